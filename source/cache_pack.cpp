@@ -0,0 +1,615 @@
+/*
+ * Copyright (C) 2014 Patrick Mours
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "cache_pack.hpp"
+#include <vector>
+#include <cstring> // std::memcmp, std::memcpy
+#include <algorithm>
+#include <Windows.h>
+
+// Has to be incremented whenever the layout of the records below changes, so that old pack files are discarded instead of being misinterpreted
+static constexpr uint32_t s_pack_format_version = 2;
+static constexpr char s_pack_format_magic[4] = { 'R', 'S', 'P', 'K' };
+
+// Entries smaller than this are not worth compressing
+static constexpr size_t s_compression_threshold = 4096;
+// Size of the window into the pack file that is mapped at once, which is large enough to cover many entries, but small enough to not exhaust the address space of 32-bit processes
+static constexpr size_t s_view_size = 16 * 1024 * 1024;
+
+enum record_flags : uint32_t
+{
+	record_flag_compressed = 1 << 0,
+	record_flag_removed = 1 << 1,
+	record_flag_used = 1 << 2,
+};
+
+// Every record consists of this header, followed by the key and then the (potentially compressed) entry data
+// A record with the "removed" flag and no data marks the removal of an entry that was written before
+// A record with the "used" flag and no data marks that an entry that was written before was used again, which moves it to the end of the least recently used order
+struct record_header
+{
+	uint32_t key_size;
+	uint32_t stored_size;
+	uint32_t original_size;
+	uint32_t flags;
+	uint32_t checksum;
+};
+
+static uint32_t compute_checksum(std::string_view key, std::string_view data)
+{
+	// FNV-1a, which is fast enough to verify every entry when it is loaded
+	uint32_t hash = 2166136261u;
+	for (const char c : key)
+		hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+	for (const char c : data)
+		hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+	return hash;
+}
+
+// Use the LZNT1 compression built into Windows, which is fast and available on all supported versions
+typedef LONG(NTAPI *PFN_RtlGetCompressionWorkSpaceSize)(USHORT CompressionFormatAndEngine, PULONG CompressBufferWorkSpaceSize, PULONG CompressFragmentWorkSpaceSize);
+typedef LONG(NTAPI *PFN_RtlCompressBuffer)(USHORT CompressionFormatAndEngine, PUCHAR UncompressedBuffer, ULONG UncompressedBufferSize, PUCHAR CompressedBuffer, ULONG CompressedBufferSize, ULONG UncompressedChunkSize, PULONG FinalCompressedSize, PVOID WorkSpace);
+typedef LONG(NTAPI *PFN_RtlDecompressBuffer)(USHORT CompressionFormat, PUCHAR UncompressedBuffer, ULONG UncompressedBufferSize, PUCHAR CompressedBuffer, ULONG CompressedBufferSize, PULONG FinalUncompressedSize);
+
+static bool compress(const std::string &data, std::string &compressed)
+{
+	static const auto s_get_work_space_size = reinterpret_cast<PFN_RtlGetCompressionWorkSpaceSize>(GetProcAddress(GetModuleHandleW(L"ntdll.dll"), "RtlGetCompressionWorkSpaceSize"));
+	static const auto s_compress_buffer = reinterpret_cast<PFN_RtlCompressBuffer>(GetProcAddress(GetModuleHandleW(L"ntdll.dll"), "RtlCompressBuffer"));
+	if (s_get_work_space_size == nullptr || s_compress_buffer == nullptr)
+		return false;
+
+	ULONG work_space_size = 0, fragment_work_space_size = 0;
+	if (s_get_work_space_size(COMPRESSION_FORMAT_LZNT1 | COMPRESSION_ENGINE_STANDARD, &work_space_size, &fragment_work_space_size) != 0)
+		return false;
+
+	std::vector<uint8_t> work_space(work_space_size);
+
+	// Only keep the compressed data if it is actually smaller, so fail if it does not fit into less space than the input
+	compressed.resize(data.size() - 1);
+
+	ULONG compressed_size = 0;
+	if (s_compress_buffer(COMPRESSION_FORMAT_LZNT1 | COMPRESSION_ENGINE_STANDARD,
+			reinterpret_cast<PUCHAR>(const_cast<char *>(data.data())), static_cast<ULONG>(data.size()),
+			reinterpret_cast<PUCHAR>(compressed.data()), static_cast<ULONG>(compressed.size()),
+			4096, &compressed_size, work_space.data()) != 0)
+		return false;
+
+	compressed.resize(compressed_size);
+	return true;
+}
+static bool decompress(std::string_view compressed, size_t original_size, std::string &data)
+{
+	static const auto s_decompress_buffer = reinterpret_cast<PFN_RtlDecompressBuffer>(GetProcAddress(GetModuleHandleW(L"ntdll.dll"), "RtlDecompressBuffer"));
+	if (s_decompress_buffer == nullptr)
+		return false;
+
+	data.resize(original_size);
+
+	ULONG final_size = 0;
+	return s_decompress_buffer(COMPRESSION_FORMAT_LZNT1,
+			reinterpret_cast<PUCHAR>(data.data()), static_cast<ULONG>(data.size()),
+			reinterpret_cast<PUCHAR>(const_cast<char *>(compressed.data())), static_cast<ULONG>(compressed.size()),
+			&final_size) == 0 && final_size == original_size;
+}
+
+static bool write_file(HANDLE file, uint64_t offset, const void *data, size_t size)
+{
+	LARGE_INTEGER position;
+	position.QuadPart = static_cast<LONGLONG>(offset);
+	if (!SetFilePointerEx(file, position, nullptr, FILE_BEGIN))
+		return false;
+
+	DWORD size_written = 0;
+	return WriteFile(file, data, static_cast<DWORD>(size), &size_written, nullptr) && size_written == size;
+}
+
+static void append_record(std::string &records, const std::string &key, std::string_view data, uint32_t original_size, uint32_t flags)
+{
+	record_header header;
+	header.key_size = static_cast<uint32_t>(key.size());
+	header.stored_size = static_cast<uint32_t>(data.size());
+	header.original_size = original_size;
+	header.flags = flags;
+	header.checksum = compute_checksum(key, data);
+
+	records.append(reinterpret_cast<const char *>(&header), sizeof(header));
+	records.append(key);
+	records.append(data);
+}
+
+std::shared_ptr<reshade::cache_pack> reshade::cache_pack::open(const std::filesystem::path &path)
+{
+	// Multiple runtimes in the same process share the instance, since the pack file can only be opened for writing once
+	static std::mutex s_packs_mutex;
+	static std::unordered_map<std::wstring, std::weak_ptr<cache_pack>> s_packs;
+
+	const std::unique_lock<std::mutex> lock(s_packs_mutex);
+
+	std::weak_ptr<cache_pack> &existing_pack = s_packs[path.native()];
+	if (std::shared_ptr<cache_pack> pack = existing_pack.lock())
+		return pack;
+
+	const std::shared_ptr<cache_pack> pack(new cache_pack(path));
+	if (!pack->open_file())
+		return nullptr;
+
+	existing_pack = pack;
+	return pack;
+}
+
+reshade::cache_pack::cache_pack(const std::filesystem::path &path) : _path(path)
+{
+}
+reshade::cache_pack::~cache_pack()
+{
+	close_file();
+}
+
+void reshade::cache_pack::configure(uint64_t size_limit, bool compression)
+{
+	const std::unique_lock<std::mutex> lock(_mutex);
+
+	_size_limit = size_limit;
+	_compression = compression;
+
+	if (_live_size > _size_limit && !_read_only)
+		evict();
+}
+
+bool reshade::cache_pack::load(const std::string &key, std::string &data)
+{
+	std::string stored_data;
+	entry entry;
+
+	{	const std::unique_lock<std::mutex> lock(_mutex);
+
+		const auto it = _entries.find(key);
+		if (it == _entries.end())
+		{
+			_misses++;
+			return false;
+		}
+
+		entry = it->second;
+
+		const char *const record = map_range(entry.offset, sizeof(record_header) + key.size() + entry.stored_size);
+		if (record != nullptr)
+			stored_data.assign(record + sizeof(record_header) + key.size(), entry.stored_size);
+
+		// Drop entries that can no longer be read, so that they are written again
+		if (record == nullptr)
+		{
+			_live_size -= sizeof(record_header) + key.size() + entry.stored_size;
+			_entries.erase(it);
+			_misses++;
+			return false;
+		}
+
+		it->second.last_use = ++_use_counter;
+
+		// Record the first use in this session in the pack file, so that the order in which entries were used survives a restart
+		// Later uses in the same session are only tracked in memory, so that this costs no more than one small write per entry
+		if (!it->second.use_recorded && !_read_only)
+		{
+			std::string records;
+			append_record(records, key, std::string_view(), 0, record_flag_used);
+			it->second.use_recorded = append(records);
+		}
+	}
+
+	// Verify the data outside the lock, so that loading large entries on multiple threads does not serialize on it
+	if (compute_checksum(key, stored_data) != entry.checksum)
+	{
+		const std::unique_lock<std::mutex> lock(_mutex);
+
+		// Drop the corrupted entry, unless it was replaced in the meantime
+		if (const auto it = _entries.find(key); it != _entries.end() && it->second.offset == entry.offset)
+		{
+			_live_size -= sizeof(record_header) + key.size() + entry.stored_size;
+			_entries.erase(it);
+		}
+
+		_misses++;
+		return false;
+	}
+
+	if (entry.compressed)
+	{
+		if (!decompress(stored_data, entry.original_size, data))
+		{
+			_misses++;
+			return false;
+		}
+	}
+	else
+	{
+		data = std::move(stored_data);
+	}
+
+	_hits++;
+	return true;
+}
+bool reshade::cache_pack::save(const std::string &key, const std::string &data)
+{
+	if (key.empty() || data.size() > std::numeric_limits<uint32_t>::max() || _read_only)
+		return false;
+
+	bool compression;
+	{	const std::unique_lock<std::mutex> lock(_mutex);
+		compression = _compression;
+	}
+
+	// Compress outside the lock, so that other threads can keep loading entries in the meantime
+	bool compressed = false;
+	std::string compressed_data;
+	if (compression && data.size() >= s_compression_threshold)
+		compressed = compress(data, compressed_data);
+
+	const std::string_view stored_data = compressed ? std::string_view(compressed_data) : std::string_view(data);
+
+	std::string record;
+	append_record(record, key, stored_data, static_cast<uint32_t>(data.size()), compressed ? record_flag_compressed : 0);
+
+	const std::unique_lock<std::mutex> lock(_mutex);
+
+	const uint64_t offset = _file_size;
+	if (!append(record))
+		return false;
+
+	if (const auto it = _entries.find(key); it != _entries.end())
+		_live_size -= sizeof(record_header) + key.size() + it->second.stored_size;
+	_live_size += record.size();
+
+	_entries[key] = { offset, static_cast<uint32_t>(stored_data.size()), static_cast<uint32_t>(data.size()), compute_checksum(key, stored_data), compressed, ++_use_counter, true };
+
+	if (_live_size > _size_limit)
+		evict();
+
+	return true;
+}
+
+void reshade::cache_pack::clear()
+{
+	const std::unique_lock<std::mutex> lock(_mutex);
+
+	if (_file == nullptr)
+		return;
+
+	// Another process owns the pack file, so only forget about the entries in this one
+	if (_read_only)
+	{
+		_entries.clear();
+		_live_size = 0;
+		return;
+	}
+
+	// Cannot truncate a file while it is mapped
+	close_mapping();
+
+	LARGE_INTEGER position;
+	position.QuadPart = sizeof(s_pack_format_magic) + sizeof(s_pack_format_version);
+	if (SetFilePointerEx(_file, position, nullptr, FILE_BEGIN))
+		SetEndOfFile(_file);
+
+	_entries.clear();
+	_file_size = position.QuadPart;
+	_live_size = 0;
+}
+void reshade::cache_pack::compact()
+{
+	const std::unique_lock<std::mutex> lock(_mutex);
+
+	if (compaction_worthwhile())
+		compact_locked();
+}
+
+bool reshade::cache_pack::open_file()
+{
+	_file = CreateFileW(_path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_ARCHIVE, nullptr);
+	if (_file == INVALID_HANDLE_VALUE)
+	{
+		// Another process (e.g. a second instance of the same application) may have the pack file open for writing already, in which case fall back to only reading entries from it
+		_file = CreateFileW(_path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_ARCHIVE, nullptr);
+		if (_file == INVALID_HANDLE_VALUE)
+		{
+			_file = nullptr;
+			return false;
+		}
+
+		_read_only = true;
+	}
+
+	LARGE_INTEGER file_size = {};
+	GetFileSizeEx(_file, &file_size);
+	_file_size = file_size.QuadPart;
+
+	if (!read_index())
+	{
+		if (_read_only)
+		{
+			close_file();
+			return false;
+		}
+
+		// Start over with an empty pack if the file is new or was written by an incompatible version
+		close_mapping();
+
+		char header[sizeof(s_pack_format_magic) + sizeof(s_pack_format_version)];
+		std::memcpy(header, s_pack_format_magic, sizeof(s_pack_format_magic));
+		std::memcpy(header + sizeof(s_pack_format_magic), &s_pack_format_version, sizeof(s_pack_format_version));
+
+		if (!write_file(_file, 0, header, sizeof(header)) || !SetEndOfFile(_file))
+		{
+			close_file();
+			return false;
+		}
+
+		_entries.clear();
+		_file_size = sizeof(header);
+		_live_size = 0;
+	}
+
+	// Reclaim space now if a lot of it is taken up by entries that were replaced or evicted before
+	if (compaction_worthwhile())
+		compact_locked();
+
+	return true;
+}
+void reshade::cache_pack::close_file()
+{
+	close_mapping();
+
+	if (_file != nullptr)
+		CloseHandle(_file);
+	_file = nullptr;
+}
+void reshade::cache_pack::close_mapping()
+{
+	if (_view != nullptr)
+		UnmapViewOfFile(_view);
+	_view = nullptr;
+	_view_offset = 0;
+	_view_size = 0;
+
+	if (_mapping != nullptr)
+		CloseHandle(_mapping);
+	_mapping = nullptr;
+	_mapping_size = 0;
+}
+
+const char *reshade::cache_pack::map_range(uint64_t offset, size_t size)
+{
+	if (_view != nullptr && offset >= _view_offset && offset + size <= _view_offset + _view_size)
+		return _view + (offset - _view_offset);
+
+	if (_file == nullptr || offset + size > _file_size)
+		return nullptr;
+
+	if (_view != nullptr)
+		UnmapViewOfFile(_view);
+	_view = nullptr;
+
+	// The file grows as entries are appended, so create a new mapping that covers the additional data when necessary
+	if (offset + size > _mapping_size)
+	{
+		close_mapping();
+
+		_mapping = CreateFileMappingW(_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (_mapping == nullptr)
+			return nullptr;
+		_mapping_size = _file_size;
+	}
+
+	static const DWORD s_allocation_granularity = []() {
+		SYSTEM_INFO system_info = {};
+		GetSystemInfo(&system_info);
+		return system_info.dwAllocationGranularity;
+	}();
+
+	_view_offset = offset - (offset % s_allocation_granularity);
+	_view_size = static_cast<size_t>(std::min<uint64_t>(_mapping_size - _view_offset, std::max<uint64_t>(offset + size - _view_offset, s_view_size)));
+	_view = static_cast<const char *>(MapViewOfFile(_mapping, FILE_MAP_READ, static_cast<DWORD>(_view_offset >> 32), static_cast<DWORD>(_view_offset & 0xFFFFFFFF), _view_size));
+	if (_view == nullptr)
+		return nullptr;
+
+	return _view + (offset - _view_offset);
+}
+
+bool reshade::cache_pack::read_index()
+{
+	_entries.clear();
+	_live_size = 0;
+	_use_counter = 0;
+
+	const char *const header = map_range(0, sizeof(s_pack_format_magic) + sizeof(s_pack_format_version));
+	if (header == nullptr ||
+		std::memcmp(header, s_pack_format_magic, sizeof(s_pack_format_magic)) != 0 ||
+		std::memcmp(header + sizeof(s_pack_format_magic), &s_pack_format_version, sizeof(s_pack_format_version)) != 0)
+		return false;
+
+	// Replay all records in the order they were appended, so that later ones replace earlier ones with the same key
+	// Records were written from least to most recently used during the last compaction, and saved entries and records marking the first use of an entry in a session are appended afterwards, so this order also reflects how recently they were used
+	uint64_t offset = sizeof(s_pack_format_magic) + sizeof(s_pack_format_version);
+	while (offset + sizeof(record_header) <= _file_size)
+	{
+		const char *const record_data = map_range(offset, sizeof(record_header));
+		if (record_data == nullptr)
+			break;
+
+		record_header record;
+		std::memcpy(&record, record_data, sizeof(record));
+
+		const uint64_t record_size = sizeof(record_header) + static_cast<uint64_t>(record.key_size) + record.stored_size;
+		if (record.key_size == 0 || offset + record_size > _file_size || (record.flags & ~(record_flag_compressed | record_flag_removed | record_flag_used)) != 0)
+			break; // Stop at the first incomplete record, which happens when the application was terminated while writing it
+
+		const char *const key_data = map_range(offset + sizeof(record_header), record.key_size);
+		if (key_data == nullptr)
+			break;
+		const std::string key(key_data, record.key_size);
+
+		if ((record.flags & record_flag_used) != 0)
+		{
+			if (const auto it = _entries.find(key); it != _entries.end())
+				it->second.last_use = ++_use_counter;
+
+			offset += record_size;
+			continue;
+		}
+
+		if (const auto it = _entries.find(key); it != _entries.end())
+		{
+			_live_size -= sizeof(record_header) + key.size() + it->second.stored_size;
+			_entries.erase(it);
+		}
+
+		if ((record.flags & record_flag_removed) == 0)
+		{
+			_entries.emplace(key, entry { offset, record.stored_size, record.original_size, record.checksum, (record.flags & record_flag_compressed) != 0, ++_use_counter, false });
+			_live_size += record_size;
+		}
+
+		offset += record_size;
+	}
+
+	// Discard any incomplete data at the end, so that the next record is appended right after the last valid one
+	// When reading a pack file another process is writing, that may be a record it is still writing, so only ignore it in that case
+	if (offset != _file_size && _read_only)
+	{
+		_file_size = offset;
+	}
+	else if (offset != _file_size)
+	{
+		close_mapping();
+
+		LARGE_INTEGER position;
+		position.QuadPart = static_cast<LONGLONG>(offset);
+		if (SetFilePointerEx(_file, position, nullptr, FILE_BEGIN))
+			SetEndOfFile(_file);
+
+		_file_size = offset;
+	}
+
+	return true;
+}
+
+bool reshade::cache_pack::append(const std::string &records)
+{
+	if (_file == nullptr || !write_file(_file, _file_size, records.data(), records.size()))
+		return false;
+
+	_file_size += records.size();
+	return true;
+}
+
+void reshade::cache_pack::evict()
+{
+	std::vector<std::unordered_map<std::string, entry>::const_iterator> entries;
+	entries.reserve(_entries.size());
+	for (auto it = _entries.cbegin(); it != _entries.cend(); ++it)
+		entries.push_back(it);
+
+	std::sort(entries.begin(), entries.end(),
+		[](const auto &lhs, const auto &rhs) { return lhs->second.last_use < rhs->second.last_use; });
+
+	// Evict down to three quarters of the limit, so that this does not have to be repeated on every following save
+	std::string records;
+	for (const auto &it : entries)
+	{
+		if (_live_size <= _size_limit / 4 * 3)
+			break;
+
+		append_record(records, it->first, std::string_view(), 0, record_flag_removed);
+
+		_live_size -= sizeof(record_header) + it->first.size() + it->second.stored_size;
+		_entries.erase(it);
+	}
+
+	append(records);
+
+	// Leave reclaiming the space to 'compact', since that rewrites the entire file, during which all other operations on the pack would be blocked
+}
+
+bool reshade::cache_pack::compaction_worthwhile() const
+{
+	return !_read_only && _file_size > 2 * _live_size + s_view_size;
+}
+
+void reshade::cache_pack::compact_locked()
+{
+	if (_file == nullptr)
+		return;
+
+	std::vector<std::unordered_map<std::string, entry>::iterator> entries;
+	entries.reserve(_entries.size());
+	for (auto it = _entries.begin(); it != _entries.end(); ++it)
+		entries.push_back(it);
+
+	std::sort(entries.begin(), entries.end(),
+		[](const auto &lhs, const auto &rhs) { return lhs->second.last_use < rhs->second.last_use; });
+
+	std::filesystem::path temp_path = _path;
+	temp_path += L".tmp";
+
+	const HANDLE temp_file = CreateFileW(temp_path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_ARCHIVE | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (temp_file == INVALID_HANDLE_VALUE)
+		return;
+
+	const char *const header = map_range(0, sizeof(s_pack_format_magic) + sizeof(s_pack_format_version));
+	bool success = header != nullptr && write_file(temp_file, 0, header, sizeof(s_pack_format_magic) + sizeof(s_pack_format_version));
+
+	// Copy all records that are still in use to the new file, directly from the mapped views of the old one
+	std::vector<uint64_t> offsets;
+	offsets.reserve(entries.size());
+	uint64_t offset = sizeof(s_pack_format_magic) + sizeof(s_pack_format_version);
+	for (size_t i = 0; i < entries.size() && success; ++i)
+	{
+		const entry &entry = entries[i]->second;
+		const size_t record_size = sizeof(record_header) + entries[i]->first.size() + entry.stored_size;
+
+		const char *const record = map_range(entry.offset, record_size);
+		success = record != nullptr && write_file(temp_file, offset, record, record_size);
+
+		offsets.push_back(offset);
+		offset += record_size;
+	}
+
+	CloseHandle(temp_file);
+
+	if (success)
+	{
+		close_file();
+		success = MoveFileExW(temp_path.c_str(), _path.c_str(), MOVEFILE_REPLACE_EXISTING) != FALSE;
+	}
+	else
+	{
+		DeleteFileW(temp_path.c_str());
+		return;
+	}
+
+	if (success)
+	{
+		// The new file is ordered by when entries were last used, so the next use of any entry has to be recorded again to move it to the end
+		for (size_t i = 0; i < entries.size(); ++i)
+		{
+			entries[i]->second.offset = offsets[i];
+			entries[i]->second.use_recorded = false;
+		}
+		_file_size = offset;
+	}
+	else
+	{
+		DeleteFileW(temp_path.c_str());
+	}
+
+	// Reopen the pack file (which is the old one if it could not be replaced, in which case the index still matches it)
+	_file = CreateFileW(_path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_ARCHIVE, nullptr);
+	if (_file == INVALID_HANDLE_VALUE)
+	{
+		_file = nullptr;
+		_entries.clear();
+		_live_size = 0;
+	}
+}
@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2014 Patrick Mours
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <limits>
+#include <string>
+#include <filesystem>
+#include <unordered_map>
+
+namespace reshade
+{
+	/// <summary>
+	/// A cache of binary data that stores all entries in a single append-only pack file, which is memory-mapped for reading.
+	/// When the total size of all entries exceeds the size limit, the entries that were not used for the longest time are evicted and the space they occupied is reclaimed by compacting the file.
+	/// </summary>
+	class cache_pack
+	{
+	public:
+		/// <summary>
+		/// Opens the pack file at the specified <paramref name="path"/>, or returns the instance that already has it open.
+		/// </summary>
+		/// <param name="path">Path to the pack file, which is created if it does not exist yet.</param>
+		/// <returns>Pointer to the pack, or <see langword="nullptr"/> if the file could not be opened (e.g. because another process is using it).</returns>
+		static std::shared_ptr<cache_pack> open(const std::filesystem::path &path);
+
+		cache_pack(const cache_pack &) = delete;
+		cache_pack &operator=(const cache_pack &) = delete;
+		~cache_pack();
+
+		/// <summary>
+		/// Gets the path to the pack file.
+		/// </summary>
+		const std::filesystem::path &path() const { return _path; }
+
+		/// <summary>
+		/// Changes the maximum total size of all entries and whether large entries are compressed when they are saved.
+		/// </summary>
+		/// <param name="size_limit">Size limit in bytes.</param>
+		/// <param name="compression">Set to <see langword="true"/> to compress large entries.</param>
+		void configure(uint64_t size_limit, bool compression);
+
+		/// <summary>
+		/// Reads the entry with the specified <paramref name="key"/>.
+		/// </summary>
+		/// <param name="key">Unique name of the entry.</param>
+		/// <param name="data">String that is overwritten with the entry data.</param>
+		/// <returns><see langword="true"/> if the entry exists and its data is intact, <see langword="false"/> otherwise.</returns>
+		bool load(const std::string &key, std::string &data);
+		/// <summary>
+		/// Adds an entry with the specified <paramref name="key"/>, replacing any existing one with the same key.
+		/// </summary>
+		/// <param name="key">Unique name of the entry.</param>
+		/// <param name="data">Data to store.</param>
+		/// <returns><see langword="true"/> if the entry was written to the pack file, <see langword="false"/> otherwise.</returns>
+		bool save(const std::string &key, const std::string &data);
+
+		/// <summary>
+		/// Removes all entries.
+		/// </summary>
+		void clear();
+		/// <summary>
+		/// Rewrites the pack file with only the entries that are still in use, ordered from least to most recently used, if a large part of it is taken up by entries that were replaced or evicted.
+		/// This blocks all other operations on the pack until it finished, so should only be called while no effects are being loaded.
+		/// </summary>
+		void compact();
+
+		/// <summary>
+		/// Gets whether the pack file is opened by another process and this instance can therefore only read entries that were in it when it was opened.
+		/// </summary>
+		bool read_only() const { return _read_only; }
+
+		/// <summary>
+		/// Gets the number of successful loads since the pack was opened.
+		/// </summary>
+		uint64_t hits() const { return _hits; }
+		/// <summary>
+		/// Gets the number of failed loads since the pack was opened.
+		/// </summary>
+		uint64_t misses() const { return _misses; }
+		/// <summary>
+		/// Gets the total size of all entries in bytes.
+		/// </summary>
+		uint64_t size() const { return _live_size; }
+
+	private:
+		struct entry
+		{
+			uint64_t offset;
+			uint32_t stored_size;
+			uint32_t original_size;
+			uint32_t checksum;
+			bool compressed;
+			uint64_t last_use;
+			bool use_recorded;
+		};
+
+		explicit cache_pack(const std::filesystem::path &path);
+
+		bool open_file();
+		void close_file();
+		void close_mapping();
+		const char *map_range(uint64_t offset, size_t size);
+		bool read_index();
+		bool append(const std::string &records);
+		void evict();
+		bool compaction_worthwhile() const;
+		void compact_locked();
+
+		const std::filesystem::path _path;
+		std::mutex _mutex;
+		void *_file = nullptr;
+		void *_mapping = nullptr;
+		uint64_t _mapping_size = 0;
+		const char *_view = nullptr;
+		uint64_t _view_offset = 0;
+		size_t _view_size = 0;
+		uint64_t _file_size = 0;
+		std::atomic<uint64_t> _live_size = 0;
+		uint64_t _use_counter = 0;
+		uint64_t _size_limit = std::numeric_limits<uint64_t>::max();
+		bool _compression = false;
+		bool _read_only = false;
+		std::unordered_map<std::string, entry> _entries;
+		std::atomic<uint64_t> _hits = 0;
+		std::atomic<uint64_t> _misses = 0;
+	};
+}
@@ -9,7 +9,9 @@
 #include <cstdio> // snprintf
 #include <cassert>
 #include <cstring> // stricmp
-#include <algorithm> // std::find_if, std::max
+#include <algorithm> // std::count, std::find_if, std::max, std::min
+#include <string_view>
+#include <unordered_set>
 
 using namespace reshadefx;
 
@@ -36,9 +38,25 @@ private:
 	};
 
 	std::string _cbuffer_block;
-	std::string _current_location;
-	std::unordered_map<id, std::string> _names;
+	interned_string _current_location;
+	std::vector<std::string> _names; // Indexed by ID
+	std::unordered_multiset<std::string> _defined_names;
 	std::unordered_map<id, std::string> _blocks;
+	struct nested_block
+	{
+		size_t offset;
+		id block;
+		unsigned int indentation;
+	};
+	// Blocks that control flow statements insert into the code of another block, which are only copied together when the function is finished (see 'write_block')
+	std::unordered_map<id, std::vector<nested_block>> _nested_blocks;
+	struct global_definition
+	{
+		size_t offset;
+		std::string name;
+	};
+	// Start of every definition in the global code block, so that those an entry point does not depend on can be skipped when compiling it (see 'write_global_definitions')
+	std::vector<global_definition> _global_definitions;
 	bool _debug_info = false;
 	bool _uniforms_to_spec_constants = false;
 	unsigned int _shader_model = 0;
@@ -101,7 +119,139 @@ private:
 			module.total_uniform_size *= 4;
 		}
 
-		module.hlsl += _blocks.at(0);
+		write_global_definitions(module.hlsl, module.entry_points);
+	}
+
+	void write_global_definitions(std::string &s, const std::vector<entry_point> &entry_points) const
+	{
+		const std::string &code = _blocks.at(0);
+		const size_t num_definitions = _global_definitions.size();
+
+		if (entry_points.empty() || num_definitions == 0)
+		{
+			s += code;
+			return;
+		}
+
+		const auto definition_code = [&](size_t i) {
+			const size_t end = i + 1 < num_definitions ? _global_definitions[i + 1].offset : code.size();
+			return std::string_view(code).substr(_global_definitions[i].offset, end - _global_definitions[i].offset);
+		};
+
+		// Functions can be overloaded, so multiple definitions may share the same name
+		std::unordered_map<std::string_view, std::vector<size_t>> name_to_definitions;
+		for (size_t i = 0; i < num_definitions; ++i)
+			name_to_definitions[_global_definitions[i].name].push_back(i);
+
+		const auto is_identifier_char = [](char c) {
+			return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '_'; };
+
+		// Find the definitions each definition depends on by looking up all identifiers in its code
+		std::vector<std::vector<size_t>> references(num_definitions);
+		for (size_t i = 0; i < num_definitions; ++i)
+		{
+			const std::string_view definition = definition_code(i);
+
+			for (size_t offset = 0, begin; offset < definition.size();)
+			{
+				if (!is_identifier_char(definition[offset]))
+				{
+					offset++;
+					continue;
+				}
+
+				for (begin = offset; offset < definition.size() && is_identifier_char(definition[offset]); ++offset)
+					continue;
+
+				if (definition[begin] >= '0' && definition[begin] <= '9')
+					continue; // Skip numeric literals
+
+				if (const auto it = name_to_definitions.find(definition.substr(begin, offset - begin));
+					it != name_to_definitions.end())
+					references[i].insert(references[i].end(), it->second.begin(), it->second.end());
+			}
+		}
+
+		// Collect the entry points that depend on each definition, starting at the entry point function
+		std::vector<std::vector<size_t>> used_by(num_definitions);
+		std::vector<bool> visited;
+		std::vector<size_t> stack;
+		for (size_t entry_point_index = 0; entry_point_index < entry_points.size(); ++entry_point_index)
+		{
+			visited.assign(num_definitions, false);
+
+			if (const auto it = name_to_definitions.find(entry_points[entry_point_index].name);
+				it != name_to_definitions.end())
+				stack = it->second;
+			else // Keep everything if the entry point function cannot be found for some reason
+				for (size_t i = 0; i < num_definitions; ++i)
+					stack.push_back(i);
+
+			while (!stack.empty())
+			{
+				const size_t i = stack.back();
+				stack.pop_back();
+
+				if (visited[i])
+					continue;
+				visited[i] = true;
+
+				used_by[i].push_back(entry_point_index);
+				stack.insert(stack.end(), references[i].begin(), references[i].end());
+			}
+		}
+
+		s += std::string_view(code).substr(0, _global_definitions[0].offset);
+
+		// Remove definitions that are not used by any entry point and put those only used by some of them in a conditional block, which is only compiled when one of those is (the application defines "ENTRY_POINT_<name>" for that)
+		const std::vector<size_t> *current_condition = nullptr;
+
+		for (size_t i = 0; i < num_definitions; ++i)
+		{
+			if (used_by[i].empty())
+				continue;
+
+			const bool is_conditional = used_by[i].size() != entry_points.size();
+
+			if (current_condition != nullptr && (!is_conditional || *current_condition != used_by[i]))
+			{
+				s += "#endif\n";
+				current_condition = nullptr;
+			}
+
+			if (is_conditional && current_condition == nullptr)
+			{
+				s += "#if ";
+				for (size_t k = 0; k < used_by[i].size(); ++k)
+				{
+					if (k != 0)
+						s += " || ";
+					s += "defined(ENTRY_POINT_" + entry_points[used_by[i][k]].name + ')';
+				}
+				s += '\n';
+
+				current_condition = &used_by[i];
+			}
+
+			s += definition_code(i);
+		}
+
+		if (current_condition != nullptr)
+			s += "#endif\n";
+	}
+
+	void begin_global_definition(std::string name)
+	{
+		if (_current_block != 0)
+			return;
+		// Entry point functions may have already been started with an attribute
+		if (!_global_definitions.empty() && _global_definitions.back().name == name)
+			return;
+
+		_global_definitions.push_back({ _blocks.at(0).size(), std::move(name) });
+
+		// The line directive containing the current file name may be skipped together with the previous definition, so need to write it again
+		_current_location = interned_string();
 	}
 
 	template <bool is_param = false, bool is_decl = true>
@@ -272,11 +422,11 @@ private:
 		// Avoid writing the file name every time to reduce output text size
 		if constexpr (force_source)
 		{
-			s += " \"" + loc.source + '\"';
+			s += " \"" + loc.source.str() + '\"';
 		}
 		else if (loc.source != _current_location)
 		{
-			s += " \"" + loc.source + '\"';
+			s += " \"" + loc.source.str() + '\"';
 
 			_current_location = loc.source;
 		}
@@ -294,9 +444,8 @@ private:
 	std::string id_to_name(id id) const
 	{
 		assert(id != 0);
-		if (const auto names_it = _names.find(id);
-			names_it != _names.end())
-			return names_it->second;
+		if (id < _names.size() && !_names[id].empty())
+			return _names[id];
 		return '_' + std::to_string(id);
 	}
 
@@ -309,8 +458,13 @@ private:
 				return; // Filter out names that may clash with automatic ones
 		name = escape_name(std::move(name));
 		if constexpr (naming_type == naming::general)
-			if (std::find_if(_names.begin(), _names.end(), [&name](const auto &it) { return it.second == name; }) != _names.end())
+			if (_defined_names.find(name) != _defined_names.end())
 				name += '_' + std::to_string(id); // Append a numbered suffix if the name already exists
+		if (id >= _names.size())
+			_names.resize(id + 1);
+		else if (!_names[id].empty())
+			_defined_names.erase(_defined_names.find(_names[id]));
+		_defined_names.insert(name);
 		_names[id] = std::move(name);
 	}
 
@@ -360,15 +514,64 @@ private:
 		return name;
 	}
 
-	static void increase_indentation_level(std::string &block)
+	void insert_block(id block, unsigned int indentation = 0)
+	{
+		_nested_blocks[_current_block].push_back({ _blocks.at(_current_block).size(), block, indentation });
+	}
+
+	bool is_empty_block(id block) const
+	{
+		return _blocks.at(block).empty() && _nested_blocks.find(block) == _nested_blocks.end();
+	}
+
+	void write_block(std::string &s, id block, unsigned int indentation = 0) const
 	{
-		if (block.empty())
+		const std::string_view code = _blocks.at(block);
+
+		size_t offset = 0;
+		if (const auto it = _nested_blocks.find(block);
+			it != _nested_blocks.end())
+		{
+			for (const nested_block &nested : it->second)
+			{
+				write_indented(s, code.substr(offset, nested.offset - offset), indentation);
+				write_block(s, nested.block, indentation + nested.indentation);
+				offset = nested.offset;
+			}
+		}
+
+		write_indented(s, code.substr(offset), indentation);
+	}
+	static void write_indented(std::string &s, std::string_view code, unsigned int indentation)
+	{
+		if (indentation == 0)
+		{
+			s += code;
 			return;
+		}
+
+		// Only lines that are already indented are indented further, so that preprocessor directives stay at the start of the line
+		for (size_t line_begin = 0, line_end; line_begin < code.size(); line_begin = line_end)
+		{
+			line_end = std::min(code.find('\n', line_begin), code.size() - 1) + 1;
+
+			if (code[line_begin] == '\t')
+				s.append(indentation, '\t');
+			s += code.substr(line_begin, line_end - line_begin);
+		}
+	}
 
-		for (size_t pos = 0; (pos = block.find("\n\t", pos)) != std::string::npos; pos += 3)
-			block.replace(pos, 2, "\n\t\t");
+	void erase_block(id block)
+	{
+		if (const auto it = _nested_blocks.find(block);
+			it != _nested_blocks.end())
+		{
+			for (const nested_block &nested : it->second)
+				erase_block(nested.block);
+			_nested_blocks.erase(it);
+		}
 
-		block.insert(block.begin(), '\t');
+		_blocks.erase(block);
 	}
 
 	id   define_struct(const location &loc, struct_info &info) override
@@ -378,6 +581,8 @@ private:
 
 		_structs.push_back(info);
 
+		begin_global_definition(id_to_name(info.definition));
+
 		std::string &code = _blocks.at(_current_block);
 
 		write_location(code, loc);
@@ -412,11 +617,18 @@ private:
 			info.binding = _module.num_texture_bindings;
 			_module.num_texture_bindings += 2;
 
+			begin_global_definition("__" + info.unique_name);
+
 			std::string &code = _blocks.at(_current_block);
 
 			write_location(code, loc);
 
 			code += "Texture2D __"     + info.unique_name + " : register(t" + std::to_string(info.binding + 0) + ");\n";
+
+			begin_global_definition("__srgb" + info.unique_name);
+
+			write_location(code, loc);
+
 			code += "Texture2D __srgb" + info.unique_name + " : register(t" + std::to_string(info.binding + 1) + ");\n";
 		}
 
@@ -454,12 +666,16 @@ private:
 			{
 				info.binding = _module.num_sampler_bindings++;
 
+				begin_global_definition("__s" + std::to_string(info.binding));
+
 				code += "SamplerState __s" + std::to_string(info.binding) + " : register(s" + std::to_string(info.binding) + ");\n";
 			}
 
 			assert(info.srgb == 0 || info.srgb == 1);
 			info.texture_binding = texture->binding + info.srgb; // Offset binding by one to choose the SRGB variant
 
+			begin_global_definition(id_to_name(info.id));
+
 			write_location(code, loc);
 
 			code += "static const __sampler2D " + id_to_name(info.id) + " = { " + (info.srgb ? "__srgb" : "__") + info.texture_name + ", __s" + std::to_string(info.binding) + " };\n";
@@ -469,8 +685,12 @@ private:
 			info.binding = _module.num_sampler_bindings++;
 			info.texture_binding = ~0u; // Unset texture binding
 
+			begin_global_definition("__" + info.unique_name + "_s");
+
 			code += "sampler2D __" + info.unique_name + "_s : register(s" + std::to_string(info.binding) + ");\n";
 
+			begin_global_definition(id_to_name(info.id));
+
 			write_location(code, loc);
 
 			code += "static const __sampler2D " + id_to_name(info.id) + " = { __" + info.unique_name + "_s, float2(";
@@ -498,6 +718,8 @@ private:
 		{
 			info.binding = _module.num_storage_bindings++;
 
+			begin_global_definition(info.unique_name);
+
 			std::string &code = _blocks.at(_current_block);
 
 			write_location(code, loc);
@@ -548,6 +770,8 @@ private:
 			if (info.type.is_array())
 				info.size *= info.type.array_length;
 
+			begin_global_definition(id_to_name(res));
+
 			std::string &code = _blocks.at(_current_block);
 
 			write_location(code, loc);
@@ -627,6 +851,9 @@ private:
 		if (!name.empty())
 			define_name<naming::general>(res, name);
 
+		if (global)
+			begin_global_definition(id_to_name(res));
+
 		std::string &code = _blocks.at(_current_block);
 
 		write_location(code, loc);
@@ -656,6 +883,8 @@ private:
 
 		define_name<naming::unique>(info.definition, info.unique_name);
 
+		begin_global_definition(id_to_name(info.definition));
+
 		std::string &code = _blocks.at(_current_block);
 
 		write_location(code, loc);
@@ -779,6 +1008,8 @@ private:
 			}
 		}
 
+		begin_global_definition(func.unique_name);
+
 		if (stype == shader_type::cs)
 			_blocks.at(_current_block) += "[numthreads(" +
 				std::to_string(num_threads[0]) + ", " +
@@ -967,6 +1198,8 @@ private:
 		{
 			assert(type.has(type::q_const));
 
+			begin_global_definition(id_to_name(res));
+
 			std::string &code = _blocks.at(_current_block);
 
 			// Array constants need to be stored in a constant variable as they cannot be used in-place
@@ -1285,15 +1518,9 @@ private:
 	{
 		assert(condition_value != 0 && condition_block != 0 && true_statement_block != 0 && false_statement_block != 0);
 
-		std::string &code = _blocks.at(_current_block);
-
-		std::string &true_statement_data = _blocks.at(true_statement_block);
-		std::string &false_statement_data = _blocks.at(false_statement_block);
-
-		increase_indentation_level(true_statement_data);
-		increase_indentation_level(false_statement_data);
+		insert_block(condition_block);
 
-		code += _blocks.at(condition_block);
+		std::string &code = _blocks.at(_current_block);
 
 		write_location(code, loc);
 
@@ -1303,36 +1530,25 @@ private:
 		if (flags & 0x2) code += "[branch] ";
 
 		code += "if (" + id_to_name(condition_value) + ")\n\t{\n";
-		code += true_statement_data;
+		insert_block(true_statement_block, 1);
 		code += "\t}\n";
 
-		if (!false_statement_data.empty())
+		if (!is_empty_block(false_statement_block))
 		{
 			code += "\telse\n\t{\n";
-			code += false_statement_data;
+			insert_block(false_statement_block, 1);
 			code += "\t}\n";
 		}
-
-		// Remove consumed blocks to save memory
-		_blocks.erase(condition_block);
-		_blocks.erase(true_statement_block);
-		_blocks.erase(false_statement_block);
 	}
 	id   emit_phi(const location &loc, id condition_value, id condition_block, id true_value, id true_statement_block, id false_value, id false_statement_block, const type &type) override
 	{
 		assert(condition_value != 0 && condition_block != 0 && true_value != 0 && true_statement_block != 0 && false_value != 0 && false_statement_block != 0);
 
-		std::string &code = _blocks.at(_current_block);
-
-		std::string &true_statement_data = _blocks.at(true_statement_block);
-		std::string &false_statement_data = _blocks.at(false_statement_block);
-
-		increase_indentation_level(true_statement_data);
-		increase_indentation_level(false_statement_data);
-
 		const id res = make_id();
 
-		code += _blocks.at(condition_block);
+		insert_block(condition_block);
+
+		std::string &code = _blocks.at(_current_block);
 
 		code += '\t';
 		write_type(code, type);
@@ -1341,34 +1557,29 @@ private:
 		write_location(code, loc);
 
 		code += "\tif (" + id_to_name(condition_value) + ")\n\t{\n";
-		code += (true_statement_block != condition_block ? true_statement_data : std::string());
+		if (true_statement_block != condition_block)
+			insert_block(true_statement_block, 1);
 		code += "\t\t" + id_to_name(res) + " = " + id_to_name(true_value) + ";\n";
 		code += "\t}\n\telse\n\t{\n";
-		code += (false_statement_block != condition_block ? false_statement_data : std::string());
+		if (false_statement_block != condition_block)
+			insert_block(false_statement_block, 1);
 		code += "\t\t" + id_to_name(res) + " = " + id_to_name(false_value) + ";\n";
 		code += "\t}\n";
 
-		// Remove consumed blocks to save memory
-		_blocks.erase(condition_block);
-		_blocks.erase(true_statement_block);
-		_blocks.erase(false_statement_block);
-
 		return res;
 	}
 	void emit_loop(const location &loc, id condition_value, id prev_block, id header_block, id condition_block, id loop_block, id continue_block, unsigned int flags) override
 	{
 		assert(prev_block != 0 && header_block != 0 && loop_block != 0 && continue_block != 0);
 
-		std::string &code = _blocks.at(_current_block);
+		// The continue block is modified below, so flatten it into a single string first
+		std::string continue_data;
+		write_block(continue_data, continue_block);
+		erase_block(continue_block);
 
-		std::string &loop_data = _blocks.at(loop_block);
-		std::string &continue_data = _blocks.at(continue_block);
+		insert_block(prev_block);
 
-		increase_indentation_level(loop_data);
-		increase_indentation_level(loop_data);
-		increase_indentation_level(continue_data);
-
-		code += _blocks.at(prev_block);
+		std::string &code = _blocks.at(_current_block);
 
 		std::string attributes;
 		if (flags & 0x1)
@@ -1386,25 +1597,20 @@ private:
 			auto pos_prev_assign = continue_data.rfind('\t', pos_assign);
 			continue_data.erase(pos_prev_assign + 1, pos_assign - pos_prev_assign - 1);
 
-			// We need to add the continue block to all "continue" statements as well
-			const std::string continue_id = "__CONTINUE__" + std::to_string(continue_block);
-			for (size_t offset = 0; (offset = loop_data.find(continue_id, offset)) != std::string::npos; offset += continue_data.size())
-				loop_data.replace(offset, continue_id.size(), continue_data);
-
 			code += "\tbool " + condition_name + ";\n";
 
 			write_location(code, loc);
 
 			code += '\t' + attributes;
 			code += "do\n\t{\n\t\t{\n";
-			code += loop_data; // Encapsulate loop body into another scope, so not to confuse any local variables with the current iteration variable accessed in the continue block below
+			insert_block(loop_block, 2); // Encapsulate loop body into another scope, so not to confuse any local variables with the current iteration variable accessed in the continue block below
 			code += "\t\t}\n";
-			code += continue_data;
-			code += "\t}\n\twhile (" + condition_name + ");\n";
 		}
 		else
 		{
-			std::string &condition_data = _blocks.at(condition_block);
+			std::string condition_data;
+			write_block(condition_data, condition_block);
+			erase_block(condition_block);
 
 			// Work around D3DCompiler putting uniform variables that are used as the loop count register into integer registers (only in SM3)
 			// Only applies to dynamic loops with uniform variables in the condition, where it generates a loop instruction like "rep i0", but then expects the "i0" register to be set externally
@@ -1432,18 +1638,12 @@ private:
 			{
 				code += condition_data;
 
-				increase_indentation_level(condition_data);
-
 				// Convert the last SSA variable initializer to an assignment statement
 				auto pos_assign = condition_data.rfind(condition_name);
 				auto pos_prev_assign = condition_data.rfind('\t', pos_assign);
 				condition_data.erase(pos_prev_assign + 1, pos_assign - pos_prev_assign - 1);
 			}
 
-			const std::string continue_id = "__CONTINUE__" + std::to_string(continue_block);
-			for (size_t offset = 0; (offset = loop_data.find(continue_id, offset)) != std::string::npos; offset += continue_data.size())
-				loop_data.replace(offset, continue_id.size(), continue_data + condition_data);
-
 			write_location(code, loc);
 
 			code += '\t' + attributes;
@@ -1451,31 +1651,33 @@ private:
 				code += "while (true)\n\t{\n\t\tif (" + condition_name + ")\n\t\t{\n";
 			else
 				code += "while (" + condition_name + ")\n\t{\n\t\t{\n";
-			code += loop_data;
+			insert_block(loop_block, 2);
 			code += "\t\t}\n";
 			if (use_break_statement_for_condition)
 				code += "\t\telse break;\n";
-			code += continue_data;
-			code += condition_data;
-			code += "\t}\n";
 
-			_blocks.erase(condition_block);
+			continue_data += condition_data;
 		}
 
-		// Remove consumed blocks to save memory
-		_blocks.erase(prev_block);
-		_blocks.erase(header_block);
-		_blocks.erase(loop_block);
-		_blocks.erase(continue_block);
+		// The continue block was already inserted at every "continue" statement in the loop body (see 'leave_block_and_branch'), so add its final code and place it at the end of the loop as well
+		_blocks[continue_block] = std::move(continue_data);
+		insert_block(continue_block, 1);
+
+		if (condition_block == 0)
+			code += "\t}\n\twhile (" + condition_name + ");\n";
+		else
+			code += "\t}\n";
+
+		erase_block(header_block);
 	}
 	void emit_switch(const location &loc, id selector_value, id selector_block, id default_label, id default_block, const std::vector<id> &case_literal_and_labels, const std::vector<id> &case_blocks, unsigned int flags) override
 	{
 		assert(selector_value != 0 && selector_block != 0 && default_label != 0 && default_block != 0);
 		assert(case_blocks.size() == case_literal_and_labels.size() / 2);
 
-		std::string &code = _blocks.at(_current_block);
+		insert_block(selector_block);
 
-		code += _blocks.at(selector_block);
+		std::string &code = _blocks.at(_current_block);
 
 		if (_shader_model >= 40)
 		{
@@ -1516,26 +1718,16 @@ private:
 				}
 
 				assert(case_blocks[i / 2] != 0);
-				std::string &case_data = _blocks.at(case_blocks[i / 2]);
-
-				increase_indentation_level(case_data);
-
 				code += "{\n";
-				code += case_data;
+				insert_block(case_blocks[i / 2], 1);
 				code += "\t}\n";
 			}
 
 			if (default_label != 0 && default_block != _current_block)
 			{
-				std::string &default_data = _blocks.at(default_block);
-
-				increase_indentation_level(default_data);
-
 				code += "\tdefault: {\n";
-				code += default_data;
+				insert_block(default_block, 1);
 				code += "\t}\n";
-
-				_blocks.erase(default_block);
 			}
 
 			code += "\t}\n";
@@ -1567,44 +1759,25 @@ private:
 				}
 
 				assert(case_blocks[i / 2] != 0);
-				std::string &case_data = _blocks.at(case_blocks[i / 2]);
-
-				increase_indentation_level(case_data);
-
 				code += ")\n\t{\n";
-				code += case_data;
+				insert_block(case_blocks[i / 2], 1);
 				code += "\t}\n\telse\n\t";
 			}
 
 			code += "{\n";
 
 			if (default_block != _current_block)
-			{
-				std::string &default_data = _blocks.at(default_block);
-
-				increase_indentation_level(default_data);
-
-				code += default_data;
-
-				_blocks.erase(default_block);
-			}
+				insert_block(default_block, 1);
 
 			code += "\t} } while (false);\n";
 		}
-
-		// Remove consumed blocks to save memory
-		_blocks.erase(selector_block);
-		for (const id case_block : case_blocks)
-			_blocks.erase(case_block);
 	}
 
 	id   create_block() override
 	{
 		const id res = make_id();
 
-		std::string &block = _blocks.emplace(res, std::string()).first->second;
-		// Reserve a decently big enough memory block to avoid frequent reallocations
-		block.reserve(4096);
+		_blocks.emplace(res, std::string());
 
 		return res;
 	}
@@ -1680,8 +1853,9 @@ private:
 		case 1:
 			code += "\tbreak;\n";
 			break;
-		case 2: // Keep track of continue target block, so we can insert its code here later
-			code += "__CONTINUE__" + std::to_string(target) + "\tcontinue;\n";
+		case 2: // Insert the code of the continue target block here, which is only completed when the loop is emitted
+			insert_block(target);
+			code += "\tcontinue;\n";
 			break;
 		}
 
@@ -1698,7 +1872,18 @@ private:
 	{
 		assert(_last_block != 0);
 
-		_blocks.at(0) += "{\n" + _blocks.at(_last_block) + "}\n";
+		std::string &code = _blocks.at(0);
+		code += "{\n";
+		write_block(code, _last_block);
+		code += "}\n";
+
+		// Remove consumed blocks to save memory
+		for (auto it = _blocks.begin(); it != _blocks.end();)
+			if (it->first != 0)
+				it = _blocks.erase(it);
+			else
+				++it;
+		_nested_blocks.clear();
 	}
 };
 
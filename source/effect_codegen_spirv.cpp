@@ -7,7 +7,8 @@
 #include "effect_codegen.hpp"
 #include <cassert>
 #include <cstring> // memcmp
-#include <algorithm> // std::find_if, std::max
+#include <algorithm> // std::copy, std::find_if, std::max, std::remove_if
+#include <map>
 #include <unordered_set>
 
 // Use the C++ variant of the SPIR-V headers
@@ -19,37 +20,85 @@ namespace spv {
 using namespace reshadefx;
 
 /// <summary>
-/// A single instruction in a SPIR-V module
+/// Checks whether instructions with the specified opcode have a result ID and a result type ID, which determines how their words are laid out.
+/// </summary>
+static void has_result_and_type(spv::Op op, bool &has_result, bool &has_type)
+{
+	switch (op)
+	{
+	case spv::OpNop:
+	case spv::OpSource:
+	case spv::OpName:
+	case spv::OpMemberName:
+	case spv::OpLine:
+	case spv::OpDecorate:
+	case spv::OpMemberDecorate:
+	case spv::OpMemoryModel:
+	case spv::OpEntryPoint:
+	case spv::OpExecutionMode:
+	case spv::OpCapability:
+	case spv::OpFunctionEnd:
+	case spv::OpStore:
+	case spv::OpImageWrite:
+	case spv::OpControlBarrier:
+	case spv::OpMemoryBarrier:
+	case spv::OpLoopMerge:
+	case spv::OpSelectionMerge:
+	case spv::OpBranch:
+	case spv::OpBranchConditional:
+	case spv::OpSwitch:
+	case spv::OpKill:
+	case spv::OpReturn:
+	case spv::OpReturnValue:
+		has_result = false;
+		has_type = false;
+		break;
+	case spv::OpString:
+	case spv::OpExtInstImport:
+	case spv::OpLabel:
+	case spv::OpTypeVoid:
+	case spv::OpTypeBool:
+	case spv::OpTypeInt:
+	case spv::OpTypeFloat:
+	case spv::OpTypeVector:
+	case spv::OpTypeMatrix:
+	case spv::OpTypeImage:
+	case spv::OpTypeSampledImage:
+	case spv::OpTypeArray:
+	case spv::OpTypeStruct:
+	case spv::OpTypePointer:
+	case spv::OpTypeFunction:
+		has_result = true;
+		has_type = false;
+		break;
+	default:
+		has_result = true;
+		has_type = true;
+		break;
+	}
+}
+
+struct spirv_basic_block;
+
+/// <summary>
+/// A single instruction that is being added to the end of a basic block
 /// </summary>
 struct spirv_instruction
 {
-	spv::Op op;
-	spv::Id type;
+	spirv_basic_block *block;
+	size_t offset; // Index of the first word of the instruction in the block
 	spv::Id result;
-	std::vector<spv::Id> operands;
-
-	explicit spirv_instruction(spv::Op op = spv::OpNop) : op(op), type(0), result(0) {}
-	spirv_instruction(spv::Op op, spv::Id result) : op(op), type(result), result(0) {}
-	spirv_instruction(spv::Op op, spv::Id type, spv::Id result) : op(op), type(type), result(result) {}
 
 	/// <summary>
 	/// Add a single operand to the instruction.
 	/// </summary>
-	spirv_instruction &add(spv::Id operand)
-	{
-		operands.push_back(operand);
-		return *this;
-	}
+	spirv_instruction &add(spv::Id operand);
 
 	/// <summary>
 	/// Add a range of operands to the instruction.
 	/// </summary>
 	template <typename It>
-	spirv_instruction &add(It begin, It end)
-	{
-		operands.insert(operands.end(), begin, end);
-		return *this;
-	}
+	spirv_instruction &add(It begin, It end);
 
 	/// <summary>
 	/// Add a null-terminated literal UTF-8 string to the instruction.
@@ -67,10 +116,34 @@ struct spirv_instruction
 	}
 
 	/// <summary>
-	/// Write this instruction to a SPIR-V module.
+	/// Set the result type of the instruction, for when it is only known after the operands were added.
 	/// </summary>
-	/// <param name="output">The output stream to append this instruction to.</param>
-	void write(std::vector<uint32_t> &output) const
+	void set_type(spv::Id type);
+};
+
+/// <summary>
+/// A single instruction decoded from the words of a basic block, with its operands referencing those words
+/// </summary>
+struct spirv_instruction_view
+{
+	struct operand_list
+	{
+		spv::Id *first, *last;
+
+		spv::Id *begin() const { return first; }
+		spv::Id *end() const { return last; }
+		size_t size() const { return last - first; }
+		bool empty() const { return first == last; }
+		spv::Id &operator[](size_t index) const { return first[index]; }
+	};
+
+	uint32_t *words;
+	spv::Op op;
+	spv::Id type = 0;
+	spv::Id result = 0;
+	operand_list operands;
+
+	explicit spirv_instruction_view(uint32_t *words) : words(words), op(static_cast<spv::Op>(words[0] & spv::OpCodeMask))
 	{
 		// See https://www.khronos.org/registry/spir-v/specs/unified1/SPIRV.html
 		// 0             | Opcode: The 16 high-order bits are the WordCount of the instruction. The 16 low-order bits are the opcode enumerant.
@@ -81,43 +154,365 @@ struct spirv_instruction
 		// ...           | ...
 		// WordCount - 1 | Operand N (N is determined by WordCount minus the 1 to 3 words used for the opcode, instruction type <id>, and instruction Result <id>).
 
-		const uint32_t num_words = 1 + (type != 0) + (result != 0) + static_cast<uint32_t>(operands.size());
-		output.push_back((num_words << spv::WordCountShift) | op);
+		bool has_result, has_type;
+		has_result_and_type(op, has_result, has_type);
 
-		// Optional instruction type ID
-		if (type != 0)
-			output.push_back(type);
+		uint32_t *operand = words + 1;
+		if (has_type)
+			type = *operand++;
+		if (has_result)
+			result = *operand++;
 
-		// Optional instruction result ID
-		if (result != 0)
-			output.push_back(result);
+		operands = { operand, words + (words[0] >> spv::WordCountShift) };
+	}
 
-		// Write out the operands
-		output.insert(output.end(), operands.begin(), operands.end());
+	/// <summary>
+	/// Turn this instruction into a "OpNop", so that it is skipped when the block is compacted with <see cref="spirv_basic_block::remove_instructions"/>.
+	/// </summary>
+	void remove()
+	{
+		op = spv::OpNop;
+		words[0] = (words[0] & ~spv::OpCodeMask) | spv::OpNop;
 	}
 };
 
 /// <summary>
-/// A list of instructions forming a basic block in the SPIR-V module
+/// A list of instructions forming a basic block in the SPIR-V module, stored in the same binary encoding they are written to the module in
 /// </summary>
 struct spirv_basic_block
 {
-	std::vector<spirv_instruction> instructions;
+	std::vector<uint32_t> words;
+
+	class iterator
+	{
+	public:
+		explicit iterator(uint32_t *word) : _word(word) {}
+
+		spirv_instruction_view operator*() const { return spirv_instruction_view(_word); }
+		iterator &operator++() { _word += *_word >> spv::WordCountShift; return *this; }
+		bool operator!=(const iterator &other) const { return _word != other._word; }
+
+	private:
+		uint32_t *_word;
+	};
+
+	iterator begin() { return iterator(words.data()); }
+	iterator end() { return iterator(words.data() + words.size()); }
+
+	/// <summary>
+	/// Decode the instruction starting at the specified word.
+	/// </summary>
+	spirv_instruction_view at(size_t offset) { return spirv_instruction_view(words.data() + offset); }
+
+	/// <summary>
+	/// Start a new instruction at the end of this block.
+	/// </summary>
+	/// <param name="op">Opcode of the instruction.</param>
+	/// <param name="type">Result type ID, which is ignored for opcodes without one and can be set later with <see cref="spirv_instruction::set_type"/>.</param>
+	/// <param name="result">Result ID, which has to be zero for opcodes without one.</param>
+	spirv_instruction add_instruction(spv::Op op, spv::Id type = 0, spv::Id result = 0)
+	{
+		bool has_result, has_type;
+		has_result_and_type(op, has_result, has_type);
+		assert(has_result == (result != 0) && (has_type || type == 0));
+
+		const size_t offset = words.size();
+		words.push_back(((1u + has_type + has_result) << spv::WordCountShift) | op);
+		if (has_type)
+			words.push_back(type);
+		if (has_result)
+			words.push_back(result);
+
+		return { this, offset, result };
+	}
+
+	/// <summary>
+	/// Remove the last instruction from this block, which has to have the specified opcode and number of words.
+	/// </summary>
+	template <size_t num_words>
+	void pop_instruction(spv::Op op, uint32_t (&instruction)[num_words])
+	{
+		assert(words.size() >= num_words && words[words.size() - num_words] == ((num_words << spv::WordCountShift) | op));
+		std::copy(words.end() - num_words, words.end(), instruction);
+		words.resize(words.size() - num_words);
+	}
+	/// <summary>
+	/// Add back an instruction previously removed with <see cref="pop_instruction"/>.
+	/// </summary>
+	template <size_t num_words>
+	void push_instruction(const uint32_t (&instruction)[num_words])
+	{
+		words.insert(words.end(), instruction, instruction + num_words);
+	}
 
 	/// <summary>
 	/// Append another basic block the end of this one.
 	/// </summary>
 	void append(const spirv_basic_block &block)
 	{
-		instructions.insert(instructions.end(), block.instructions.begin(), block.instructions.end());
+		words.insert(words.end(), block.words.begin(), block.words.end());
+	}
+
+	/// <summary>
+	/// Remove all instructions for which the specified predicate returns <see langword="true"/>, keeping the order of the remaining ones.
+	/// </summary>
+	template <typename F>
+	void remove_instructions(F predicate)
+	{
+		size_t write_offset = 0;
+		for (size_t read_offset = 0, num_words; read_offset < words.size(); read_offset += num_words)
+		{
+			num_words = words[read_offset] >> spv::WordCountShift;
+			if (predicate(at(read_offset)))
+				continue;
+
+			if (write_offset != read_offset)
+				std::copy(words.begin() + read_offset, words.begin() + read_offset + num_words, words.begin() + write_offset);
+			write_offset += num_words;
+		}
+
+		words.resize(write_offset);
 	}
 };
 
+inline spirv_instruction &spirv_instruction::add(spv::Id operand)
+{
+	// Operands can only be added while this is still the last instruction in the block
+	assert(offset + (block->words[offset] >> spv::WordCountShift) == block->words.size());
+
+	block->words.push_back(operand);
+	block->words[offset] += 1u << spv::WordCountShift;
+	return *this;
+}
+template <typename It>
+inline spirv_instruction &spirv_instruction::add(It begin, It end)
+{
+	assert(offset + (block->words[offset] >> spv::WordCountShift) == block->words.size());
+
+	const size_t num_words = block->words.size();
+	block->words.insert(block->words.end(), begin, end);
+	block->words[offset] += static_cast<uint32_t>(block->words.size() - num_words) << spv::WordCountShift;
+	return *this;
+}
+inline void spirv_instruction::set_type(spv::Id type)
+{
+	assert(block->at(offset).type == 0);
+
+	block->words[offset + 1] = type;
+}
+
+/// <summary>
+/// Calls the specified function for every operand of an instruction in a function body that references an ID (as opposed to being a literal).
+/// </summary>
+template <typename F>
+static void for_each_id_operand(const spirv_instruction_view &inst, F func)
+{
+	size_t image_operands_index = 0;
+
+	switch (inst.op)
+	{
+	case spv::OpNop:
+	case spv::OpLine:
+	case spv::OpLabel:
+		return;
+	case spv::OpVariable:
+	case spv::OpFunction:
+		// Storage class or function control is followed by an optional initializer or the function type
+		for (size_t i = 1; i < inst.operands.size(); ++i)
+			func(inst.operands[i]);
+		return;
+	case spv::OpCompositeExtract:
+	case spv::OpSelectionMerge:
+		func(inst.operands[0]);
+		return;
+	case spv::OpCompositeInsert:
+	case spv::OpVectorShuffle:
+	case spv::OpLoopMerge:
+		func(inst.operands[0]);
+		func(inst.operands[1]);
+		return;
+	case spv::OpExtInst:
+		func(inst.operands[0]);
+		for (size_t i = 2; i < inst.operands.size(); ++i)
+			func(inst.operands[i]);
+		return;
+	case spv::OpSwitch:
+		func(inst.operands[0]);
+		func(inst.operands[1]);
+		for (size_t i = 3; i < inst.operands.size(); i += 2)
+			func(inst.operands[i]);
+		return;
+	case spv::OpImageSampleImplicitLod:
+	case spv::OpImageSampleExplicitLod:
+	case spv::OpImageFetch:
+	case spv::OpImageRead:
+		image_operands_index = 2;
+		break;
+	case spv::OpImageGather:
+	case spv::OpImageWrite:
+		image_operands_index = 3;
+		break;
+	default:
+		for (spv::Id &operand : inst.operands)
+			func(operand);
+		return;
+	}
+
+	// Image operands start with a literal mask, which is followed by IDs again
+	for (size_t i = 0; i < inst.operands.size(); ++i)
+		if (i != image_operands_index)
+			func(inst.operands[i]);
+}
+
+/// <summary>
+/// Checks whether an instruction in a function body has no side effects and its result only depends on its operands, so that it can be reused or removed.
+/// </summary>
+static bool is_pure_instruction(const spirv_instruction_view &inst)
+{
+	switch (inst.op)
+	{
+	case spv::OpExtInst:
+		// These take pointer operands
+		return inst.operands[1] != spv::GLSLstd450Modf && inst.operands[1] != spv::GLSLstd450Frexp &&
+			(inst.operands[1] < spv::GLSLstd450InterpolateAtCentroid || inst.operands[1] > spv::GLSLstd450InterpolateAtOffset);
+	case spv::OpAccessChain:
+	case spv::OpImage:
+	case spv::OpImageQuerySize:
+	case spv::OpImageQuerySizeLod:
+	case spv::OpImageSampleImplicitLod:
+	case spv::OpImageSampleExplicitLod:
+	case spv::OpImageFetch:
+	case spv::OpImageGather:
+	case spv::OpVectorExtractDynamic:
+	case spv::OpVectorShuffle:
+	case spv::OpCompositeConstruct:
+	case spv::OpCompositeExtract:
+	case spv::OpCompositeInsert:
+	case spv::OpTranspose:
+	case spv::OpConvertFToU:
+	case spv::OpConvertFToS:
+	case spv::OpConvertSToF:
+	case spv::OpConvertUToF:
+	case spv::OpUConvert:
+	case spv::OpSConvert:
+	case spv::OpFConvert:
+	case spv::OpBitcast:
+	case spv::OpSNegate:
+	case spv::OpFNegate:
+	case spv::OpIAdd:
+	case spv::OpFAdd:
+	case spv::OpISub:
+	case spv::OpFSub:
+	case spv::OpIMul:
+	case spv::OpFMul:
+	case spv::OpUDiv:
+	case spv::OpSDiv:
+	case spv::OpFDiv:
+	case spv::OpUMod:
+	case spv::OpSRem:
+	case spv::OpFRem:
+	case spv::OpVectorTimesScalar:
+	case spv::OpMatrixTimesScalar:
+	case spv::OpVectorTimesMatrix:
+	case spv::OpMatrixTimesVector:
+	case spv::OpMatrixTimesMatrix:
+	case spv::OpDot:
+	case spv::OpAny:
+	case spv::OpAll:
+	case spv::OpIsNan:
+	case spv::OpIsInf:
+	case spv::OpLogicalEqual:
+	case spv::OpLogicalNotEqual:
+	case spv::OpLogicalOr:
+	case spv::OpLogicalAnd:
+	case spv::OpLogicalNot:
+	case spv::OpSelect:
+	case spv::OpIEqual:
+	case spv::OpINotEqual:
+	case spv::OpUGreaterThan:
+	case spv::OpSGreaterThan:
+	case spv::OpUGreaterThanEqual:
+	case spv::OpSGreaterThanEqual:
+	case spv::OpULessThan:
+	case spv::OpSLessThan:
+	case spv::OpULessThanEqual:
+	case spv::OpSLessThanEqual:
+	case spv::OpFOrdEqual:
+	case spv::OpFOrdNotEqual:
+	case spv::OpFOrdLessThan:
+	case spv::OpFOrdGreaterThan:
+	case spv::OpFOrdLessThanEqual:
+	case spv::OpFOrdGreaterThanEqual:
+	case spv::OpShiftRightLogical:
+	case spv::OpShiftRightArithmetic:
+	case spv::OpShiftLeftLogical:
+	case spv::OpBitwiseOr:
+	case spv::OpBitwiseXor:
+	case spv::OpBitwiseAnd:
+	case spv::OpNot:
+	case spv::OpBitReverse:
+	case spv::OpBitCount:
+	case spv::OpDPdx:
+	case spv::OpDPdy:
+	case spv::OpFwidth:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/// <summary>
+/// Checks whether an instruction can be turned into an "OpSpecConstantOp" when all its operands are constants (see the list of opcodes allowed with the Shader capability).
+/// </summary>
+static bool is_spec_constant_op_instruction(spv::Op op)
+{
+	switch (op)
+	{
+	case spv::OpSNegate:
+	case spv::OpNot:
+	case spv::OpIAdd:
+	case spv::OpISub:
+	case spv::OpIMul:
+	case spv::OpUDiv:
+	case spv::OpSDiv:
+	case spv::OpUMod:
+	case spv::OpSRem:
+	case spv::OpShiftRightLogical:
+	case spv::OpShiftRightArithmetic:
+	case spv::OpShiftLeftLogical:
+	case spv::OpBitwiseOr:
+	case spv::OpBitwiseXor:
+	case spv::OpBitwiseAnd:
+	case spv::OpVectorShuffle:
+	case spv::OpCompositeExtract:
+	case spv::OpCompositeInsert:
+	case spv::OpLogicalOr:
+	case spv::OpLogicalAnd:
+	case spv::OpLogicalNot:
+	case spv::OpLogicalEqual:
+	case spv::OpLogicalNotEqual:
+	case spv::OpSelect:
+	case spv::OpIEqual:
+	case spv::OpINotEqual:
+	case spv::OpULessThan:
+	case spv::OpSLessThan:
+	case spv::OpUGreaterThan:
+	case spv::OpSGreaterThan:
+	case spv::OpULessThanEqual:
+	case spv::OpSLessThanEqual:
+	case spv::OpUGreaterThanEqual:
+	case spv::OpSGreaterThanEqual:
+		return true;
+	default:
+		return false;
+	}
+}
+
 class codegen_spirv final : public codegen
 {
 public:
-	codegen_spirv(bool vulkan_semantics, bool debug_info, bool uniforms_to_spec_constants, bool enable_16bit_types, bool flip_vert_y)
-		: _debug_info(debug_info), _vulkan_semantics(vulkan_semantics), _uniforms_to_spec_constants(uniforms_to_spec_constants), _enable_16bit_types(enable_16bit_types), _flip_vert_y(flip_vert_y)
+	codegen_spirv(bool vulkan_semantics, bool debug_info, bool uniforms_to_spec_constants, bool enable_16bit_types, bool flip_vert_y, bool optimize)
+		: _debug_info(debug_info), _vulkan_semantics(vulkan_semantics), _uniforms_to_spec_constants(uniforms_to_spec_constants), _enable_16bit_types(enable_16bit_types), _flip_vert_y(flip_vert_y), _optimize(optimize)
 	{
 		_glsl_ext = make_id();
 	}
@@ -135,6 +530,68 @@ private:
 			return lhs.type == rhs.type && lhs.is_ptr == rhs.is_ptr && lhs.array_stride == rhs.array_stride && lhs.storage == rhs.storage;
 		}
 	};
+	struct constant_lookup
+	{
+		reshadefx::type type;
+		reshadefx::constant data;
+
+		friend bool operator==(const constant_lookup &lhs, const constant_lookup &rhs)
+		{
+			if (!(lhs.type == rhs.type && std::memcmp(&lhs.data.as_uint[0], &rhs.data.as_uint[0], sizeof(uint32_t) * 16) == 0 && lhs.data.array_data.size() == rhs.data.array_data.size()))
+				return false;
+			for (size_t i = 0; i < lhs.data.array_data.size(); ++i)
+				if (std::memcmp(&lhs.data.array_data[i].as_uint[0], &rhs.data.array_data[i].as_uint[0], sizeof(uint32_t) * 16) != 0)
+					return false;
+			return true;
+		}
+	};
+	struct lookup_hash
+	{
+		static void combine(size_t &hash, size_t value)
+		{
+			hash ^= value + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+		}
+		static size_t hash_type(const reshadefx::type &type)
+		{
+			// Only hash the fields that are compared by the equality operator of the type (which ignores qualifiers)
+			size_t hash = type.base;
+			combine(hash, type.rows);
+			combine(hash, type.cols);
+			combine(hash, static_cast<size_t>(type.array_length));
+			combine(hash, type.definition);
+			return hash;
+		}
+		static size_t hash_data(const reshadefx::constant &data, size_t hash)
+		{
+			for (uint32_t value : data.as_uint)
+				combine(hash, value);
+			return hash;
+		}
+
+		size_t operator()(const type_lookup &lookup) const
+		{
+			size_t hash = hash_type(lookup.type);
+			combine(hash, lookup.is_ptr);
+			combine(hash, lookup.array_stride);
+			combine(hash, lookup.storage.first);
+			combine(hash, lookup.storage.second);
+			return hash;
+		}
+		size_t operator()(const constant_lookup &lookup) const
+		{
+			size_t hash = hash_data(lookup.data, hash_type(lookup.type));
+			for (const reshadefx::constant &element : lookup.data.array_data)
+				hash = hash_data(element, hash);
+			return hash;
+		}
+		size_t operator()(const std::vector<spv::Id> &ids) const
+		{
+			size_t hash = ids.size();
+			for (spv::Id id : ids)
+				combine(hash, id);
+			return hash;
+		}
+	};
 	struct function_blocks
 	{
 		spirv_basic_block declaration;
@@ -163,11 +620,13 @@ private:
 	spirv_basic_block _types_and_constants;
 	spirv_basic_block _variables;
 
-	std::unordered_set<spv::Id> _spec_constants;
+	// Maps the ID of each specialization constant to the offset of its instruction in the words of '_types_and_constants'
+	std::unordered_map<spv::Id, size_t> _spec_constants;
 	std::unordered_set<spv::Capability> _capabilities;
-	std::vector<std::pair<type_lookup, spv::Id>> _type_lookup;
-	std::vector<std::tuple<type, constant, spv::Id>> _constant_lookup;
-	std::vector<std::pair<function_blocks, spv::Id>> _function_type_lookup;
+	std::unordered_map<type_lookup, spv::Id, lookup_hash> _type_lookup;
+	std::unordered_map<constant_lookup, spv::Id, lookup_hash> _constant_lookup;
+	// Function types are looked up by the IDs of their return and parameter types
+	std::unordered_map<std::vector<spv::Id>, spv::Id, lookup_hash> _function_type_lookup;
 	std::unordered_map<std::string, spv::Id> _string_lookup;
 	std::unordered_map<spv::Id, std::pair<spv::StorageClass, spv::ImageFormat>> _storage_lookup;
 	std::unordered_map<std::string, uint32_t> _semantic_to_location;
@@ -181,6 +640,7 @@ private:
 	bool _uniforms_to_spec_constants = false;
 	bool _enable_16bit_types = false;
 	bool _flip_vert_y = false;
+	bool _optimize = false;
 	id _glsl_ext = 0;
 	id _global_ubo_type = 0;
 	id _global_ubo_variable = 0;
@@ -209,33 +669,27 @@ private:
 			.add(loc.line)
 			.add(loc.column);
 	}
-	inline spirv_instruction &add_instruction(spv::Op op, spv::Id type = 0)
+	inline spirv_instruction add_instruction(spv::Op op, spv::Id type = 0)
 	{
 		assert(is_in_function() && is_in_block());
 		return add_instruction(op, type, *_current_block_data);
 	}
-	inline spirv_instruction &add_instruction(spv::Op op, spv::Id type, spirv_basic_block &block)
+	inline spirv_instruction add_instruction(spv::Op op, spv::Id type, spirv_basic_block &block)
 	{
-		spirv_instruction &instruction = add_instruction_without_result(op, block);
-		instruction.type = type;
-		instruction.result = make_id();
-		return instruction;
+		return block.add_instruction(op, type, make_id());
 	}
-	inline spirv_instruction &add_instruction(spv::Op op, spv::Id type, spirv_basic_block &block, spv::Id &result)
+	inline spirv_instruction add_instruction(spv::Op op, spv::Id type, spirv_basic_block &block, spv::Id &result)
 	{
-		spirv_instruction &instruction = add_instruction_without_result(op, block);
-		instruction.type = type;
-		instruction.result = result = make_id();
-		return instruction;
+		return block.add_instruction(op, type, result = make_id());
 	}
-	inline spirv_instruction &add_instruction_without_result(spv::Op op)
+	inline spirv_instruction add_instruction_without_result(spv::Op op)
 	{
 		assert(is_in_function() && is_in_block());
 		return add_instruction_without_result(op, *_current_block_data);
 	}
-	inline spirv_instruction &add_instruction_without_result(spv::Op op, spirv_basic_block &block)
+	inline spirv_instruction add_instruction_without_result(spv::Op op, spirv_basic_block &block)
 	{
-		return block.instructions.emplace_back(op);
+		return block.add_instruction(op);
 	}
 
 	void write_result(module &module) override
@@ -243,98 +697,596 @@ private:
 		// First initialize the UBO type now that all member types are known
 		if (_global_ubo_type != 0)
 		{
-			spirv_instruction &type_inst = add_instruction_without_result(spv::OpTypeStruct, _types_and_constants);
-			type_inst.add(_global_ubo_types.begin(), _global_ubo_types.end());
-			type_inst.result = _global_ubo_type;
+			_types_and_constants.add_instruction(spv::OpTypeStruct, 0, _global_ubo_type)
+				.add(_global_ubo_types.begin(), _global_ubo_types.end());
 
-			spirv_instruction &variable_inst = add_instruction_without_result(spv::OpVariable, _variables);
-			variable_inst.add(spv::StorageClassUniform);
-			variable_inst.type = convert_type({ type::t_struct, 0, 0, type::q_uniform, 0, _global_ubo_type }, true, spv::StorageClassUniform);
-			variable_inst.result = _global_ubo_variable;
+			_variables.add_instruction(spv::OpVariable, convert_type({ type::t_struct, 0, 0, type::q_uniform, 0, _global_ubo_type }, true, spv::StorageClassUniform), _global_ubo_variable)
+				.add(spv::StorageClassUniform);
 
-			add_name(variable_inst.result, "$Globals");
+			add_name(_global_ubo_variable, "$Globals");
 		}
 
+		if (_optimize)
+			optimize();
+
 		module = std::move(_module);
 
+		spirv_basic_block output;
+
 		// Write SPIRV header info
-		module.spirv.push_back(spv::MagicNumber);
-		module.spirv.push_back(0x10300); // Force SPIR-V 1.3
-		module.spirv.push_back(0u); // Generator magic number, see https://www.khronos.org/registry/spir-v/api/spir-v.xml
-		module.spirv.push_back(_next_id); // Maximum ID
-		module.spirv.push_back(0u); // Reserved for instruction schema
+		output.words.push_back(spv::MagicNumber);
+		output.words.push_back(0x10300); // Force SPIR-V 1.3
+		output.words.push_back(0u); // Generator magic number, see https://www.khronos.org/registry/spir-v/api/spir-v.xml
+		output.words.push_back(_next_id); // Maximum ID
+		output.words.push_back(0u); // Reserved for instruction schema
 
 		// All capabilities
-		spirv_instruction(spv::OpCapability)
-			.add(spv::CapabilityShader) // Implicitly declares the Matrix capability too
-			.write(module.spirv);
+		output.add_instruction(spv::OpCapability)
+			.add(spv::CapabilityShader); // Implicitly declares the Matrix capability too
 
 		for (spv::Capability capability : _capabilities)
-			spirv_instruction(spv::OpCapability)
-				.add(capability)
-				.write(module.spirv);
+			output.add_instruction(spv::OpCapability)
+				.add(capability);
 
 		// Optional extension instructions
-		spirv_instruction(spv::OpExtInstImport, _glsl_ext)
-			.add_string("GLSL.std.450") // Import GLSL extension
-			.write(module.spirv);
+		output.add_instruction(spv::OpExtInstImport, 0, _glsl_ext)
+			.add_string("GLSL.std.450"); // Import GLSL extension
 
 		// Single required memory model instruction
-		spirv_instruction(spv::OpMemoryModel)
+		output.add_instruction(spv::OpMemoryModel)
 			.add(spv::AddressingModelLogical)
-			.add(spv::MemoryModelGLSL450)
-			.write(module.spirv);
+			.add(spv::MemoryModelGLSL450);
+
+		// The remaining instructions are already encoded, so allocate enough space for all of them up front and copy them over
+		size_t num_words = output.words.size() + 3 + _entries.words.size() + _execution_modes.words.size() + _annotations.words.size() + _types_and_constants.words.size() + _variables.words.size();
+		if (_debug_info)
+			num_words += _debug_a.words.size() + _debug_b.words.size();
+		for (const function_blocks &function : _functions_blocks)
+			if (!function.definition.words.empty())
+				num_words += function.declaration.words.size() + function.variables.words.size() + function.definition.words.size();
+		output.words.reserve(num_words);
 
 		// All entry point declarations
-		for (const auto &node : _entries.instructions)
-			node.write(module.spirv);
+		output.append(_entries);
 
 		// All execution mode declarations
-		for (const auto &node : _execution_modes.instructions)
-			node.write(module.spirv);
+		output.append(_execution_modes);
 
-		spirv_instruction(spv::OpSource)
+		output.add_instruction(spv::OpSource)
 			.add(spv::SourceLanguageUnknown) // ReShade FX is not a reserved token at the moment
-			.add(0) // Language version, TODO: Maybe fill in ReShade version here?
-			.write(module.spirv);
+			.add(0); // Language version, TODO: Maybe fill in ReShade version here?
 
 		if (_debug_info)
 		{
 			// All debug instructions
-			for (const auto &node : _debug_a.instructions)
-				node.write(module.spirv);
-			for (const auto &node : _debug_b.instructions)
-				node.write(module.spirv);
+			output.append(_debug_a);
+			output.append(_debug_b);
 		}
 
 		// All annotation instructions
-		for (const auto &node : _annotations.instructions)
-			node.write(module.spirv);
+		output.append(_annotations);
 
 		// All type declarations
-		for (const auto &node : _types_and_constants.instructions)
-			node.write(module.spirv);
-		for (const auto &node : _variables.instructions)
-			node.write(module.spirv);
+		output.append(_types_and_constants);
+		output.append(_variables);
 
 		// All function definitions
-		for (const auto &function : _functions_blocks)
+		for (const function_blocks &function : _functions_blocks)
 		{
-			if (function.definition.instructions.empty())
+			if (function.definition.words.empty())
 				continue;
 
-			for (const auto &node : function.declaration.instructions)
-				node.write(module.spirv);
+			output.append(function.declaration);
 
 			// Grab first label and move it in front of variable declarations
-			function.definition.instructions.front().write(module.spirv);
-			assert(function.definition.instructions.front().op == spv::OpLabel);
+			assert(function.definition.words[0] == ((2u << spv::WordCountShift) | spv::OpLabel));
+			output.words.insert(output.words.end(), function.definition.words.begin(), function.definition.words.begin() + 2);
 
-			for (const auto &node : function.variables.instructions)
-				node.write(module.spirv);
-			for (auto it = function.definition.instructions.begin() + 1; it != function.definition.instructions.end(); ++it)
-				it->write(module.spirv);
+			output.append(function.variables);
+			output.words.insert(output.words.end(), function.definition.words.begin() + 2, function.definition.words.end());
 		}
+
+		assert(output.words.size() == num_words);
+		module.spirv = std::move(output.words);
+	}
+
+	void optimize()
+	{
+		std::unordered_set<spv::Id> removed_ids;
+
+		const auto remove_instruction = [&removed_ids](spirv_instruction_view &inst) {
+			removed_ids.insert(inst.result);
+			inst.remove();
+		};
+		const auto erase_removed_instructions = [](spirv_basic_block &block) {
+			block.remove_instructions([](const spirv_instruction_view &inst) { return inst.op == spv::OpNop; });
+		};
+
+		// Remove all functions that cannot be reached from any entry point
+		{
+			const auto function_id = [](function_blocks &function) -> spv::Id {
+				for (const spirv_instruction_view &inst : function.declaration)
+					if (inst.op == spv::OpFunction)
+						return inst.result;
+				return 0;
+			};
+
+			std::unordered_map<spv::Id, function_blocks *> functions;
+			for (function_blocks &function : _functions_blocks)
+				functions.emplace(function_id(function), &function);
+
+			std::vector<spv::Id> worklist;
+			for (const spirv_instruction_view &inst : _entries)
+				worklist.push_back(inst.operands[1]);
+
+			std::unordered_set<spv::Id> reachable;
+			while (!worklist.empty())
+			{
+				const spv::Id id = worklist.back();
+				worklist.pop_back();
+
+				if (!reachable.insert(id).second)
+					continue;
+
+				if (const auto it = functions.find(id); it != functions.end())
+					for (const spirv_instruction_view &inst : it->second->definition)
+						if (inst.op == spv::OpFunctionCall)
+							worklist.push_back(inst.operands[0]);
+			}
+
+			_functions_blocks.erase(std::remove_if(_functions_blocks.begin(), _functions_blocks.end(),
+				[&](function_blocks &function) {
+					if (reachable.find(function_id(function)) != reachable.end())
+						return false;
+					for (spirv_basic_block *block : { &function.declaration, &function.variables, &function.definition })
+						for (const spirv_instruction_view &inst : *block)
+							if (inst.result != 0)
+								removed_ids.insert(inst.result);
+					return true;
+				}), _functions_blocks.end());
+		}
+
+		std::unordered_map<spv::Id, type> types;
+		for (const auto &[lookup, id] : _type_lookup)
+			if (!lookup.is_ptr && lookup.array_stride == 0)
+				types.emplace(id, lookup.type);
+
+		std::unordered_map<spv::Id, spv::Id> value_types;
+		std::unordered_map<spv::Id, std::pair<type, constant>> constant_values;
+		std::unordered_map<spv::Id, std::vector<spv::Id>> constant_composites;
+		std::unordered_set<spv::Id> constant_ids, spec_constant_ids;
+		for (const auto &[lookup, id] : _constant_lookup)
+			constant_values.emplace(id, std::make_pair(lookup.type, lookup.data));
+		for (const auto &[id, index] : _spec_constants)
+			spec_constant_ids.insert(id);
+		for (const spirv_instruction_view &inst : _types_and_constants)
+		{
+			switch (inst.op)
+			{
+			case spv::OpConstantComposite:
+				constant_composites.emplace(inst.result, std::vector<spv::Id>(inst.operands.begin(), inst.operands.end()));
+				[[fallthrough]];
+			case spv::OpConstantTrue:
+			case spv::OpConstantFalse:
+			case spv::OpConstant:
+			case spv::OpConstantNull:
+			case spv::OpSpecConstantTrue:
+			case spv::OpSpecConstantFalse:
+			case spv::OpSpecConstant:
+			case spv::OpSpecConstantComposite:
+			case spv::OpSpecConstantOp:
+				constant_ids.insert(inst.result);
+				value_types[inst.result] = inst.type;
+				break;
+			default:
+				break;
+			}
+		}
+
+		// Evaluate operations whose operands are all constants, returning the resulting constant or zero if that is not possible
+		const auto fold_constant = [&](const spirv_instruction_view &inst) -> spv::Id {
+			if (inst.op == spv::OpSelect)
+			{
+				if (const auto it = constant_values.find(inst.operands[0]);
+					it != constant_values.end() && it->second.first.is_scalar())
+					return it->second.second.as_uint[0] ? inst.operands[1] : inst.operands[2];
+				return 0;
+			}
+			if (inst.op == spv::OpCompositeExtract)
+			{
+				spv::Id element = inst.operands[0];
+				for (size_t i = 1; i < inst.operands.size(); ++i)
+				{
+					const auto it = constant_composites.find(element);
+					if (it == constant_composites.end() || inst.operands[i] >= it->second.size())
+						return 0;
+					element = it->second[inst.operands[i]];
+				}
+				if (const auto it = value_types.find(element);
+					it == value_types.end() || it->second != inst.type)
+					return 0;
+				return element;
+			}
+
+			const auto res_type_it = types.find(inst.type);
+			if (res_type_it == types.end() || inst.operands.empty() || inst.operands.size() > 2)
+				return 0;
+			const type &res_type = res_type_it->second;
+			if (!(res_type.is_scalar() || res_type.is_vector()) || res_type.precision() < 32)
+				return 0;
+
+			const constant *args[2] = {};
+			for (size_t i = 0; i < inst.operands.size(); ++i)
+			{
+				const auto it = constant_values.find(inst.operands[i]);
+				if (it == constant_values.end() || it->second.first.components() != res_type.components() || it->second.first.precision() < 32 || it->second.first.is_array())
+					return 0;
+				args[i] = &it->second.second;
+			}
+
+			const constant &a = *args[0];
+			const constant &b = args[1] != nullptr ? *args[1] : a;
+
+			constant result = {};
+			for (unsigned int i = 0; i < res_type.components(); ++i)
+			{
+				switch (inst.op)
+				{
+				case spv::OpFNegate:
+					result.as_float[i] = -a.as_float[i];
+					break;
+				case spv::OpFAdd:
+					result.as_float[i] = a.as_float[i] + b.as_float[i];
+					break;
+				case spv::OpFSub:
+					result.as_float[i] = a.as_float[i] - b.as_float[i];
+					break;
+				case spv::OpFMul:
+					result.as_float[i] = a.as_float[i] * b.as_float[i];
+					break;
+				case spv::OpFDiv:
+					if (b.as_float[i] == 0.0f)
+						return 0;
+					result.as_float[i] = a.as_float[i] / b.as_float[i];
+					break;
+				case spv::OpSNegate:
+					result.as_uint[i] = 0u - a.as_uint[i];
+					break;
+				case spv::OpIAdd:
+					result.as_uint[i] = a.as_uint[i] + b.as_uint[i];
+					break;
+				case spv::OpISub:
+					result.as_uint[i] = a.as_uint[i] - b.as_uint[i];
+					break;
+				case spv::OpIMul:
+					result.as_uint[i] = a.as_uint[i] * b.as_uint[i];
+					break;
+				case spv::OpNot:
+					result.as_uint[i] = ~a.as_uint[i];
+					break;
+				case spv::OpBitwiseAnd:
+					result.as_uint[i] = a.as_uint[i] & b.as_uint[i];
+					break;
+				case spv::OpBitwiseOr:
+					result.as_uint[i] = a.as_uint[i] | b.as_uint[i];
+					break;
+				case spv::OpBitwiseXor:
+					result.as_uint[i] = a.as_uint[i] ^ b.as_uint[i];
+					break;
+				case spv::OpLogicalNot:
+					result.as_uint[i] = a.as_uint[i] == 0;
+					break;
+				case spv::OpLogicalAnd:
+					result.as_uint[i] = a.as_uint[i] != 0 && b.as_uint[i] != 0;
+					break;
+				case spv::OpLogicalOr:
+					result.as_uint[i] = a.as_uint[i] != 0 || b.as_uint[i] != 0;
+					break;
+				case spv::OpLogicalEqual:
+					result.as_uint[i] = (a.as_uint[i] != 0) == (b.as_uint[i] != 0);
+					break;
+				case spv::OpLogicalNotEqual:
+					result.as_uint[i] = (a.as_uint[i] != 0) != (b.as_uint[i] != 0);
+					break;
+				case spv::OpIEqual:
+					result.as_uint[i] = a.as_uint[i] == b.as_uint[i];
+					break;
+				case spv::OpINotEqual:
+					result.as_uint[i] = a.as_uint[i] != b.as_uint[i];
+					break;
+				case spv::OpSLessThan:
+					result.as_uint[i] = a.as_int[i] < b.as_int[i];
+					break;
+				case spv::OpSLessThanEqual:
+					result.as_uint[i] = a.as_int[i] <= b.as_int[i];
+					break;
+				case spv::OpSGreaterThan:
+					result.as_uint[i] = a.as_int[i] > b.as_int[i];
+					break;
+				case spv::OpSGreaterThanEqual:
+					result.as_uint[i] = a.as_int[i] >= b.as_int[i];
+					break;
+				case spv::OpULessThan:
+					result.as_uint[i] = a.as_uint[i] < b.as_uint[i];
+					break;
+				case spv::OpULessThanEqual:
+					result.as_uint[i] = a.as_uint[i] <= b.as_uint[i];
+					break;
+				case spv::OpUGreaterThan:
+					result.as_uint[i] = a.as_uint[i] > b.as_uint[i];
+					break;
+				case spv::OpUGreaterThanEqual:
+					result.as_uint[i] = a.as_uint[i] >= b.as_uint[i];
+					break;
+				case spv::OpFOrdEqual:
+					result.as_uint[i] = a.as_float[i] == b.as_float[i];
+					break;
+				case spv::OpFOrdNotEqual:
+					result.as_uint[i] = a.as_float[i] < b.as_float[i] || a.as_float[i] > b.as_float[i];
+					break;
+				case spv::OpFOrdLessThan:
+					result.as_uint[i] = a.as_float[i] < b.as_float[i];
+					break;
+				case spv::OpFOrdLessThanEqual:
+					result.as_uint[i] = a.as_float[i] <= b.as_float[i];
+					break;
+				case spv::OpFOrdGreaterThan:
+					result.as_uint[i] = a.as_float[i] > b.as_float[i];
+					break;
+				case spv::OpFOrdGreaterThanEqual:
+					result.as_uint[i] = a.as_float[i] >= b.as_float[i];
+					break;
+				default:
+					return 0;
+				}
+			}
+
+			const spv::Id result_id = emit_constant(res_type, result);
+			constant_values.emplace(result_id, std::make_pair(res_type, result));
+			constant_ids.insert(result_id);
+			value_types[result_id] = inst.type;
+			return result_id;
+		};
+
+		// Keep track of the variable each pointer points into, so that stores only need to invalidate known values of pointers into the same variable
+		enum class memory_kind
+		{
+			untracked, // Memory that other invocations may write to
+			read_only,
+			local,
+			global, // Memory that function parameters may alias
+		};
+		struct pointer_info
+		{
+			spv::Id root;
+			memory_kind kind;
+		};
+		struct known_value
+		{
+			spv::Id value;
+			pointer_info pointer;
+		};
+
+		std::unordered_map<spv::Id, pointer_info> global_pointers;
+		for (const spirv_instruction_view &inst : _variables)
+		{
+			if (inst.op != spv::OpVariable)
+				continue;
+
+			switch (inst.operands[0])
+			{
+			case spv::StorageClassUniformConstant:
+			case spv::StorageClassInput:
+			case spv::StorageClassUniform:
+				global_pointers[inst.result] = { inst.result, memory_kind::read_only };
+				break;
+			case spv::StorageClassOutput:
+			case spv::StorageClassPrivate:
+				global_pointers[inst.result] = { inst.result, memory_kind::global };
+				break;
+			default:
+				global_pointers[inst.result] = { inst.result, memory_kind::untracked };
+				break;
+			}
+		}
+
+		for (function_blocks &function : _functions_blocks)
+		{
+			std::unordered_map<spv::Id, pointer_info> pointers;
+			for (const spirv_instruction_view &inst : function.declaration)
+				if (inst.op == spv::OpFunctionParameter)
+					pointers[inst.result] = { inst.result, memory_kind::global };
+			for (const spirv_instruction_view &inst : function.variables)
+				if (inst.op == spv::OpVariable)
+					pointers[inst.result] = { inst.result, memory_kind::local };
+
+			const auto find_pointer = [&](spv::Id id) -> const pointer_info * {
+				if (const auto it = pointers.find(id); it != pointers.end())
+					return &it->second;
+				if (const auto it = global_pointers.find(id); it != global_pointers.end())
+					return &it->second;
+				return nullptr;
+			};
+
+			// Values and expressions are only reused within a single basic block, which avoids having to analyze the control flow
+			std::unordered_map<spv::Id, spv::Id> replacements;
+			std::unordered_map<spv::Id, known_value> known_values;
+			std::map<std::vector<spv::Id>, spv::Id> known_expressions;
+
+			const auto invalidate = [&known_values](const pointer_info &pointer) {
+				if (pointer.kind == memory_kind::untracked || pointer.kind == memory_kind::read_only)
+					return;
+				for (auto it = known_values.begin(); it != known_values.end();)
+					if (pointer.kind == memory_kind::global ? it->second.pointer.kind == memory_kind::global : it->second.pointer.root == pointer.root)
+						it = known_values.erase(it);
+					else
+						++it;
+			};
+
+			for (spirv_instruction_view inst : function.definition)
+			{
+				if (inst.op == spv::OpLabel)
+				{
+					known_values.clear();
+					known_expressions.clear();
+					continue;
+				}
+
+				for_each_id_operand(inst, [&replacements](spv::Id &id) {
+					if (const auto it = replacements.find(id); it != replacements.end())
+						id = it->second;
+				});
+
+				if (inst.result != 0)
+					value_types[inst.result] = inst.type;
+
+				switch (inst.op)
+				{
+				case spv::OpLoad:
+					if (const auto it = known_values.find(inst.operands[0]);
+						it != known_values.end() && value_types[it->second.value] == inst.type)
+					{
+						replacements[inst.result] = it->second.value;
+						remove_instruction(inst);
+					}
+					else if (const pointer_info *const pointer = find_pointer(inst.operands[0]);
+						pointer != nullptr && pointer->kind != memory_kind::untracked)
+					{
+						known_values[inst.operands[0]] = { inst.result, *pointer };
+					}
+					continue;
+				case spv::OpStore:
+					if (const pointer_info *const pointer = find_pointer(inst.operands[0]))
+					{
+						invalidate(*pointer);
+						if (pointer->kind == memory_kind::local || pointer->kind == memory_kind::global)
+							known_values[inst.operands[0]] = { inst.operands[1], *pointer };
+					}
+					else
+					{
+						invalidate({ 0, memory_kind::global });
+					}
+					continue;
+				case spv::OpAccessChain:
+					if (const pointer_info *const pointer = find_pointer(inst.operands[0]))
+						pointers[inst.result] = *pointer;
+					break;
+				case spv::OpFunctionCall:
+					// The called function may write to any global variable or pointer argument
+					for (auto it = known_values.begin(); it != known_values.end();)
+						if (it->second.pointer.kind != memory_kind::read_only)
+							it = known_values.erase(it);
+						else
+							++it;
+					continue;
+				default:
+					// Other instructions may write to pointer operands too (e.g. atomics or "modf")
+					for_each_id_operand(inst, [&](spv::Id &id) {
+						if (const pointer_info *const pointer = find_pointer(id))
+							invalidate(*pointer);
+					});
+					break;
+				}
+
+				if (inst.result == 0)
+					continue;
+
+				if (const spv::Id value = fold_constant(inst))
+				{
+					replacements[inst.result] = value;
+					remove_instruction(inst);
+					continue;
+				}
+
+				// Move operations on specialization constants out of the function, so that they are evaluated only once when the pipeline is created
+				if (is_spec_constant_op_instruction(inst.op))
+				{
+					bool is_constant = true, has_spec_constant = false;
+					for_each_id_operand(inst, [&](spv::Id &id) {
+						if (spec_constant_ids.find(id) != spec_constant_ids.end())
+							has_spec_constant = true;
+						else if (constant_ids.find(id) == constant_ids.end())
+							is_constant = false;
+					});
+
+					if (const auto it = types.find(inst.type);
+						is_constant && has_spec_constant && it != types.end() && it->second.precision() == 32)
+					{
+						_types_and_constants.add_instruction(spv::OpSpecConstantOp, inst.type, inst.result)
+							.add(inst.op)
+							.add(inst.operands.begin(), inst.operands.end());
+
+						spec_constant_ids.insert(inst.result);
+						inst.remove();
+						continue;
+					}
+				}
+
+				if (is_pure_instruction(inst))
+				{
+					std::vector<spv::Id> key;
+					key.reserve(2 + inst.operands.size());
+					key.push_back(inst.op);
+					key.push_back(inst.type);
+					key.insert(key.end(), inst.operands.begin(), inst.operands.end());
+
+					if (const auto it = known_expressions.emplace(std::move(key), inst.result).first;
+						it->second != inst.result)
+					{
+						replacements[inst.result] = it->second;
+						remove_instruction(inst);
+					}
+				}
+			}
+
+			// Update references that appear before the replaced value in the instruction stream (e.g. phi operands in loops) and remove instructions whose results are no longer used
+			std::unordered_map<spv::Id, uint32_t> use_counts;
+			std::vector<spirv_instruction_view> instructions;
+			for (const spirv_instruction_view &inst : function.definition)
+			{
+				for_each_id_operand(inst, [&](spv::Id &id) {
+					if (const auto it = replacements.find(id); it != replacements.end())
+						id = it->second;
+					use_counts[id]++;
+				});
+				instructions.push_back(inst);
+			}
+
+			for (auto inst = instructions.rbegin(); inst != instructions.rend(); ++inst)
+			{
+				if (inst->op != spv::OpLoad && !is_pure_instruction(*inst))
+					continue;
+				if (const auto it = use_counts.find(inst->result); it != use_counts.end() && it->second != 0)
+					continue;
+
+				for_each_id_operand(*inst, [&use_counts](spv::Id &id) { use_counts[id]--; });
+				remove_instruction(*inst);
+			}
+
+			erase_removed_instructions(function.definition);
+		}
+
+		// Remove global variables that are no longer referenced by any function
+		{
+			std::unordered_set<spv::Id> referenced_ids;
+			for (function_blocks &function : _functions_blocks)
+				for (spirv_basic_block *block : { &function.declaration, &function.variables, &function.definition })
+					for (const spirv_instruction_view &inst : *block)
+						for_each_id_operand(inst, [&referenced_ids](spv::Id &id) { referenced_ids.insert(id); });
+			for (spirv_basic_block *block : { &_entries, &_execution_modes })
+				for (const spirv_instruction_view &inst : *block)
+					referenced_ids.insert(inst.operands.begin(), inst.operands.end());
+
+			for (spirv_instruction_view inst : _variables)
+				if (inst.op == spv::OpVariable && referenced_ids.find(inst.result) == referenced_ids.end())
+					remove_instruction(inst);
+
+			erase_removed_instructions(_variables);
+		}
+
+		// Remove names and decorations of everything that was removed above
+		for (spirv_basic_block *block : { &_debug_b, &_annotations })
+			block->remove_instructions([&removed_ids](const spirv_instruction_view &inst) { return removed_ids.find(inst.operands[0]) != removed_ids.end(); });
 	}
 
 	spv::Id convert_type(type info, bool is_ptr = false, spv::StorageClass storage = spv::StorageClassFunction, spv::ImageFormat format = spv::ImageFormatUnknown, uint32_t array_stride = 0)
@@ -356,12 +1308,9 @@ private:
 
 		const type_lookup lookup { info, is_ptr, array_stride, { storage, format } };
 
-		{	const auto it = std::find_if(_type_lookup.begin(), _type_lookup.end(),
-				[&lookup](const auto &lookup_it) {
-					return lookup_it.first == lookup; });
-			if (it != _type_lookup.end())
-				return it->second;
-		}
+		if (const auto it = _type_lookup.find(lookup);
+			it != _type_lookup.end())
+			return it->second;
 
 		spv::Id type, elem_type;
 		if (is_ptr)
@@ -506,32 +1455,29 @@ private:
 			}
 		}
 
-		_type_lookup.push_back({ lookup, type });
+		_type_lookup.emplace(lookup, type);
 
 		return type;
 	}
 	spv::Id convert_type(const function_blocks &info)
 	{
-		{	const auto it = std::find_if(_function_type_lookup.begin(), _function_type_lookup.end(),
-				[&lookup = info](const auto &lookup_it) {
-					return lookup_it.first == lookup; });
-			if (it != _function_type_lookup.end())
-				return it->second;
-		}
+		std::vector<spv::Id> lookup;
+		lookup.reserve(1 + info.param_types.size());
 
-		auto return_type = convert_type(info.return_type);
-		assert(return_type != 0);
+		lookup.push_back(convert_type(info.return_type));
+		assert(lookup[0] != 0);
 
-		std::vector<spv::Id> param_type_ids;
-		param_type_ids.reserve(info.param_types.size());
 		for (const type &param_type : info.param_types)
-			param_type_ids.push_back(convert_type(param_type, true));
+			lookup.push_back(convert_type(param_type, true));
 
-		spirv_instruction &inst = add_instruction(spv::OpTypeFunction, 0, _types_and_constants);
-		inst.add(return_type);
-		inst.add(param_type_ids.begin(), param_type_ids.end());
+		if (const auto it = _function_type_lookup.find(lookup);
+			it != _function_type_lookup.end())
+			return it->second;
+
+		spirv_instruction inst = add_instruction(spv::OpTypeFunction, 0, _types_and_constants);
+		inst.add(lookup.begin(), lookup.end());
 
-		_function_type_lookup.push_back({ info, inst.result });;
+		_function_type_lookup.emplace(std::move(lookup), inst.result);
 
 		return inst.result;
 	}
@@ -766,7 +1712,7 @@ private:
 
 			add_name(res, info.name.c_str());
 
-			const auto add_spec_constant = [this](const spirv_instruction &inst, const uniform_info &info, const constant &initializer_value, size_t initializer_offset) {
+			const auto add_spec_constant = [this](const spirv_instruction_view &inst, const uniform_info &info, const constant &initializer_value, size_t initializer_offset) {
 				assert(inst.op == spv::OpSpecConstant || inst.op == spv::OpSpecConstantTrue || inst.op == spv::OpSpecConstantFalse);
 
 				const uint32_t spec_id = static_cast<uint32_t>(_module.spec_constants.size());
@@ -783,7 +1729,7 @@ private:
 				_module.spec_constants.push_back(scalar_info);
 			};
 
-			const spirv_instruction &base_inst = _types_and_constants.instructions.back();
+			const spirv_instruction_view base_inst = _types_and_constants.at(_spec_constants.at(res));
 			assert(base_inst.result == res);
 
 			// External specialization constants need to be scalars
@@ -799,12 +1745,11 @@ private:
 				for (size_t i = 0; i < (info.type.is_array() ? base_inst.operands.size() : 1); ++i)
 				{
 					constant initializer_value = info.initializer_value;
-					spirv_instruction elem_inst = base_inst;
+					spirv_instruction_view elem_inst = base_inst;
 
 					if (info.type.is_array())
 					{
-						elem_inst = *std::find_if(_types_and_constants.instructions.rbegin(), _types_and_constants.instructions.rend(),
-							[elem = base_inst.operands[i]](const auto &it) { return it.result == elem; });
+						elem_inst = _types_and_constants.at(_spec_constants.at(base_inst.operands[i]));
 
 						assert(initializer_value.array_data.size() == base_inst.operands.size());
 						initializer_value = initializer_value.array_data[i];
@@ -812,8 +1757,7 @@ private:
 
 					for (size_t row = 0; row < elem_inst.operands.size(); ++row)
 					{
-						const spirv_instruction &row_inst = *std::find_if(_types_and_constants.instructions.rbegin(), _types_and_constants.instructions.rend(),
-							[elem = elem_inst.operands[row]](const auto &it) { return it.result == elem; });
+						const spirv_instruction_view row_inst = _types_and_constants.at(_spec_constants.at(elem_inst.operands[row]));
 
 						if (row_inst.op != spv::OpSpecConstantComposite)
 						{
@@ -823,8 +1767,7 @@ private:
 
 						for (size_t col = 0; col < row_inst.operands.size(); ++col)
 						{
-							const spirv_instruction &col_inst = *std::find_if(_types_and_constants.instructions.rbegin(), _types_and_constants.instructions.rend(),
-								[elem = row_inst.operands[col]](const auto &it) { return it.result == elem; });
+							const spirv_instruction_view col_inst = _types_and_constants.at(_spec_constants.at(row_inst.operands[col]));
 
 							add_spec_constant(col_inst, info, initializer_value, row * info.type.cols + col);
 						}
@@ -923,7 +1866,7 @@ private:
 
 		spv::Id res;
 		// https://www.khronos.org/registry/spir-v/specs/unified1/SPIRV.html#OpVariable
-		spirv_instruction &inst = add_instruction(spv::OpVariable, convert_type(type, true, storage, format), block, res)
+		spirv_instruction inst = add_instruction(spv::OpVariable, convert_type(type, true, storage, format), block, res)
 			.add(storage);
 
 		if (initializer_value != 0)
@@ -1332,7 +2275,7 @@ private:
 				it != _storage_lookup.end())
 				storage = it->second;
 
-			spirv_instruction *access_chain = nullptr;
+			spirv_instruction access_chain = {};
 
 			// Check if this is a uniform variable (see 'define_uniform' function above) and dereference it
 			if (result & 0xF0000000)
@@ -1345,7 +2288,7 @@ private:
 				if (is_uniform_bool)
 					base_type.base = type::t_uint;
 
-				access_chain = &add_instruction(spv::OpAccessChain)
+				access_chain = add_instruction(spv::OpAccessChain)
 					.add(_global_ubo_variable)
 					.add(emit_constant(member_index));
 			}
@@ -1356,12 +2299,12 @@ private:
 				exp.chain[0].op == expression::operation::op_dynamic_index ||
 				exp.chain[0].op == expression::operation::op_constant_index))
 			{
-				// Ensure that 'access_chain' cannot get invalidated by calls to 'emit_constant' or 'convert_type'
+				// Ensure that 'access_chain' remains the last instruction in its block while calling 'emit_constant' or 'convert_type'
 				assert(_current_block_data != &_types_and_constants);
 
 				// Use access chain from uniform if possible, otherwise create new one
-				if (access_chain == nullptr) access_chain =
-					&add_instruction(spv::OpAccessChain).add(result); // Base
+				if (access_chain.result == 0) access_chain =
+					add_instruction(spv::OpAccessChain).add(result); // Base
 
 				// Ignore first index into 1xN matrices, since they were translated to a vector type in SPIR-V
 				if (exp.chain[0].from.rows == 1 && exp.chain[0].from.cols > 1)
@@ -1371,18 +2314,18 @@ private:
 					exp.chain[i].op == expression::operation::op_member ||
 					exp.chain[i].op == expression::operation::op_dynamic_index ||
 					exp.chain[i].op == expression::operation::op_constant_index); ++i)
-					access_chain->add(exp.chain[i].op == expression::operation::op_dynamic_index ?
+					access_chain.add(exp.chain[i].op == expression::operation::op_dynamic_index ?
 						exp.chain[i].index :
 						emit_constant(exp.chain[i].index)); // Indexes
 
 				base_type = exp.chain[i - 1].to;
-				access_chain->type = convert_type(base_type, true, storage.first, storage.second); // Last type is the result
-				result = access_chain->result;
+				access_chain.set_type(convert_type(base_type, true, storage.first, storage.second)); // Last type is the result
+				result = access_chain.result;
 			}
-			else if (access_chain != nullptr)
+			else if (access_chain.result != 0)
 			{
-				access_chain->type = convert_type(base_type, true, storage.first, storage.second, base_type.is_array() ? 16u : 0u);
-				result = access_chain->result;
+				access_chain.set_type(convert_type(base_type, true, storage.first, storage.second, base_type.is_array() ? 16u : 0u));
+				result = access_chain.result;
 			}
 
 			result = add_instruction(spv::OpLoad, convert_type(base_type, false, spv::StorageClassFunction, storage.second))
@@ -1509,7 +2452,7 @@ private:
 							scalar_type.rows = 1;
 							scalar_type.cols = 1;
 
-							spirv_instruction &node = add_instruction(spv::OpCompositeExtract, convert_type(scalar_type))
+							spirv_instruction node = add_instruction(spv::OpCompositeExtract, convert_type(scalar_type))
 								.add(result);
 
 							if (op.from.rows > 1) // Matrix types with a single row are actually vectors, so they don't need the extra index
@@ -1520,7 +2463,7 @@ private:
 							components[c] = node.result;
 						}
 
-						spirv_instruction &node = add_instruction(spv::OpCompositeConstruct, convert_type(op.to));
+						spirv_instruction node = add_instruction(spv::OpCompositeConstruct, convert_type(op.to));
 						for (unsigned int c = 0; c < 4 && op.swizzle[c] >= 0; ++c)
 							node.add(components[c]);
 						result = node.result;
@@ -1528,7 +2471,7 @@ private:
 					}
 					else if (op.from.is_vector())
 					{
-						spirv_instruction &node = add_instruction(spv::OpVectorShuffle, convert_type(op.to))
+						spirv_instruction node = add_instruction(spv::OpVectorShuffle, convert_type(op.to))
 							.add(result) // Vector 1
 							.add(result); // Vector 2
 						for (unsigned int c = 0; c < 4 && op.swizzle[c] >= 0; ++c)
@@ -1538,7 +2481,7 @@ private:
 					}
 					else
 					{
-						spirv_instruction &node = add_instruction(spv::OpCompositeConstruct, convert_type(op.to));
+						spirv_instruction node = add_instruction(spv::OpCompositeConstruct, convert_type(op.to));
 						for (unsigned int c = 0; c < op.to.rows; ++c)
 							node.add(result);
 						result = node.result;
@@ -1549,7 +2492,7 @@ private:
 				{
 					assert(op.swizzle[1] < 0);
 
-					spirv_instruction &node = add_instruction(spv::OpCompositeExtract, convert_type(op.to))
+					spirv_instruction node = add_instruction(spv::OpCompositeExtract, convert_type(op.to))
 						.add(result); // Composite
 					if (op.from.rows > 1)
 					{
@@ -1606,7 +2549,7 @@ private:
 
 					if (base_type.is_vector())
 					{
-						spirv_instruction &node = add_instruction(spv::OpVectorShuffle, convert_type(base_type))
+						spirv_instruction node = add_instruction(spv::OpVectorShuffle, convert_type(base_type))
 							.add(result) // Vector 1
 							.add(value); // Vector 2
 
@@ -1623,7 +2566,7 @@ private:
 					{
 						assert(op.swizzle[1] < 0);
 
-						spirv_instruction &node = add_instruction(spv::OpCompositeInsert, convert_type(base_type))
+						spirv_instruction node = add_instruction(spv::OpCompositeInsert, convert_type(base_type))
 							.add(value) // Object
 							.add(result); // Composite
 
@@ -1672,11 +2615,11 @@ private:
 			it != _storage_lookup.end())
 			storage = it->second;
 
-		// Ensure that 'access_chain' cannot get invalidated by calls to 'emit_constant' or 'convert_type'
+		// Ensure that 'access_chain' remains the last instruction in its block while calling 'emit_constant' or 'convert_type'
 		assert(_current_block_data != &_types_and_constants);
 
-		spirv_instruction *access_chain =
-			&add_instruction(spv::OpAccessChain).add(exp.base); // Base
+		spirv_instruction access_chain =
+			add_instruction(spv::OpAccessChain).add(exp.base); // Base
 
 		// Ignore first index into 1xN matrices, since they were translated to a vector type in SPIR-V
 		if (exp.chain[0].from.rows == 1 && exp.chain[0].from.cols > 1)
@@ -1686,12 +2629,12 @@ private:
 			exp.chain[i].op == expression::operation::op_member ||
 			exp.chain[i].op == expression::operation::op_dynamic_index ||
 			exp.chain[i].op == expression::operation::op_constant_index); ++i)
-			access_chain->add(exp.chain[i].op == expression::operation::op_dynamic_index ?
+			access_chain.add(exp.chain[i].op == expression::operation::op_dynamic_index ?
 				exp.chain[i].index :
 				emit_constant(exp.chain[i].index)); // Indexes
 
-		access_chain->type = convert_type(exp.chain[i - 1].to, true, storage.first, storage.second); // Last type is the result
-		return access_chain->result;
+		access_chain.set_type(convert_type(exp.chain[i - 1].to, true, storage.first, storage.second)); // Last type is the result
+		return access_chain.result;
 	}
 
 	id   emit_constant(uint32_t value)
@@ -1718,19 +2661,13 @@ private:
 	{
 		if (!spec_constant) // Specialization constants cannot reuse other constants
 		{
-			const auto it = std::find_if(_constant_lookup.begin(), _constant_lookup.end(),
-				[&type, &data](auto &x) {
-					if (!(std::get<0>(x) == type && std::memcmp(&std::get<1>(x).as_uint[0], &data.as_uint[0], sizeof(uint32_t) * 16) == 0 && std::get<1>(x).array_data.size() == data.array_data.size()))
-						return false;
-					for (size_t i = 0; i < data.array_data.size(); ++i)
-						if (std::memcmp(&std::get<1>(x).array_data[i].as_uint[0], &data.array_data[i].as_uint[0], sizeof(uint32_t) * 16) != 0)
-							return false;
-					return true; });
-			if (it != _constant_lookup.end())
-				return std::get<2>(*it); // Re-use existing constant instead of duplicating the definition
+			if (const auto it = _constant_lookup.find({ type, data });
+				it != _constant_lookup.end())
+				return it->second; // Re-use existing constant instead of duplicating the definition
 		}
 
 		spv::Id result;
+		spirv_instruction inst = {};
 		if (type.is_array())
 		{
 			assert(type.array_length > 0); // Unsized arrays cannot be constants
@@ -1748,16 +2685,16 @@ private:
 			for (size_t i = elements.size(); i < static_cast<size_t>(type.array_length); ++i)
 				elements.push_back(emit_constant(elem_type, {}, spec_constant));
 
-			result = add_instruction(spec_constant ? spv::OpSpecConstantComposite : spv::OpConstantComposite, convert_type(type), _types_and_constants)
-				.add(elements.begin(), elements.end())
-				.result;
+			inst = add_instruction(spec_constant ? spv::OpSpecConstantComposite : spv::OpConstantComposite, convert_type(type), _types_and_constants)
+				.add(elements.begin(), elements.end());
+			result = inst.result;
 		}
 		else if (type.is_struct())
 		{
 			assert(!spec_constant); // Structures cannot be specialization constants
 
-			result = add_instruction(spv::OpConstantNull, convert_type(type), _types_and_constants)
-				.result;
+			inst = add_instruction(spv::OpConstantNull, convert_type(type), _types_and_constants);
+			result = inst.result;
 		}
 		else if (type.is_vector() || type.is_matrix())
 		{
@@ -1784,33 +2721,33 @@ private:
 			}
 			else
 			{
-				spirv_instruction &node = add_instruction(spec_constant ? spv::OpSpecConstantComposite : spv::OpConstantComposite, convert_type(type), _types_and_constants);
+				inst = add_instruction(spec_constant ? spv::OpSpecConstantComposite : spv::OpConstantComposite, convert_type(type), _types_and_constants);
 				for (unsigned int i = 0; i < type.rows; ++i)
-					node.add(rows[i]);
+					inst.add(rows[i]);
 
-				result = node.result;
+				result = inst.result;
 			}
 		}
 		else if (type.is_boolean())
 		{
-			result = add_instruction(data.as_uint[0] ?
+			inst = add_instruction(data.as_uint[0] ?
 				(spec_constant ? spv::OpSpecConstantTrue : spv::OpConstantTrue) :
-				(spec_constant ? spv::OpSpecConstantFalse : spv::OpConstantFalse), convert_type(type), _types_and_constants)
-				.result;
+				(spec_constant ? spv::OpSpecConstantFalse : spv::OpConstantFalse), convert_type(type), _types_and_constants);
+			result = inst.result;
 		}
 		else
 		{
 			assert(type.is_scalar());
 
-			result = add_instruction(spec_constant ? spv::OpSpecConstant : spv::OpConstant, convert_type(type), _types_and_constants)
-				.add(data.as_uint[0])
-				.result;
+			inst = add_instruction(spec_constant ? spv::OpSpecConstant : spv::OpConstant, convert_type(type), _types_and_constants)
+				.add(data.as_uint[0]);
+			result = inst.result;
 		}
 
-		if (spec_constant) // Keep track of all specialization constants
-			_spec_constants.insert(result);
+		if (spec_constant) // Keep track of all specialization constants (matrices with a single row were already added as their row vector above)
+			_spec_constants.emplace(result, inst.offset);
 		else
-			_constant_lookup.push_back({ type, data, result });
+			_constant_lookup.emplace(constant_lookup { type, data }, result);
 
 		return result;
 	}
@@ -1836,7 +2773,7 @@ private:
 
 		add_location(loc, *_current_block_data);
 
-		spirv_instruction &inst = add_instruction(spv_op, convert_type(type));
+		spirv_instruction inst = add_instruction(spv_op, convert_type(type));
 		inst.add(val); // Operand
 
 		return inst.result;
@@ -1946,7 +2883,7 @@ private:
 					.add(row)
 					.result;
 
-				spirv_instruction &inst = add_instruction(spv_op, convert_type(vector_type));
+				spirv_instruction inst = add_instruction(spv_op, convert_type(vector_type));
 				inst.add(lhs_elem); // Operand 1
 				inst.add(rhs_elem); // Operand 2
 
@@ -1958,14 +2895,14 @@ private:
 				ids.push_back(inst.result);
 			}
 
-			spirv_instruction &inst = add_instruction(spv::OpCompositeConstruct, convert_type(res_type));
+			spirv_instruction inst = add_instruction(spv::OpCompositeConstruct, convert_type(res_type));
 			inst.add(ids.begin(), ids.end());
 
 			return inst.result;
 		}
 		else
 		{
-			spirv_instruction &inst = add_instruction(spv_op, convert_type(res_type));
+			spirv_instruction inst = add_instruction(spv_op, convert_type(res_type));
 			inst.add(lhs); // Operand 1
 			inst.add(rhs); // Operand 2
 
@@ -1984,7 +2921,7 @@ private:
 
 		add_location(loc, *_current_block_data);
 
-		spirv_instruction &inst = add_instruction(spv::OpSelect, convert_type(type));
+		spirv_instruction inst = add_instruction(spv::OpSelect, convert_type(type));
 		inst.add(condition); // Condition
 		inst.add(true_value); // Object 1
 		inst.add(false_value); // Object 2
@@ -2000,7 +2937,7 @@ private:
 		add_location(loc, *_current_block_data);
 
 		// https://www.khronos.org/registry/spir-v/specs/unified1/SPIRV.html#OpFunctionCall
-		spirv_instruction &inst = add_instruction(spv::OpFunctionCall, convert_type(res_type));
+		spirv_instruction inst = add_instruction(spv::OpFunctionCall, convert_type(res_type));
 		inst.add(function); // Function
 		for (const expression &arg : args)
 			inst.add(arg.base); // Arguments
@@ -2050,7 +2987,7 @@ private:
 			// Turn the list of scalar arguments into a list of column vectors
 			for (size_t arg = 0; arg < args.size(); arg += vector_type.rows)
 			{
-				spirv_instruction &inst = add_instruction(spv::OpCompositeConstruct, convert_type(vector_type));
+				spirv_instruction inst = add_instruction(spv::OpCompositeConstruct, convert_type(vector_type));
 				for (unsigned row = 0; row < vector_type.rows; ++row)
 					inst.add(args[arg + row].base);
 
@@ -2066,7 +3003,7 @@ private:
 				ids.push_back(arg.base);
 		}
 
-		spirv_instruction &inst = add_instruction(spv::OpCompositeConstruct, convert_type(type));
+		spirv_instruction inst = add_instruction(spv::OpCompositeConstruct, convert_type(type));
 		inst.add(ids.begin(), ids.end());
 
 		return inst.result;
@@ -2074,35 +3011,32 @@ private:
 
 	void emit_if(const location &loc, id, id condition_block, id true_statement_block, id false_statement_block, unsigned int selection_control) override
 	{
-		spirv_instruction merge_label = _current_block_data->instructions.back();
-		assert(merge_label.op == spv::OpLabel);
-		_current_block_data->instructions.pop_back();
+		uint32_t merge_label[2];
+		_current_block_data->pop_instruction(spv::OpLabel, merge_label);
 
 		// Add previous block containing the condition value first
 		_current_block_data->append(_block_data[condition_block]);
 
-		spirv_instruction branch_inst = _current_block_data->instructions.back();
-		assert(branch_inst.op == spv::OpBranchConditional);
-		_current_block_data->instructions.pop_back();
+		uint32_t branch_inst[4];
+		_current_block_data->pop_instruction(spv::OpBranchConditional, branch_inst);
 
 		// Add structured control flow instruction
 		add_location(loc, *_current_block_data);
 		add_instruction_without_result(spv::OpSelectionMerge)
-			.add(merge_label.result)
+			.add(merge_label[1])
 			.add(selection_control & 0x3); // 'SelectionControl' happens to match the flags produced by the parser
 
 		// Append all blocks belonging to the branch
-		_current_block_data->instructions.push_back(branch_inst);
+		_current_block_data->push_instruction(branch_inst);
 		_current_block_data->append(_block_data[true_statement_block]);
 		_current_block_data->append(_block_data[false_statement_block]);
 
-		_current_block_data->instructions.push_back(merge_label);
+		_current_block_data->push_instruction(merge_label);
 	}
 	id   emit_phi(const location &loc, id, id condition_block, id true_value, id true_statement_block, id false_value, id false_statement_block, const type &type) override
 	{
-		spirv_instruction merge_label = _current_block_data->instructions.back();
-		assert(merge_label.op == spv::OpLabel);
-		_current_block_data->instructions.pop_back();
+		uint32_t merge_label[2];
+		_current_block_data->pop_instruction(spv::OpLabel, merge_label);
 
 		// Add previous block containing the condition value first
 		_current_block_data->append(_block_data[condition_block]);
@@ -2112,12 +3046,12 @@ private:
 		if (false_statement_block != condition_block)
 			_current_block_data->append(_block_data[false_statement_block]);
 
-		_current_block_data->instructions.push_back(merge_label);
+		_current_block_data->push_instruction(merge_label);
 
 		add_location(loc, *_current_block_data);
 
 		// https://www.khronos.org/registry/spir-v/specs/unified1/SPIRV.html#OpPhi
-		spirv_instruction &inst = add_instruction(spv::OpPhi, convert_type(type))
+		spirv_instruction inst = add_instruction(spv::OpPhi, convert_type(type))
 			.add(true_value) // Variable 0
 			.add(true_statement_block) // Parent 0
 			.add(false_value) // Variable 1
@@ -2127,27 +3061,26 @@ private:
 	}
 	void emit_loop(const location &loc, id, id prev_block, id header_block, id condition_block, id loop_block, id continue_block, unsigned int loop_control) override
 	{
-		spirv_instruction merge_label = _current_block_data->instructions.back();
-		assert(merge_label.op == spv::OpLabel);
-		_current_block_data->instructions.pop_back();
+		uint32_t merge_label[2];
+		_current_block_data->pop_instruction(spv::OpLabel, merge_label);
 
 		// Add previous block first
 		_current_block_data->append(_block_data[prev_block]);
 
 		// Fill header block
-		assert(_block_data[header_block].instructions.size() == 2);
-		_current_block_data->instructions.push_back(_block_data[header_block].instructions[0]);
-		assert(_current_block_data->instructions.back().op == spv::OpLabel);
+		const spirv_basic_block &header_block_data = _block_data[header_block];
+		assert(header_block_data.words.size() == 4 && header_block_data.words[0] == ((2u << spv::WordCountShift) | spv::OpLabel));
+		_current_block_data->words.insert(_current_block_data->words.end(), header_block_data.words.begin(), header_block_data.words.begin() + 2);
 
 		// Add structured control flow instruction
 		add_location(loc, *_current_block_data);
 		add_instruction_without_result(spv::OpLoopMerge)
-			.add(merge_label.result)
+			.add(merge_label[1])
 			.add(continue_block)
 			.add(loop_control & 0x3); // 'LoopControl' happens to match the flags produced by the parser
 
-		_current_block_data->instructions.push_back(_block_data[header_block].instructions[1]);
-		assert(_current_block_data->instructions.back().op == spv::OpBranch);
+		assert(header_block_data.words[2] == ((2u << spv::WordCountShift) | spv::OpBranch));
+		_current_block_data->words.insert(_current_block_data->words.end(), header_block_data.words.begin() + 2, header_block_data.words.end());
 
 		// Add condition block if it exists
 		if (condition_block != 0)
@@ -2157,38 +3090,36 @@ private:
 		_current_block_data->append(_block_data[loop_block]);
 		_current_block_data->append(_block_data[continue_block]);
 
-		_current_block_data->instructions.push_back(merge_label);
+		_current_block_data->push_instruction(merge_label);
 	}
 	void emit_switch(const location &loc, id, id selector_block, id default_label, id default_block, const std::vector<id> &case_literal_and_labels, const std::vector<id> &case_blocks, unsigned int selection_control) override
 	{
 		assert(case_blocks.size() == case_literal_and_labels.size() / 2);
 
-		spirv_instruction merge_label = _current_block_data->instructions.back();
-		assert(merge_label.op == spv::OpLabel);
-		_current_block_data->instructions.pop_back();
+		uint32_t merge_label[2];
+		_current_block_data->pop_instruction(spv::OpLabel, merge_label);
 
 		// Add previous block containing the selector value first
 		_current_block_data->append(_block_data[selector_block]);
 
-		spirv_instruction switch_inst = _current_block_data->instructions.back();
-		assert(switch_inst.op == spv::OpSwitch);
-		_current_block_data->instructions.pop_back();
+		uint32_t switch_inst[3];
+		_current_block_data->pop_instruction(spv::OpSwitch, switch_inst);
 
 		// Add structured control flow instruction
 		add_location(loc, *_current_block_data);
 		add_instruction_without_result(spv::OpSelectionMerge)
-			.add(merge_label.result)
+			.add(merge_label[1])
 			.add(selection_control & 0x3); // 'SelectionControl' happens to match the flags produced by the parser
 
-		// Update switch instruction to contain all case labels
-		switch_inst.operands[1] = default_label;
-		switch_inst.add(case_literal_and_labels.begin(), case_literal_and_labels.end());
+		// Add switch instruction again with the actual default label and all case labels
+		add_instruction_without_result(spv::OpSwitch)
+			.add(switch_inst[1]) // Selector
+			.add(default_label)
+			.add(case_literal_and_labels.begin(), case_literal_and_labels.end());
 
 		// Append all blocks belonging to the switch
-		_current_block_data->instructions.push_back(switch_inst);
-
 		std::vector<id> blocks = case_blocks;
-		if (default_label != merge_label.result)
+		if (default_label != merge_label[1])
 			blocks.push_back(default_block);
 		// Eliminate duplicates (because of multiple case labels pointing to the same block)
 		std::sort(blocks.begin(), blocks.end());
@@ -2196,7 +3127,7 @@ private:
 		for (const id case_block : blocks)
 			_current_block_data->append(_block_data[case_block]);
 
-		_current_block_data->instructions.push_back(merge_label);
+		_current_block_data->push_instruction(merge_label);
 	}
 
 	bool is_in_function() const override { return _current_function != nullptr; }
@@ -2217,8 +3148,7 @@ private:
 
 		set_block(id);
 
-		add_instruction_without_result(spv::OpLabel)
-			.result = id;
+		_current_block_data->add_instruction(spv::OpLabel, 0, id);
 	}
 	id   leave_block_and_kill() override
 	{
@@ -2299,7 +3229,7 @@ private:
 	{
 		assert(is_in_function()); // Can only leave if there was a function to begin with
 
-		_current_function->definition = _block_data[_last_block];
+		_current_function->definition = std::move(_block_data[_last_block]);
 
 		// Append function end instruction
 		add_instruction_without_result(spv::OpFunctionEnd, _current_function->definition);
@@ -2308,7 +3238,7 @@ private:
 	}
 };
 
-codegen *reshadefx::create_codegen_spirv(bool vulkan_semantics, bool debug_info, bool uniforms_to_spec_constants, bool enable_16bit_types, bool flip_vert_y)
+codegen *reshadefx::create_codegen_spirv(bool vulkan_semantics, bool debug_info, bool uniforms_to_spec_constants, bool enable_16bit_types, bool flip_vert_y, bool optimize)
 {
-	return new codegen_spirv(vulkan_semantics, debug_info, uniforms_to_spec_constants, enable_16bit_types, flip_vert_y);
+	return new codegen_spirv(vulkan_semantics, debug_info, uniforms_to_spec_constants, enable_16bit_types, flip_vert_y, optimize);
 }
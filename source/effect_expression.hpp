@@ -6,9 +6,107 @@
 #pragma once
 
 #include "effect_token.hpp"
+#include <new> // Placement new
+#include <cstring> // std::memcpy
+#include <type_traits>
 
 namespace reshadefx
 {
+	/// <summary>
+	/// A list of trivially copyable elements which stores the first few of them inline, so that short lists do not need a heap allocation.
+	/// </summary>
+	template <typename T, size_t N>
+	class small_vector
+	{
+		static_assert(std::is_trivially_copyable_v<T>);
+
+	public:
+		small_vector() = default;
+		small_vector(const small_vector &other) { append(other); }
+		small_vector(small_vector &&other) noexcept { operator=(std::move(other)); }
+		~small_vector() { ::operator delete(_heap); }
+
+		small_vector &operator=(const small_vector &other)
+		{
+			if (this != &other)
+			{
+				clear();
+				append(other);
+			}
+			return *this;
+		}
+		small_vector &operator=(small_vector &&other) noexcept
+		{
+			if (this == &other)
+				return *this;
+
+			if (other._heap != nullptr)
+			{
+				// Take over the heap allocation of the other list, so that no elements have to be copied
+				std::swap(_heap, other._heap);
+				std::swap(_capacity, other._capacity);
+				_size = other._size;
+			}
+			else
+			{
+				clear();
+				append(other);
+			}
+
+			other._size = 0;
+			return *this;
+		}
+
+		T *data() { return _heap != nullptr ? _heap : reinterpret_cast<T *>(_inline); }
+		const T *data() const { return _heap != nullptr ? _heap : reinterpret_cast<const T *>(_inline); }
+
+		T *begin() { return data(); }
+		const T *begin() const { return data(); }
+		T *end() { return data() + _size; }
+		const T *end() const { return data() + _size; }
+
+		T &operator[](size_t index) { return data()[index]; }
+		const T &operator[](size_t index) const { return data()[index]; }
+
+		size_t size() const { return _size; }
+		bool empty() const { return _size == 0; }
+
+		void clear() { _size = 0; }
+
+		void push_back(const T &value)
+		{
+			if (_size == _capacity)
+				reserve(_capacity * 2);
+			new (data() + _size++) T(value);
+		}
+
+		void reserve(size_t capacity)
+		{
+			if (capacity <= _capacity)
+				return;
+
+			T *const heap = static_cast<T *>(::operator new(capacity * sizeof(T)));
+			std::memcpy(static_cast<void *>(heap), data(), _size * sizeof(T));
+			::operator delete(_heap);
+
+			_heap = heap;
+			_capacity = static_cast<uint32_t>(capacity);
+		}
+
+	private:
+		void append(const small_vector &other)
+		{
+			reserve(_size + other._size);
+			std::memcpy(static_cast<void *>(data() + _size), other.data(), other._size * sizeof(T));
+			_size += other._size;
+		}
+
+		T *_heap = nullptr;
+		uint32_t _size = 0;
+		uint32_t _capacity = N;
+		alignas(T) unsigned char _inline[N * sizeof(T)];
+	};
+
 	/// <summary>
 	/// Structure which encapsulates a parsed value type
 	/// </summary>
@@ -153,7 +251,8 @@ namespace reshadefx
 		bool is_lvalue = false;
 		bool is_constant = false;
 		reshadefx::location location;
-		std::vector<operation> chain;
+		// Most access chains are a single member or index access, optionally followed by a swizzle, so store those inline
+		small_vector<operation, 2> chain;
 
 		/// <summary>
 		/// Initializes the expression to a l-value.
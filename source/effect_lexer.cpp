@@ -5,10 +5,56 @@
 
 #include "effect_lexer.hpp"
 #include <cassert>
+#include <cstdint>
+#include <cstring> // std::memchr
+#include <algorithm> // std::min
+#include <iterator> // std::size
+#include <mutex>
 #include <unordered_map> // Used for static lookup tables
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#define RESHADEFX_LEXER_SSE2 1
+#endif
 
 using namespace reshadefx;
 
+#if RESHADEFX_LEXER_SSE2
+static inline unsigned int bit_scan_forward(unsigned int mask)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return index;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+#endif
+
+// Finds the next character that can affect where the next preprocessor directive is, which is a new line, the start of a comment or string literal, or the end of input
+static const char *find_next_directive_candidate(const char *begin, const char *end)
+{
+#if RESHADEFX_LEXER_SSE2
+	for (; end - begin >= 16; begin += 16)
+	{
+		const __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i *>(begin));
+		const __m128i matches = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(chars, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(chars, _mm_set1_epi8('/'))),
+			_mm_or_si128(_mm_cmpeq_epi8(chars, _mm_set1_epi8('"')), _mm_cmpeq_epi8(chars, _mm_setzero_si128())));
+
+		if (const unsigned int mask = static_cast<unsigned int>(_mm_movemask_epi8(matches));
+			mask != 0)
+			return begin + bit_scan_forward(mask);
+	}
+#endif
+	while (begin < end && *begin != '\n' && *begin != '/' && *begin != '"' && *begin != '\0')
+		begin++;
+	return begin;
+}
+
 enum token_type
 {
 	DIGIT = '0',
@@ -198,7 +244,63 @@ static const std::unordered_map<tokenid, std::string> token_lookup = {
 	{ tokenid::sampler, "sampler" },
 	{ tokenid::storage, "storage" },
 };
-static const std::unordered_map<std::string, tokenid> keyword_lookup = {
+struct keyword
+{
+	std::string_view name;
+	tokenid id;
+};
+
+/// <summary>
+/// A perfect hash table that maps the names in a fixed list of keywords to their token, which is built at compile time.
+/// The seed is chosen so that no two names in the list hash to the same slot, which is verified with a static assertion after construction.
+/// </summary>
+template <size_t N, unsigned int BITS>
+struct keyword_hash_table
+{
+	static_assert(N < 256, "slots only store an 8-bit index into the keyword list");
+
+	static constexpr uint32_t hash(std::string_view name, uint32_t seed)
+	{
+		// FNV-1a
+		for (const char c : name)
+			seed = (seed ^ static_cast<uint8_t>(c)) * 16777619u;
+		return seed >> (32 - BITS);
+	}
+
+	constexpr keyword_hash_table(const keyword (&list)[N], uint32_t seed) : list(list), seed(seed)
+	{
+		for (size_t i = 0; i < N; ++i)
+		{
+			uint8_t &slot = slots[hash(list[i].name, seed)];
+			if (slot != 0)
+				is_perfect = false;
+			slot = static_cast<uint8_t>(i + 1);
+
+			if (list[i].name.size() > max_length)
+				max_length = list[i].name.size();
+		}
+	}
+
+	constexpr tokenid find(std::string_view name, tokenid not_found) const
+	{
+		if (name.size() > max_length)
+			return not_found;
+
+		if (const uint8_t slot = slots[hash(name, seed)];
+			slot != 0 && list[slot - 1].name == name)
+			return list[slot - 1].id;
+		else
+			return not_found;
+	}
+
+	const keyword *list;
+	uint32_t seed;
+	uint8_t slots[1 << BITS] = {};
+	size_t max_length = 0;
+	bool is_perfect = true;
+};
+
+static constexpr keyword keyword_list[] = {
 	{ "asm", tokenid::reserved },
 	{ "asm_fragment", tokenid::reserved },
 	{ "auto", tokenid::reserved },
@@ -432,7 +534,7 @@ static const std::unordered_map<std::string, tokenid> keyword_lookup = {
 	{ "volatile", tokenid::volatile_ },
 	{ "while", tokenid::while_ }
 };
-static const std::unordered_map<std::string, tokenid> pp_directive_lookup = {
+static constexpr keyword pp_directive_list[] = {
 	{ "define", tokenid::hash_def },
 	{ "undef", tokenid::hash_undef },
 	{ "if", tokenid::hash_if },
@@ -447,6 +549,11 @@ static const std::unordered_map<std::string, tokenid> pp_directive_lookup = {
 	{ "include", tokenid::hash_include },
 };
 
+static constexpr keyword_hash_table<std::size(keyword_list), 12> keyword_lookup(keyword_list, 2166136479u);
+static_assert(keyword_lookup.is_perfect, "keyword hash table seed produces collisions, choose a different one");
+static constexpr keyword_hash_table<std::size(pp_directive_list), 6> pp_directive_lookup(pp_directive_list, 2166136268u);
+static_assert(pp_directive_lookup.is_perfect, "preprocessor directive hash table seed produces collisions, choose a different one");
+
 static inline bool is_octal_digit(char c)
 {
 	return static_cast<unsigned>(c - '0') < 8;
@@ -495,6 +602,42 @@ static long long octal_to_decimal(long long n)
 	return n;
 }
 
+static thread_local reshadefx::string_pool *s_current_string_pool = nullptr;
+
+reshadefx::string_pool::scope::scope(string_pool &pool) : _previous(s_current_string_pool)
+{
+	s_current_string_pool = &pool;
+}
+reshadefx::string_pool::scope::~scope()
+{
+	s_current_string_pool = _previous;
+}
+
+const std::string *reshadefx::string_pool::intern(std::string_view str)
+{
+	if (str.empty())
+		return nullptr;
+
+	const std::lock_guard<std::mutex> lock(_mutex);
+
+	if (const auto it = _strings.find(str); it != _strings.end())
+		return it->second.get();
+
+	auto new_string = std::make_unique<const std::string>(str);
+	const std::string *const result = new_string.get();
+	_strings.emplace(*result, std::move(new_string));
+	return result;
+}
+reshadefx::string_pool &reshadefx::string_pool::current()
+{
+	if (s_current_string_pool != nullptr)
+		return *s_current_string_pool;
+
+	// Strings interned on threads that did not select a pool are kept for the lifetime of the process
+	static string_pool s_global_pool;
+	return s_global_pool;
+}
+
 std::string reshadefx::token::id_to_name(tokenid id)
 {
 	const auto it = token_lookup.find(id);
@@ -514,7 +657,7 @@ next_token:
 	tok.offset = input_offset();
 	tok.length = 1;
 	tok.literal_as_double = 0;
-	tok.literal_as_string.clear();
+	tok.literal_as_string = {};
 
 	assert(_cur <= _end);
 
@@ -788,30 +931,126 @@ void reshadefx::lexer::skip_to_next_line()
 		skip(1);
 }
 
+void reshadefx::lexer::skip_to_next_pp_directive()
+{
+	// Lexing resumes at the beginning of the line that contains the directive, so keep track of where that is
+	const char *line_begin = _cur_location.column <= 1 ? _cur : nullptr;
+	const char *const start = _cur, *physical_line_begin = nullptr;
+	unsigned int line = _cur_location.line, line_begin_line = line;
+
+	while (_cur < _end && *_cur != '\0')
+	{
+		if (*_cur == '\n')
+		{
+			line_begin = physical_line_begin = ++_cur;
+			line_begin_line = ++line;
+			continue;
+		}
+
+		if (line_begin != nullptr)
+		{
+			// A hash is only a directive if it is preceded by nothing but whitespace and comments on its line (see 'lex')
+			if (*_cur == '#')
+			{
+				_cur = line_begin;
+				_cur_location.line = line_begin_line;
+				_cur_location.column = 1;
+				return;
+			}
+			if (type_lookup[uint8_t(*_cur)] == SPACE)
+			{
+				_cur++;
+				continue;
+			}
+		}
+
+		if (_cur[0] == '/' && _cur[1] == '*')
+		{
+			for (_cur += 1; _cur < _end && !(_cur[0] == '*' && _cur[1] == '/'); ++_cur)
+				if (*_cur == '\n')
+					line++, physical_line_begin = _cur + 1;
+			_cur = std::min(_cur + 2, _end);
+			continue;
+		}
+
+		line_begin = nullptr;
+
+		if (_cur[0] == '/' && _cur[1] == '/')
+		{
+			const auto line_end = static_cast<const char *>(std::memchr(_cur, '\n', _end - _cur));
+			_cur = line_end != nullptr ? line_end : _end;
+			continue;
+		}
+		if (*_cur == '"')
+		{
+			// String literals end at the closing quote or the end of the line, unless the line feed is escaped (see 'parse_string_literal')
+			for (++_cur; _cur < _end && *_cur != '"'; ++_cur)
+			{
+				if (*_cur == '\n')
+					break;
+				if (*_cur == '\\' && (_cur[1] == '\n' || (_cur[1] == '\r' && _cur[2] == '\n')))
+					_cur += _cur[1] == '\r' ? 2 : 1, line++, physical_line_begin = _cur + 1;
+			}
+			if (_cur < _end && *_cur == '"')
+				_cur++;
+			continue;
+		}
+
+		// Nothing else on this line can start a directive, so skip ahead to the next character that could change that
+		_cur = find_next_directive_candidate(_cur + 1, _end);
+	}
+
+	_cur = std::min(_cur, _end);
+	_cur_location.line = line;
+	_cur_location.column = physical_line_begin != nullptr ? static_cast<unsigned int>(_cur - physical_line_begin) + 1 : _cur_location.column + static_cast<unsigned int>(_cur - start);
+}
+
 void reshadefx::lexer::reset_to_offset(size_t offset)
 {
-	assert(offset < _input.size());
-	_cur = _input.data() + offset;
+	assert(offset < _input->size());
+	_cur = _input->data() + offset;
 }
 
 void reshadefx::lexer::parse_identifier(token &tok) const
 {
-	auto *const begin = _cur, *end = begin;
+	auto *const begin = _cur, *end = begin + 1;
 
 	// Skip to the end of the identifier sequence
-	do end++; while (type_lookup[uint8_t(*end)] == IDENT || type_lookup[uint8_t(*end)] == DIGIT);
+#if RESHADEFX_LEXER_SSE2
+	// Test 16 characters at once while there is enough input left, which covers most identifiers in a single iteration
+	for (; _end - end >= 16; end += 16)
+	{
+		const __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i *>(end));
+		// Compare ranges by shifting them to start at the smallest signed value, since there are only signed comparisons available
+		const __m128i is_alpha = _mm_cmplt_epi8(_mm_add_epi8(_mm_or_si128(chars, _mm_set1_epi8(0x20)), _mm_set1_epi8(static_cast<char>(0x80 - 'a'))), _mm_set1_epi8(static_cast<char>(0x80 + 26)));
+		const __m128i is_digit = _mm_cmplt_epi8(_mm_add_epi8(chars, _mm_set1_epi8(static_cast<char>(0x80 - '0'))), _mm_set1_epi8(static_cast<char>(0x80 + 10)));
+		const __m128i is_underscore = _mm_cmpeq_epi8(chars, _mm_set1_epi8('_'));
+
+		if (const unsigned int mask = ~static_cast<unsigned int>(_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(is_alpha, is_digit), is_underscore))) & 0xFFFF;
+			mask != 0)
+		{
+			// Advance to the first character that is not part of the identifier
+			end += bit_scan_forward(mask);
+			break;
+		}
+	}
+#endif
+	while (type_lookup[uint8_t(*end)] == IDENT || type_lookup[uint8_t(*end)] == DIGIT)
+		end++;
 
 	tok.id = tokenid::identifier;
 	tok.offset = input_offset();
 	tok.length = end - begin;
-	tok.literal_as_string.assign(begin, end);
+	tok.literal_as_string = std::string_view(begin, end - begin);
 
 	if (_ignore_keywords)
 		return;
 
-	if (const auto it = keyword_lookup.find(tok.literal_as_string);
-		it != keyword_lookup.end())
-		tok.id = it->second;
+	tok.id = keyword_lookup.find(tok.literal_as_string, tokenid::identifier);
+}
+reshadefx::tokenid reshadefx::lexer::find_keyword(std::string_view name)
+{
+	return keyword_lookup.find(name, tokenid::identifier);
 }
 bool reshadefx::lexer::parse_pp_directive(token &tok)
 {
@@ -819,10 +1058,10 @@ bool reshadefx::lexer::parse_pp_directive(token &tok)
 	skip_space(); // Skip any space between the '#' and directive
 	parse_identifier(tok);
 
-	if (const auto it = pp_directive_lookup.find(tok.literal_as_string);
-		it != pp_directive_lookup.end())
+	if (const tokenid id = pp_directive_lookup.find(tok.literal_as_string, tokenid::hash_unknown);
+		id != tokenid::hash_unknown)
 	{
-		tok.id = it->second;
+		tok.id = id;
 		return true;
 	}
 	else if (!_ignore_line_directives && tok.literal_as_string == "line") // The #line directive needs special handling
@@ -846,7 +1085,7 @@ bool reshadefx::lexer::parse_pp_directive(token &tok)
 			token temptok;
 			parse_string_literal(temptok, false);
 
-			_cur_location.source = std::move(temptok.literal_as_string);
+			_cur_location.source = temptok.literal_as_string;
 		}
 
 		// Do not return the #line directive as token to the caller
@@ -861,6 +1100,21 @@ void reshadefx::lexer::parse_string_literal(token &tok, bool escape)
 {
 	auto *const begin = _cur, *end = begin + 1; // Skip first quote character right away
 
+	tok.id = tokenid::string_literal;
+
+	// Most string literals contain no special characters and can therefore simply reference the input string
+	for (auto *it = end; it < _end && *it != '\\' && *it != '\r' && *it != '\n'; ++it)
+	{
+		if (*it == '"')
+		{
+			tok.length = it - begin + 1;
+			tok.literal_as_string = std::string_view(begin + 1, it - begin - 1);
+			return;
+		}
+	}
+
+	std::string literal;
+
 	for (auto c = *end; c != '"'; c = *++end)
 	{
 		if (c == '\n' || end >= _end)
@@ -951,11 +1205,21 @@ void reshadefx::lexer::parse_string_literal(token &tok, bool escape)
 			}
 		}
 
-		tok.literal_as_string += c;
+		literal += c;
 	}
 
-	tok.id = tokenid::string_literal;
 	tok.length = end - begin + 1;
+
+	// Only need to keep a separate copy if the contents actually differ from the input string
+	if (std::string_view(begin + 1, literal.size()) == literal)
+	{
+		tok.literal_as_string = std::string_view(begin + 1, literal.size());
+	}
+	else
+	{
+		_escaped_literals.push_front(std::move(literal));
+		tok.literal_as_string = _escaped_literals.front();
+	}
 }
 void reshadefx::lexer::parse_numeric_literal(token &tok) const
 {
@@ -6,6 +6,8 @@
 #pragma once
 
 #include "effect_token.hpp"
+#include <forward_list>
+#include <memory> // std::shared_ptr
 
 namespace reshadefx
 {
@@ -24,6 +26,22 @@ namespace reshadefx
 			bool ignore_keywords = false,
 			bool escape_string_literals = true,
 			const location &start_location = location()) :
+			lexer(std::make_shared<const std::string>(std::move(input)), ignore_comments, ignore_whitespace, ignore_pp_directives, ignore_line_directives, ignore_keywords, escape_string_literals, start_location)
+		{
+		}
+		/// <summary>
+		/// Constructs a lexical analyzer that works directly on a shared input string, without copying it.
+		/// The literals of the returned tokens reference the input string or storage owned by this lexical analyzer, so they are only valid while it is alive.
+		/// </summary>
+		explicit lexer(
+			std::shared_ptr<const std::string> input,
+			bool ignore_comments = true,
+			bool ignore_whitespace = true,
+			bool ignore_pp_directives = true,
+			bool ignore_line_directives = false,
+			bool ignore_keywords = false,
+			bool escape_string_literals = true,
+			const location &start_location = location()) :
 			_input(std::move(input)),
 			_cur_location(start_location),
 			_ignore_comments(ignore_comments),
@@ -33,17 +51,18 @@ namespace reshadefx
 			_ignore_keywords(ignore_keywords),
 			_escape_string_literals(escape_string_literals)
 		{
-			_cur = _input.data();
-			_end = _cur + _input.size();
+			_cur = _input->data();
+			_end = _cur + _input->size();
 		}
 
 		lexer(const lexer &lexer) { operator=(lexer); }
 		lexer &operator=(const lexer &lexer)
 		{
+			// The input string is immutable, so can share it instead of creating a copy
 			_input = lexer._input;
 			_cur_location = lexer._cur_location;
-			reset_to_offset(lexer._cur - lexer._input.data());
-			_end = _input.data() + _input.size();
+			reset_to_offset(lexer._cur - lexer._input->data());
+			_end = _input->data() + _input->size();
 			_ignore_comments = lexer._ignore_comments;
 			_ignore_whitespace = lexer._ignore_whitespace;
 			_ignore_pp_directives = lexer._ignore_pp_directives;
@@ -57,13 +76,18 @@ namespace reshadefx
 		/// <summary>
 		/// Gets the current position in the input string.
 		/// </summary>
-		size_t input_offset() const { return _cur - _input.data(); }
+		size_t input_offset() const { return _cur - _input->data(); }
+
+		/// <summary>
+		/// Gets the location of the current position in the input string.
+		/// </summary>
+		const location &input_location() const { return _cur_location; }
 
 		/// <summary>
 		/// Gets the input string this lexical analyzer works on.
 		/// </summary>
-		/// <returns>Constant reference to the input string.</returns>
-		const std::string &input_string() const { return _input; }
+		/// <returns>View of the input string.</returns>
+		std::string_view input_string() const { return *_input; }
 
 		/// <summary>
 		/// Performs lexical analysis on the input string and return the next token in sequence.
@@ -79,12 +103,33 @@ namespace reshadefx
 		/// Advances to the next new line, ignoring all tokens.
 		/// </summary>
 		void skip_to_next_line();
+		/// <summary>
+		/// Advances to the beginning of the next line with a preprocessor directive, without tokenizing anything in between.
+		/// </summary>
+		void skip_to_next_pp_directive();
 
 		/// <summary>
 		/// Resets position to the specified <paramref name="offset"/>.
 		/// </summary>
 		/// <param name="offset">Offset in characters from the start of the input string.</param>
 		void reset_to_offset(size_t offset);
+		/// <summary>
+		/// Resets position to the specified <paramref name="offset"/> and the location to the one that was reported at that position.
+		/// </summary>
+		/// <param name="offset">Offset in characters from the start of the input string.</param>
+		/// <param name="location">Location at that offset, as previously returned by <see cref="input_location"/>.</param>
+		void reset_to_offset(size_t offset, const location &location)
+		{
+			reset_to_offset(offset);
+			_cur_location = location;
+		}
+
+		/// <summary>
+		/// Looks up the keyword with the specified <paramref name="name"/>.
+		/// </summary>
+		/// <param name="name">Identifier to look up.</param>
+		/// <returns>Token identifier of the keyword, or <see cref="tokenid::identifier"/> if the name is not a keyword.</returns>
+		static tokenid find_keyword(std::string_view name);
 
 	private:
 		/// <summary>
@@ -98,7 +143,9 @@ namespace reshadefx
 		void parse_string_literal(token &tok, bool escape);
 		void parse_numeric_literal(token &tok) const;
 
-		std::string _input;
+		std::shared_ptr<const std::string> _input;
+		// String literals with escape sequences cannot reference the input string directly, so their contents are stored here instead
+		std::forward_list<std::string> _escaped_literals;
 		location _cur_location;
 		const std::string::value_type *_cur, *_end;
 		bool _ignore_comments;
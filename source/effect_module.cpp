@@ -0,0 +1,292 @@
+/*
+ * Copyright (C) 2014 Patrick Mours
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "effect_module.hpp"
+#include <cstring> // std::memcpy
+#include <type_traits>
+
+// Has to be incremented whenever any of the structures written below change, so that old data is rejected instead of being misinterpreted
+static constexpr uint32_t s_module_format_version = 1;
+static constexpr char s_module_format_magic[4] = { 'R', 'F', 'X', 'M' };
+
+// Every structure lists its fields only once, in a function that is used both for writing and reading it
+template <typename Archive>
+static void transfer(Archive &ar, reshadefx::type &type)
+{
+	ar(type.base);
+	ar(type.rows);
+	ar(type.cols);
+	ar(type.qualifiers);
+	ar(type.array_length);
+	ar(type.definition);
+}
+template <typename Archive>
+static void transfer(Archive &ar, reshadefx::constant &constant)
+{
+	ar(constant.as_uint);
+	ar(constant.string_data);
+	ar(constant.array_data);
+}
+template <typename Archive>
+static void transfer(Archive &ar, reshadefx::annotation &annotation)
+{
+	ar(annotation.type);
+	ar(annotation.name);
+	ar(annotation.value);
+}
+template <typename Archive>
+static void transfer(Archive &ar, reshadefx::entry_point &entry_point)
+{
+	ar(entry_point.name);
+	ar(entry_point.type);
+}
+template <typename Archive>
+static void transfer(Archive &ar, reshadefx::texture_info &info)
+{
+	ar(info.id);
+	ar(info.binding);
+	ar(info.name);
+	ar(info.semantic);
+	ar(info.unique_name);
+	ar(info.annotations);
+	ar(info.width);
+	ar(info.height);
+	ar(info.levels);
+	ar(info.format);
+	ar(info.render_target);
+	ar(info.storage_access);
+}
+template <typename Archive>
+static void transfer(Archive &ar, reshadefx::sampler_info &info)
+{
+	ar(info.id);
+	ar(info.binding);
+	ar(info.texture_binding);
+	ar(info.name);
+	ar(info.unique_name);
+	ar(info.texture_name);
+	ar(info.annotations);
+	ar(info.filter);
+	ar(info.address_u);
+	ar(info.address_v);
+	ar(info.address_w);
+	ar(info.min_lod);
+	ar(info.max_lod);
+	ar(info.lod_bias);
+	ar(info.srgb);
+}
+template <typename Archive>
+static void transfer(Archive &ar, reshadefx::storage_info &info)
+{
+	ar(info.id);
+	ar(info.binding);
+	ar(info.name);
+	ar(info.unique_name);
+	ar(info.texture_name);
+	ar(info.format);
+}
+template <typename Archive>
+static void transfer(Archive &ar, reshadefx::uniform_info &info)
+{
+	ar(info.name);
+	ar(info.type);
+	ar(info.size);
+	ar(info.offset);
+	ar(info.annotations);
+	ar(info.has_initializer_value);
+	ar(info.initializer_value);
+}
+template <typename Archive>
+static void transfer(Archive &ar, reshadefx::pass_info &info)
+{
+	ar(info.name);
+	ar(info.render_target_names);
+	ar(info.vs_entry_point);
+	ar(info.ps_entry_point);
+	ar(info.cs_entry_point);
+	ar(info.clear_render_targets);
+	ar(info.srgb_write_enable);
+	ar(info.blend_enable);
+	ar(info.stencil_enable);
+	ar(info.color_write_mask);
+	ar(info.stencil_read_mask);
+	ar(info.stencil_write_mask);
+	ar(info.blend_op);
+	ar(info.blend_op_alpha);
+	ar(info.src_blend);
+	ar(info.dest_blend);
+	ar(info.src_blend_alpha);
+	ar(info.dest_blend_alpha);
+	ar(info.stencil_comparison_func);
+	ar(info.stencil_reference_value);
+	ar(info.stencil_op_pass);
+	ar(info.stencil_op_fail);
+	ar(info.stencil_op_depth_fail);
+	ar(info.num_vertices);
+	ar(info.topology);
+	ar(info.viewport_width);
+	ar(info.viewport_height);
+	ar(info.viewport_dispatch_z);
+	ar(info.samplers);
+	ar(info.storages);
+}
+template <typename Archive>
+static void transfer(Archive &ar, reshadefx::technique_info &info)
+{
+	ar(info.name);
+	ar(info.passes);
+	ar(info.annotations);
+}
+template <typename Archive>
+static void transfer(Archive &ar, reshadefx::module &module)
+{
+	ar(module.hlsl);
+	ar(module.spirv);
+	ar(module.entry_points);
+	ar(module.textures);
+	ar(module.samplers);
+	ar(module.storages);
+	ar(module.uniforms);
+	ar(module.spec_constants);
+	ar(module.techniques);
+	ar(module.total_uniform_size);
+	ar(module.num_texture_bindings);
+	ar(module.num_sampler_bindings);
+	ar(module.num_storage_bindings);
+}
+
+class module_writer
+{
+public:
+	explicit module_writer(std::string &data) : _data(data) {}
+
+	template <typename T>
+	void operator()(const T &value)
+	{
+		if constexpr (std::is_arithmetic_v<T> || std::is_enum_v<T>)
+			_data.append(reinterpret_cast<const char *>(&value), sizeof(value));
+		else if constexpr (std::is_array_v<T>)
+			for (const auto &element : value)
+				operator()(element);
+		else
+			transfer(*this, const_cast<T &>(value));
+	}
+	template <typename T>
+	void operator()(const std::vector<T> &value)
+	{
+		operator()(static_cast<uint32_t>(value.size()));
+		if constexpr (std::is_arithmetic_v<T>)
+			_data.append(reinterpret_cast<const char *>(value.data()), value.size() * sizeof(T));
+		else
+			for (const T &element : value)
+				operator()(element);
+	}
+	void operator()(const std::string &value)
+	{
+		operator()(static_cast<uint32_t>(value.size()));
+		_data.append(value);
+	}
+
+private:
+	std::string &_data;
+};
+
+class module_reader
+{
+public:
+	explicit module_reader(std::string_view data) : _cur(data.data()), _end(data.data() + data.size()) {}
+
+	bool failed() const { return _failed; }
+	bool at_end() const { return _cur == _end; }
+
+	template <typename T>
+	void operator()(T &value)
+	{
+		if constexpr (std::is_arithmetic_v<T> || std::is_enum_v<T>)
+			read(&value, sizeof(value));
+		else if constexpr (std::is_array_v<T>)
+			for (auto &element : value)
+				operator()(element);
+		else
+			transfer(*this, value);
+	}
+	template <typename T>
+	void operator()(std::vector<T> &value)
+	{
+		uint32_t size = 0;
+		operator()(size);
+		// Every element takes up at least one byte, so this catches corrupted sizes before attempting to allocate memory for them
+		if (size > static_cast<size_t>(_end - _cur))
+			_failed = true;
+		if (_failed)
+			return;
+
+		value.resize(size);
+		if constexpr (std::is_arithmetic_v<T>)
+			read(value.data(), size * sizeof(T));
+		else
+			for (T &element : value)
+				operator()(element);
+	}
+	void operator()(std::string &value)
+	{
+		uint32_t size = 0;
+		operator()(size);
+		if (size > static_cast<size_t>(_end - _cur))
+			_failed = true;
+		if (_failed)
+			return;
+
+		value.assign(_cur, size);
+		_cur += size;
+	}
+
+private:
+	void read(void *data, size_t size)
+	{
+		if (_failed || size > static_cast<size_t>(_end - _cur))
+		{
+			_failed = true;
+			std::memset(data, 0, size);
+			return;
+		}
+
+		std::memcpy(data, _cur, size);
+		_cur += size;
+	}
+
+	const char *_cur, *_end;
+	bool _failed = false;
+};
+
+void reshadefx::serialize_module(const module &module, std::string &data)
+{
+	data.append(s_module_format_magic, sizeof(s_module_format_magic));
+
+	module_writer writer(data);
+	writer(s_module_format_version);
+	writer(module);
+}
+
+bool reshadefx::deserialize_module(std::string_view data, module &module)
+{
+	if (data.size() < sizeof(s_module_format_magic) || std::memcmp(data.data(), s_module_format_magic, sizeof(s_module_format_magic)) != 0)
+		return false;
+
+	module_reader reader(data.substr(sizeof(s_module_format_magic)));
+
+	uint32_t version = 0;
+	reader(version);
+	if (version != s_module_format_version)
+		return false;
+
+	reshadefx::module result;
+	reader(result);
+	if (reader.failed() || !reader.at_end())
+		return false;
+
+	module = std::move(result);
+	return true;
+}
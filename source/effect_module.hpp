@@ -316,6 +316,9 @@ namespace reshadefx
 	/// </summary>
 	struct module
 	{
+		/// <summary>
+		/// Generated HLSL or GLSL code. Code that only some entry points depend on is enclosed in conditional blocks, so an "ENTRY_POINT_" macro followed by the entry point name has to be defined when compiling one.
+		/// </summary>
 		std::string hlsl;
 		std::vector<uint32_t> spirv;
 
@@ -331,4 +334,18 @@ namespace reshadefx
 		uint32_t num_sampler_bindings = 0;
 		uint32_t num_storage_bindings = 0;
 	};
+
+	/// <summary>
+	/// Appends a compact binary representation of the module to the specified data, which can be stored in a cache and read back with <see cref="deserialize_module"/> instead of compiling the effect again.
+	/// </summary>
+	/// <param name="module">Module to serialize.</param>
+	/// <param name="data">String that the binary data is appended to.</param>
+	void serialize_module(const module &module, std::string &data);
+	/// <summary>
+	/// Reads a module from the binary representation created by <see cref="serialize_module"/>.
+	/// </summary>
+	/// <param name="data">Binary data to read.</param>
+	/// <param name="module">Module that is overwritten with the result.</param>
+	/// <returns><see langword="true"/> if the data was valid and written by a compatible version, <see langword="false"/> otherwise (in which case the module is not modified).</returns>
+	bool deserialize_module(std::string_view data, module &module);
 }
@@ -26,7 +26,15 @@ namespace reshadefx
 		/// <param name="source">String to analyze.</param>
 		/// <param name="backend">Code generation implementation to use.</param>
 		/// <returns><see langword="true"/> if parsing was successfull, <see langword="false"/> otherwise.</returns>
-		bool parse(std::string source, class codegen *backend);
+		bool parse(std::string source, class codegen *backend) { return parse(std::move(source), std::vector<token>(), backend); }
+		/// <summary>
+		/// Parses the provided input string, using the specified list of tokens instead of lexing it again.
+		/// </summary>
+		/// <param name="source">String to analyze.</param>
+		/// <param name="tokens">Tokens of the input string, terminated by an end of file token (see <see cref="preprocessor::output_tokens"/>). The input string is lexed instead if this is empty.</param>
+		/// <param name="backend">Code generation implementation to use.</param>
+		/// <returns><see langword="true"/> if parsing was successfull, <see langword="false"/> otherwise.</returns>
+		bool parse(std::string source, std::vector<token> tokens, class codegen *backend);
 
 		/// <summary>
 		/// Gets the list of error messages.
@@ -79,7 +87,12 @@ namespace reshadefx
 		std::string _errors;
 		token _token, _token_next, _token_backup;
 		std::unique_ptr<class lexer> _lexer;
+		// This is an index into the token list instead of an offset into the input string when parsing from a token list
 		size_t _lexer_backup_offset = 0;
+		location _lexer_backup_location;
+		std::vector<token> _tokens;
+		std::vector<size_t> _token_source_indices;
+		size_t _next_token_index = 0;
 		std::vector<uint32_t> _loop_break_target_stack;
 		std::vector<uint32_t> _loop_continue_target_stack;
 		reshadefx::function_info *_current_function = nullptr;
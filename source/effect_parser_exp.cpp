@@ -7,6 +7,7 @@
 #include "effect_parser.hpp"
 #include "effect_codegen.hpp"
 #include <cassert>
+#include <algorithm> // std::upper_bound
 
 reshadefx::parser::parser()
 {
@@ -35,18 +36,38 @@ void reshadefx::parser::warning(const location &location, unsigned int code, con
 void reshadefx::parser::backup()
 {
 	_token_backup = _token_next;
-	_lexer_backup_offset = _lexer->input_offset();
+	_lexer_backup_offset = _tokens.empty() ? _lexer->input_offset() : _next_token_index;
+	// Restore the lexer location together with its offset, so that tokens lexed again get the same locations as when lexing from a token list
+	if (_tokens.empty())
+		_lexer_backup_location = _lexer->input_location();
 }
 void reshadefx::parser::restore()
 {
-	_lexer->reset_to_offset(_lexer_backup_offset);
+	if (_tokens.empty())
+		_lexer->reset_to_offset(_lexer_backup_offset, _lexer_backup_location);
+	else
+		_next_token_index = _lexer_backup_offset;
 	_token_next = _token_backup; // Copy instead of move here, since restore may be called twice (from 'accept_type_class' and then again from 'parse_expression_unary')
 }
 
 void reshadefx::parser::consume()
 {
 	_token = std::move(_token_next);
-	_token_next = _lexer->lex();
+	if (_tokens.empty())
+	{
+		_token_next = _lexer->lex();
+	}
+	else
+	{
+		// Keep returning the end of file token once it was reached, like the lexer does
+		const size_t index = _next_token_index < _tokens.size() - 1 ? _next_token_index++ : _next_token_index;
+		_token_next = _tokens[index];
+
+		// Only the first token after the source file name changed has it set, so look it up for the others
+		if (_token_next.location.source.empty())
+			if (const auto it = std::upper_bound(_token_source_indices.begin(), _token_source_indices.end(), index); it != _token_source_indices.begin())
+				_token_next.location.source = _tokens[*std::prev(it)].location.source;
+	}
 }
 void reshadefx::parser::consume_until(tokenid tokid)
 {
@@ -90,14 +111,15 @@ bool reshadefx::parser::accept_symbol(std::string &identifier, scoped_symbol &sy
 		return false;
 	}
 
-	identifier = std::move(_token.literal_as_string);
+	identifier = _token.literal_as_string;
 
 	// Can concatenate multiple '::' to force symbol search for a specific namespace level
 	while (accept(tokenid::colon_colon))
 	{
 		if (!expect(tokenid::identifier))
 			return false;
-		identifier += "::" + std::move(_token.literal_as_string);
+		identifier += "::";
+		identifier += _token.literal_as_string;
 	}
 
 	// Figure out which scope to start searching in
@@ -670,7 +692,7 @@ bool reshadefx::parser::parse_expression_unary(expression &exp)
 	}
 	else if (accept(tokenid::string_literal))
 	{
-		std::string value = std::move(_token.literal_as_string);
+		std::string value(_token.literal_as_string);
 
 		// Multiple string literals in sequence are concatenated into a single string literal
 		while (accept(tokenid::string_literal))
@@ -991,7 +1013,7 @@ bool reshadefx::parser::parse_expression_unary(expression &exp)
 				return false;
 
 			location = std::move(_token.location);
-			const auto subscript = std::move(_token.literal_as_string);
+			const std::string subscript(_token.literal_as_string);
 
 			if (accept('(')) // Methods (function calls on types) are not supported right now
 			{
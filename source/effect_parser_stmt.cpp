@@ -17,10 +17,35 @@ struct on_scope_exit
 	std::function<void()> leave;
 };
 
-bool reshadefx::parser::parse(std::string input, codegen *backend)
+bool reshadefx::parser::parse(std::string input, std::vector<token> tokens, codegen *backend)
 {
 	_lexer.reset(new lexer(std::move(input)));
 
+	// Fill in the information that depends on the lexer settings of the parser
+	const std::string_view source = _lexer->input_string();
+	_token_source_indices.clear();
+	for (token &tok : tokens)
+	{
+		if (!tok.location.source.empty())
+			_token_source_indices.push_back(&tok - tokens.data());
+
+		if (tok == tokenid::identifier)
+		{
+			tok.literal_as_string = source.substr(tok.offset, tok.length);
+			tok.id = lexer::find_keyword(tok.literal_as_string);
+		}
+		else if (tok == tokenid::string_literal)
+		{
+			// String literals may contain escape sequences, so lex them again to have the lexer store the escaped contents
+			_lexer->reset_to_offset(tok.offset);
+			tok.literal_as_string = _lexer->lex().literal_as_string;
+		}
+	}
+
+	assert(tokens.empty() || tokens.back() == tokenid::end_of_file);
+	_tokens = std::move(tokens);
+	_next_token_index = 0;
+
 	// Set backend for subsequent code-generation
 	_codegen = backend;
 
@@ -49,7 +74,7 @@ void reshadefx::parser::parse_top(bool &parse_success)
 			return;
 		}
 
-		const auto name = std::move(_token.literal_as_string);
+		const std::string name(_token.literal_as_string);
 
 		if (!expect('{'))
 		{
@@ -93,7 +118,7 @@ void reshadefx::parser::parse_top(bool &parse_success)
 
 			if (peek('('))
 			{
-				const auto name = std::move(_token.literal_as_string);
+				const std::string name(_token.literal_as_string);
 				// This is definitely a function declaration, so parse it
 				if (!parse_function(type, name))
 				{
@@ -113,7 +138,7 @@ void reshadefx::parser::parse_top(bool &parse_success)
 						parse_success = false;
 						return;
 					}
-					const auto name = std::move(_token.literal_as_string);
+					const std::string name(_token.literal_as_string);
 					if (!parse_variable(type, name, true))
 					{
 						// Insert dummy variable into symbol table, so later references can be resolved despite the error
@@ -167,7 +192,7 @@ bool reshadefx::parser::parse_statement(bool scoped)
 			switch_call = (0x8 << 4)
 		};
 
-		const auto attribute = std::move(_token_next.literal_as_string);
+		const std::string attribute(_token_next.literal_as_string);
 
 		if (!expect(tokenid::identifier) || !expect(']'))
 			return false;
@@ -391,7 +416,7 @@ bool reshadefx::parser::parse_statement(bool scoped)
 				do { // There may be multiple declarations behind a type, so loop through them
 					if (count++ > 0 && !expect(','))
 						return false;
-					if (!expect(tokenid::identifier) || !parse_variable(type, std::move(_token.literal_as_string)))
+					if (!expect(tokenid::identifier) || !parse_variable(type, std::string(_token.literal_as_string)))
 						return false;
 				} while (!peek(';'));
 			}
@@ -713,7 +738,7 @@ bool reshadefx::parser::parse_statement(bool scoped)
 			if (count++ > 0 && !expect(','))
 				// Try to consume the rest of the declaration so that parsing may continue despite the error
 				return consume_until(';'), false;
-			if (!expect(tokenid::identifier) || !parse_variable(type, std::move(_token.literal_as_string)))
+			if (!expect(tokenid::identifier) || !parse_variable(type, std::string(_token.literal_as_string)))
 				return consume_until(';'), false;
 		} while (!peek(';'));
 
@@ -843,7 +868,7 @@ bool reshadefx::parser::parse_annotations(std::vector<annotation> &annotations)
 		if (!expect(tokenid::identifier))
 			return consume_until('>'), false;
 
-		auto name = std::move(_token.literal_as_string);
+		std::string name(_token.literal_as_string);
 
 		if (expression expression; !expect('=') || !parse_expression_multary(expression) || !expect(';'))
 			return consume_until('>'), false;
@@ -864,7 +889,7 @@ bool reshadefx::parser::parse_struct()
 	struct_info info;
 	// The structure name is optional
 	if (accept(tokenid::identifier))
-		info.name = std::move(_token.literal_as_string);
+		info.name = _token.literal_as_string;
 	else
 		info.name = "_anonymous_struct_" + std::to_string(location.line) + '_' + std::to_string(location.column);
 
@@ -891,7 +916,7 @@ bool reshadefx::parser::parse_struct()
 			if (!expect(tokenid::identifier))
 				return consume_until('}'), accept(';'), false;
 
-			member.name = std::move(_token.literal_as_string);
+			member.name = _token.literal_as_string;
 			member.location = std::move(_token.location);
 
 			if (member.type.is_void())
@@ -933,7 +958,7 @@ bool reshadefx::parser::parse_struct()
 				if (!expect(tokenid::identifier))
 					return consume_until('}'), accept(';'), false;
 
-				member.semantic = std::move(_token.literal_as_string);
+				member.semantic = _token.literal_as_string;
 				// Make semantic upper case to simplify comparison later on
 				std::transform(member.semantic.begin(), member.semantic.end(), member.semantic.begin(), [](char c) { return static_cast<char>(toupper(c)); });
 
@@ -1032,7 +1057,7 @@ bool reshadefx::parser::parse_function(type type, std::string name)
 			break;
 		}
 
-		param.name = std::move(_token.literal_as_string);
+		param.name = _token.literal_as_string;
 		param.location = std::move(_token.location);
 
 		if (param.type.is_void())
@@ -1082,7 +1107,7 @@ bool reshadefx::parser::parse_function(type type, std::string name)
 				break;
 			}
 
-			param.semantic = std::move(_token.literal_as_string);
+			param.semantic = _token.literal_as_string;
 			// Make semantic upper case to simplify comparison later on
 			std::transform(param.semantic.begin(), param.semantic.end(), param.semantic.begin(), [](char c) { return static_cast<char>(toupper(c)); });
 
@@ -1114,7 +1139,7 @@ bool reshadefx::parser::parse_function(type type, std::string name)
 		if (type.is_void())
 			return error(_token.location, 3076, '\'' + name + "': void function cannot have a semantic"), false;
 
-		info.return_semantic = std::move(_token.literal_as_string);
+		info.return_semantic = _token.literal_as_string;
 		// Make semantic upper case to simplify comparison later on
 		std::transform(info.return_semantic.begin(), info.return_semantic.end(), info.return_semantic.begin(), [](char c) { return static_cast<char>(toupper(c)); });
 	}
@@ -1221,7 +1246,7 @@ bool reshadefx::parser::parse_variable(type type, std::string name, bool global)
 			return error(_token.location, 3043, '\'' + name + "': local variables cannot have semantics"), false;
 
 		std::string &semantic = texture_info.semantic;
-		semantic = std::move(_token.literal_as_string);
+		semantic = _token.literal_as_string;
 
 		// Make semantic upper case to simplify comparison later on
 		std::transform(semantic.begin(), semantic.end(), semantic.begin(), [](char c) { return static_cast<char>(toupper(c)); });
@@ -1281,7 +1306,7 @@ bool reshadefx::parser::parse_variable(type type, std::string name, bool global)
 				if (!expect(tokenid::identifier))
 					return consume_until('}'), false;
 
-				const auto property_name = std::move(_token.literal_as_string);
+				const std::string property_name(_token.literal_as_string);
 				const auto property_location = std::move(_token.location);
 
 				if (!expect('='))
@@ -1294,7 +1319,8 @@ bool reshadefx::parser::parse_variable(type type, std::string name, bool global)
 				if (accept(tokenid::identifier)) // Handle special enumeration names for property values
 				{
 					// Transform identifier to uppercase to do case-insensitive comparison
-					std::transform(_token.literal_as_string.begin(), _token.literal_as_string.end(), _token.literal_as_string.begin(), [](char c) { return static_cast<char>(toupper(c)); });
+					std::string identifier(_token.literal_as_string);
+					std::transform(identifier.begin(), identifier.end(), identifier.begin(), [](char c) { return static_cast<char>(toupper(c)); });
 
 					static const std::unordered_map<std::string, uint32_t> s_values = {
 						{ "NONE", 0 }, { "POINT", 0 },
@@ -1319,7 +1345,7 @@ bool reshadefx::parser::parse_variable(type type, std::string name, bool global)
 					};
 
 					// Look up identifier in list of possible enumeration names
-					if (const auto it = s_values.find(_token.literal_as_string);
+					if (const auto it = s_values.find(identifier);
 						it != s_values.end())
 						expression.reset_to_rvalue_constant(_token.location, it->second);
 					else // No match found, so rewind to parser state before the identifier was consumed and try parsing it as a normal expression
@@ -1507,7 +1533,7 @@ bool reshadefx::parser::parse_technique()
 		return false;
 
 	technique_info info;
-	info.name = std::move(_token.literal_as_string);
+	info.name = _token.literal_as_string;
 
 	bool parse_success = parse_annotations(info.annotations);
 
@@ -1538,7 +1564,7 @@ bool reshadefx::parser::parse_technique_pass(pass_info &info)
 
 	// Passes can have an optional name
 	if (accept(tokenid::identifier))
-		info.name = std::move(_token.literal_as_string);
+		info.name = _token.literal_as_string;
 
 	bool parse_success = true;
 	bool targets_support_srgb = true;
@@ -1554,7 +1580,7 @@ bool reshadefx::parser::parse_technique_pass(pass_info &info)
 			return consume_until('}'), false;
 
 		auto location = std::move(_token.location);
-		const auto state = std::move(_token.literal_as_string);
+		const std::string state(_token.literal_as_string);
 
 		if (!expect('='))
 			return consume_until('}'), false;
@@ -1683,7 +1709,8 @@ bool reshadefx::parser::parse_technique_pass(pass_info &info)
 			if (accept(tokenid::identifier)) // Handle special enumeration names for pass states
 			{
 				// Transform identifier to uppercase to do case-insensitive comparison
-				std::transform(_token.literal_as_string.begin(), _token.literal_as_string.end(), _token.literal_as_string.begin(), [](char c) { return static_cast<char>(toupper(c)); });
+				std::string identifier(_token.literal_as_string);
+				std::transform(identifier.begin(), identifier.end(), identifier.begin(), [](char c) { return static_cast<char>(toupper(c)); });
 
 				static const std::unordered_map<std::string, uint32_t> s_enum_values = {
 					{ "NONE", 0 }, { "ZERO", 0 }, { "ONE", 1 },
@@ -1726,7 +1753,7 @@ bool reshadefx::parser::parse_technique_pass(pass_info &info)
 				};
 
 				// Look up identifier in list of possible enumeration names
-				if (const auto it = s_enum_values.find(_token.literal_as_string);
+				if (const auto it = s_enum_values.find(identifier);
 					it != s_enum_values.end())
 					expression.reset_to_rvalue_constant(_token.location, it->second);
 				else // No match found, so rewind to parser state before the identifier was consumed and try parsing it as a normal expression
@@ -6,6 +6,7 @@
 #include "effect_lexer.hpp"
 #include "effect_preprocessor.hpp"
 #include <cassert>
+#include <mutex> // std::unique_lock
 #include <algorithm> // std::find_if
 
 #ifndef _WIN32
@@ -96,6 +97,76 @@ static bool read_file(const std::filesystem::path &path, std::string &data)
 	return true;
 }
 
+static bool fold_file_name_case(std::string &name)
+{
+	for (char &c : name)
+	{
+		if (static_cast<unsigned char>(c) >= 0x80)
+			return false;
+		if (c >= 'A' && c <= 'Z')
+			c += 'a' - 'A';
+	}
+	return true;
+}
+
+static std::string find_include_guard(const std::vector<reshadefx::token> &tokens)
+{
+	using reshadefx::tokenid;
+
+	size_t index = 0;
+	const auto skip_space = [&tokens, &index](bool skip_new_lines) {
+		while (tokens[index] == tokenid::space || (skip_new_lines && tokens[index] == tokenid::end_of_line))
+			index++;
+	};
+
+	// Look for a file that starts with '#ifndef NAME' followed by '#define NAME'
+	skip_space(true);
+	if (tokens[index++] != tokenid::hash_ifndef)
+		return std::string();
+	skip_space(false);
+	if (tokens[index] != tokenid::identifier)
+		return std::string();
+	const std::string_view guard = tokens[index++].literal_as_string;
+	skip_space(false);
+	if (tokens[index++] != tokenid::end_of_line)
+		return std::string();
+	skip_space(true);
+	if (tokens[index++] != tokenid::hash_def)
+		return std::string();
+	skip_space(false);
+	if (tokens[index] != tokenid::identifier || tokens[index].literal_as_string != guard)
+		return std::string();
+
+	// Ensure that the matching '#endif' is the last thing in the file and there is no '#else' or '#elif' for the outermost block
+	for (size_t level = 1; tokens[index] != tokenid::end_of_file; ++index)
+	{
+		switch (tokens[index])
+		{
+		case tokenid::hash_if:
+		case tokenid::hash_ifdef:
+		case tokenid::hash_ifndef:
+			level++;
+			break;
+		case tokenid::hash_else:
+		case tokenid::hash_elif:
+			if (level == 1)
+				return std::string();
+			break;
+		case tokenid::hash_endif:
+			if (--level == 0)
+			{
+				for (++index; tokens[index] != tokenid::end_of_file; ++index)
+					if (tokens[index] != tokenid::space && tokens[index] != tokenid::end_of_line)
+						return std::string();
+				return std::string(guard);
+			}
+			break;
+		}
+	}
+
+	return std::string();
+}
+
 static std::string escape_string(std::string s)
 {
 	for (size_t offset = 0; (offset = s.find('\\', offset)) != std::string::npos; offset += 2)
@@ -103,8 +174,188 @@ static std::string escape_string(std::string s)
 	return '\"' + s + '\"';
 }
 
-reshadefx::preprocessor::preprocessor()
+static bool tokens_merge_without_space(std::string_view prev, std::string_view next)
+{
+	const auto is_digit = [](char c) { return c >= '0' && c <= '9'; };
+	const auto is_word = [&](char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || is_digit(c); };
+
+	const char a = prev.back(), b = next.front();
+
+	// Identifiers and numbers continue into each other, numbers also into a following decimal point
+	if ((is_word(a) && is_word(b)) || (a == '.' && is_digit(b)) || (b == '.' && (is_digit(prev.front()) || prev.front() == '.')))
+		return true;
+
+	// Operators can combine into a longer operator or start a comment
+	switch (a)
+	{
+	case '&':
+	case '|':
+	case '+':
+	case '-':
+	case '.':
+	case ':':
+	case '<':
+	case '>':
+		return b == a || b == '=' || (a == '-' && b == '>');
+	case '/':
+		return b == '/' || b == '*' || b == '=';
+	case '!':
+	case '%':
+	case '*':
+	case '=':
+	case '^':
+		return b == '=';
+	default:
+		return false;
+	}
+}
+
+bool reshadefx::include_cache::file_exists(const std::filesystem::path &path)
+{
+	const std::string path_string = path.u8string();
+
+	{	const std::shared_lock<std::shared_mutex> lock(_mutex);
+
+		if (const auto it = _exists_cache.find(path_string);
+			it != _exists_cache.end())
+			return it->second;
+	}
+
+	bool exists = false, listed = false;
+	{	const std::shared_lock<std::shared_mutex> lock(_mutex);
+
+		if (const auto it = _directory_cache.find(path.parent_path().u8string());
+			it != _directory_cache.end())
+		{
+			std::string file_name = path.filename().u8string();
+			listed = fold_file_name_case(file_name);
+			exists = it->second.find(file_name) != it->second.end();
+		}
+	}
+
+	if (!exists && !listed)
+	{
+		std::error_code ec;
+		exists = std::filesystem::exists(path, ec);
+	}
+
+	const std::unique_lock<std::shared_mutex> lock(_mutex);
+	_exists_cache.emplace(path_string, exists);
+
+	return exists;
+}
+
+bool reshadefx::include_cache::read_file(const std::filesystem::path &path, file &file)
+{
+	const std::string path_string = path.u8string();
+
+	std::error_code ec;
+	const std::filesystem::file_time_type last_write_time = std::filesystem::last_write_time(path, ec);
+	if (ec)
+		return false;
+
+	{	const std::shared_lock<std::shared_mutex> lock(_mutex);
+
+		// Only use the cached contents if the file was not modified since it was read
+		if (const auto it = _file_cache.find(path_string);
+			it != _file_cache.end() && it->second.last_write_time == last_write_time)
+		{
+			file = it->second;
+			return true;
+		}
+	}
+
+	std::string file_data;
+	if (!::read_file(path, file_data))
+		return false;
+
+	include_cache::file entry;
+	entry.hash = std::hash<std::string_view>()(file_data);
+	entry.data = std::make_shared<const std::string>(std::move(file_data));
+	entry.last_write_time = last_write_time;
+
+	// Run the lexer over the file once with the same settings the preprocessor uses, so that the resulting tokens can be replayed on every include
+	// The lexer is kept alive together with the tokens, since their literals may reference storage owned by it
+	struct token_stream
+	{
+		reshadefx::lexer lexer;
+		std::vector<token> tokens;
+	};
+
+	const auto stream = std::make_shared<token_stream>(token_stream { lexer(entry.data,
+		true  /* ignore_comments */,
+		false /* ignore_whitespace */,
+		false /* ignore_pp_directives */,
+		false /* ignore_line_directives */,
+		true  /* ignore_keywords */,
+		false /* escape_string_literals */,
+		location(path_string, 1)) });
+	do
+		stream->tokens.push_back(stream->lexer.lex());
+	while (stream->tokens.back() != tokenid::end_of_file);
+
+	entry.include_guard = find_include_guard(stream->tokens);
+	entry.tokens = std::shared_ptr<const std::vector<token>>(stream, &stream->tokens);
+
+	file = entry;
+
+	const std::unique_lock<std::shared_mutex> lock(_mutex);
+	_file_cache[path_string] = std::move(entry);
+	// A file that could be read exists, so update that cache too
+	_exists_cache[path_string] = true;
+
+	return true;
+}
+
+void reshadefx::include_cache::add_directory_listing(const std::filesystem::path &directory, const std::vector<std::filesystem::path> &file_names)
 {
+	std::unordered_set<std::string> listing;
+	listing.reserve(file_names.size());
+	for (const std::filesystem::path &file_name : file_names)
+	{
+		std::string name = file_name.u8string();
+		fold_file_name_case(name);
+		listing.insert(std::move(name));
+	}
+
+	const std::unique_lock<std::shared_mutex> lock(_mutex);
+	_directory_cache[directory.u8string()] = std::move(listing);
+}
+
+void reshadefx::include_cache::invalidate_file_lookups()
+{
+	const std::unique_lock<std::shared_mutex> lock(_mutex);
+
+	_exists_cache.clear();
+	_directory_cache.clear();
+}
+
+reshadefx::preprocessor::preprocessor(std::shared_ptr<include_cache> cache) :
+	_macros(std::make_shared<std::unordered_map<std::string, macro>>()),
+	_include_cache(std::move(cache))
+{
+	// Fall back to a private cache if none is shared with other preprocessor instances
+	if (_include_cache == nullptr)
+		_include_cache = std::make_shared<include_cache>();
+}
+reshadefx::preprocessor::preprocessor(const preprocessor &base) :
+	_success(base._success),
+	_output(base._output),
+	_errors(base._errors),
+	_output_tokens_enabled(base._output_tokens_enabled),
+	_output_tokens(base._output_tokens),
+	_output_tokens_source(base._output_tokens_source),
+	_output_location(base._output_location),
+	_used_macros(base._used_macros),
+	_referenced_macros(base._referenced_macros),
+	_macros(base._macros),
+	_include_paths(base._include_paths),
+	_include_cache(base._include_cache),
+	_file_cache(base._file_cache),
+	_missing_include_files(base._missing_include_files),
+	_used_pragmas(base._used_pragmas)
+{
+	assert(base._input_stack.empty() && base._if_stack.empty());
 }
 reshadefx::preprocessor::~preprocessor()
 {
@@ -118,19 +369,36 @@ void reshadefx::preprocessor::add_include_path(const std::filesystem::path &path
 bool reshadefx::preprocessor::add_macro_definition(const std::string &name, const macro &macro)
 {
 	assert(!name.empty());
-	return _macros.emplace(name, macro).second;
+	// Avoid copying a shared macro table if this would fail anyway
+	if (_macros->find(name) != _macros->end())
+		return false;
+	return modify_macros().emplace(name, macro).second;
+}
+std::unordered_map<std::string, reshadefx::preprocessor::macro> &reshadefx::preprocessor::modify_macros()
+{
+	// Copy the macro table before the first modification if it is still shared with another preprocessor instance
+	if (_macros.use_count() > 1)
+		_macros = std::make_shared<std::unordered_map<std::string, macro>>(*_macros);
+	return *_macros;
 }
 
 bool reshadefx::preprocessor::append_file(const std::filesystem::path &path)
 {
-	std::string data;
-	if (!read_file(path, data))
+	const std::string path_string = path.u8string();
+
+	// Read the file through the include cache as well, so that its contents are only read once and the reported hash matches the data that was actually parsed
+	include_cache::file file;
+	if (!_include_cache->read_file(path, file))
 		return false;
 
+	_file_cache[path_string] = file;
+
 	_success = true; // Clear success flag before parsing a new file
 
-	push(std::move(data), path.u8string());
+	push(file, path_string);
 	parse();
+	_input_stack.clear();
+	_hidden_macros.clear();
 
 	return _success;
 }
@@ -146,6 +414,8 @@ bool reshadefx::preprocessor::append_string(std::string source_code, const std::
 	// But without a name, the lexer location is set to the last token location, which most likely will not be at the start of the line
 	push(std::move(source_code), path.empty() ? "unknown" : path.u8string());
 	parse();
+	_input_stack.clear();
+	_hidden_macros.clear();
 
 	return _success;
 }
@@ -163,21 +433,21 @@ std::vector<std::pair<std::string, std::string>> reshadefx::preprocessor::used_m
 	std::vector<std::pair<std::string, std::string>> defines;
 	defines.reserve(_used_macros.size());
 	for (const std::string &name : _used_macros)
-		if (const auto it = _macros.find(name);
+		if (const auto it = _macros->find(name);
 			// Do not include function-like macros, since they are more likely to contain a complex replacement list
-			it != _macros.end() && !it->second.is_function_like)
+			it != _macros->end() && !it->second.is_function_like)
 			defines.push_back({ name, it->second.replacement_list });
 	return defines;
 }
 
 void reshadefx::preprocessor::error(const location &location, const std::string &message)
 {
-	_errors += location.source + '(' + std::to_string(location.line) + ", " + std::to_string(location.column) + ')' + ": preprocessor error: " + message + '\n';
+	_errors += location.source.str() + '(' + std::to_string(location.line) + ", " + std::to_string(location.column) + ')' + ": preprocessor error: " + message + '\n';
 	_success = false; // Unset success flag
 }
 void reshadefx::preprocessor::warning(const location &location, const std::string &message)
 {
-	_errors += location.source + '(' + std::to_string(location.line) + ", " + std::to_string(location.column) + ')' + ": preprocessor warning: " + message + '\n';
+	_errors += location.source.str() + '(' + std::to_string(location.line) + ", " + std::to_string(location.column) + ')' + ": preprocessor warning: " + message + '\n';
 }
 
 void reshadefx::preprocessor::push(std::string input, const std::string &name)
@@ -201,6 +471,20 @@ void reshadefx::preprocessor::push(std::string input, const std::string &name)
 	level.next_token.id = tokenid::unknown;
 	level.next_token.location = start_location; // This is used in 'consume' to initialize the output location
 
+	push(std::move(level));
+}
+void reshadefx::preprocessor::push(const include_cache::file &file, const std::string &name)
+{
+	input_level level = { name };
+	level.cached_input = file.data;
+	level.cached_tokens = file.tokens;
+	level.next_token.id = tokenid::unknown;
+	level.next_token.location = location(name, 1);
+
+	push(std::move(level));
+}
+void reshadefx::preprocessor::push(input_level &&level)
+{
 	// Inherit hidden macros from parent
 	if (!_input_stack.empty())
 		level.hidden_macros = _input_stack.back().hidden_macros;
@@ -212,6 +496,11 @@ void reshadefx::preprocessor::push(std::string input, const std::string &name)
 	consume();
 }
 
+std::string_view reshadefx::preprocessor::input_string(const input_level &input) const
+{
+	return input.cached_tokens != nullptr ? *input.cached_input : input.lexer->input_string();
+}
+
 bool reshadefx::preprocessor::peek(tokenid token) const
 {
 	return _input_stack[_next_input_index].next_token == token;
@@ -230,10 +519,12 @@ bool reshadefx::preprocessor::consume()
 	// Clear out input stack, now that the current token is overwritten
 	while (_input_stack.size() > (_current_input_index + 1))
 		_input_stack.pop_back();
+	// Hidden macros are only ever added to the top of the stack, so anything past the chain of the new top is no longer referenced
+	_hidden_macros.resize(_input_stack.back().hidden_macros);
 
 	// Update location information after switching input levels
 	input_level &input = _input_stack[_current_input_index];
-	if (!input.name.empty() && input.name != _output_location.source)
+	if (!input.name.empty() && input.name != _output_location.source.str())
 	{
 		_output += "#line " + std::to_string(input.next_token.location.line) + " \"" + input.name + "\"\n";
 		_output_location.line = input.next_token.location.line;
@@ -242,10 +533,13 @@ bool reshadefx::preprocessor::consume()
 
 	// Set current token
 	_token = std::move(input.next_token);
-	_current_token_raw_data = input.lexer->input_string().substr(_token.offset, _token.length);
+	_current_token_raw_data = input_string(input).substr(_token.offset, _token.length);
 
-	// Get the next token
-	input.next_token = input.lexer->lex();
+	// Get the next token (either by replaying cached tokens or by running the lexer)
+	if (input.cached_tokens != nullptr)
+		input.next_token = (*input.cached_tokens)[std::min(input.next_cached_token++, input.cached_tokens->size() - 1)];
+	else
+		input.next_token = input.lexer->lex();
 
 	// Verify string literals (since the lexer cannot throw errors itself)
 	if (_token == tokenid::string_literal && _current_token_raw_data.back() != '\"')
@@ -262,7 +556,7 @@ bool reshadefx::preprocessor::consume()
 		if (_next_input_index == 0)
 		{
 			// End of input has been reached, so cannot pop further and this is the last token
-			_input_stack.pop_back();
+			// The input level is kept alive until parsing finished, since the current token still references its input string
 			return false;
 		}
 		else
@@ -307,7 +601,7 @@ bool reshadefx::preprocessor::expect(tokenid token)
 			error(actual_token.location, "syntax error: unexpected new line");
 		else
 			error(actual_token.location, "syntax error: unexpected token '" +
-				_input_stack[_next_input_index].lexer->input_string().substr(actual_token.offset, actual_token.length) + '\'');
+				std::string(input_string(_input_stack[_next_input_index]).substr(actual_token.offset, actual_token.length)) + '\'');
 
 		return false;
 	}
@@ -319,8 +613,23 @@ void reshadefx::preprocessor::parse()
 {
 	std::string line;
 
-	while (consume())
+	// Continue the output token list from a previous call, with the end of file token appended again at the end
+	if (!_output_tokens.empty() && _output_tokens.back() == tokenid::end_of_file)
+		_output_tokens.pop_back();
+	size_t line_first_token = _output_tokens.size();
+	// Estimate the number of tokens from the input size, to avoid growing the list repeatedly
+	if (_output_tokens_enabled && !_input_stack.empty())
+		_output_tokens.reserve(_output_tokens.size() + input_string(_input_stack.back()).size() / 6);
+
+	while (true)
 	{
+		// Skip inactive lines before their first token is consumed, so that none of their tokens are verified
+		if (!_if_stack.empty() && _if_stack.back().skipping)
+			skip_inactive_lines();
+
+		if (!consume())
+			break;
+
 		_recursion_count = 0;
 
 		const bool skip = !_if_stack.empty() && _if_stack.back().skipping;
@@ -396,7 +705,7 @@ void reshadefx::preprocessor::parse()
 			parse_include();
 			continue;
 		case tokenid::hash_unknown:
-			error(_token.location, "unrecognized preprocessing directive '" + _token.literal_as_string + '\'');
+			error(_token.location, "unrecognized preprocessing directive '" + std::string(_token.literal_as_string) + '\'');
 			consume_until(tokenid::end_of_line);
 			continue;
 		case tokenid::end_of_line:
@@ -408,23 +717,102 @@ void reshadefx::preprocessor::parse()
 				_output += "#line " + std::to_string(_token.location.line) + '\n';
 				_output_location.line  = _token.location.line;
 			}
+			if (_output_tokens_enabled)
+				finish_output_tokens(line_first_token, _output_location.line);
 			_output += line;
 			_output += '\n';
 			line.clear();
+			line_first_token = _output_tokens.size();
 			continue;
 		case tokenid::identifier:
 			if (evaluate_identifier_as_macro())
 				continue;
 			[[fallthrough]];
 		default:
+			if (_output_tokens_enabled && _token != tokenid::space)
+				append_output_token(line, line_first_token);
 			line += _current_token_raw_data;
 			break;
 		}
 	}
 
 	// Append the last line after the EOF was reached to the output
+	if (_output_tokens_enabled)
+		finish_output_tokens(line_first_token, _output_location.line + 1);
 	_output += line;
 	_output += '\n';
+
+	if (_output_tokens_enabled)
+	{
+		token &tok = _output_tokens.emplace_back();
+		tok.id = tokenid::end_of_file;
+		tok.location = location(_output_location.source, _output_location.line + 2);
+		tok.offset = _output.size();
+		tok.length = 0;
+	}
+}
+
+void reshadefx::preprocessor::append_output_token(const std::string &line, size_t line_first_token)
+{
+	// The parser may treat a hash as the start of a directive, and tokens that are not separated by whitespace may be lexed differently from the output string, so fall back to parsing that in these cases
+	// The same goes for string literals with backslashes, since the preprocessor does not handle escape sequences and therefore ends them at an escaped quote
+	if (_current_token_raw_data.front() == '#' || (_token == tokenid::string_literal && _current_token_raw_data.find('\\') != std::string_view::npos) || (
+		line_first_token < _output_tokens.size() && _output_tokens.back().offset + _output_tokens.back().length == line.size() &&
+		tokens_merge_without_space(std::string_view(line).substr(_output_tokens.back().offset), _current_token_raw_data)))
+	{
+		_output_tokens_enabled = false;
+		_output_tokens.clear();
+		return;
+	}
+
+	// The location is assigned when the line is written to the output, so only copy the identifier and literal value
+	token &tok = _output_tokens.emplace_back();
+	tok.id = _token.id;
+	tok.literal_as_double = _token.literal_as_double;
+	// Offset is relative to the start of the current line until it is written to the output
+	tok.offset = line.size();
+	tok.length = _current_token_raw_data.size();
+}
+void reshadefx::preprocessor::finish_output_tokens(size_t line_first_token, uint32_t line)
+{
+	// Assign the locations the parser would see when lexing the output string, which is where the current line is appended next
+	for (size_t i = line_first_token; i < _output_tokens.size(); ++i)
+	{
+		token &tok = _output_tokens[i];
+		// Only store the source file name in the first token after it changed, instead of a copy in every token
+		if (_output_location.source != _output_tokens_source)
+			tok.location.source = _output_tokens_source = _output_location.source;
+		tok.location.line = line;
+		tok.location.column = static_cast<uint32_t>(tok.offset + 1);
+		tok.offset += _output.size();
+	}
+}
+
+void reshadefx::preprocessor::skip_inactive_lines()
+{
+	// Only the input level the conditional block is in can be skipped (macros are not expanded while skipping, so this is always a file)
+	if (_next_input_index != _current_input_index)
+		return;
+
+	input_level &input = _input_stack[_current_input_index];
+	if ((input.next_token >= tokenid::hash_def && input.next_token <= tokenid::hash_unknown) || input.next_token == tokenid::end_of_file)
+		return;
+
+	// Advance directly to the next directive, since all tokens before it are ignored anyway
+	if (input.cached_tokens != nullptr)
+	{
+		const std::vector<token> &tokens = *input.cached_tokens;
+		size_t index = input.next_cached_token;
+		while (index < tokens.size() - 1 && !(tokens[index] >= tokenid::hash_def && tokens[index] <= tokenid::hash_unknown))
+			index++;
+		input.next_token = tokens[index];
+		input.next_cached_token = index + 1;
+	}
+	else
+	{
+		input.lexer->skip_to_next_pp_directive();
+		input.next_token = input.lexer->lex();
+	}
 }
 
 void reshadefx::preprocessor::parse_def()
@@ -436,11 +824,11 @@ void reshadefx::preprocessor::parse_def()
 
 	macro m;
 	const auto location = std::move(_token.location);
-	const auto macro_name = std::move(_token.literal_as_string);
+	const std::string macro_name(_token.literal_as_string);
 	const auto macro_name_end_offset = _token.offset + _token.length;
 
 	// Check input string here directly to ensure the parenthesis follows the macro name without any whitespace between
-	if (_input_stack[_current_input_index].lexer->input_string()[macro_name_end_offset] == '(')
+	if (input_string(_input_stack[_current_input_index])[macro_name_end_offset] == '(')
 	{
 		accept(tokenid::parenthesis_open);
 
@@ -448,7 +836,7 @@ void reshadefx::preprocessor::parse_def()
 
 		while (accept(tokenid::identifier))
 		{
-			m.parameters.push_back(_token.literal_as_string);
+			m.parameters.emplace_back(_token.literal_as_string);
 
 			if (!accept(tokenid::comma))
 				break;
@@ -470,6 +858,9 @@ void reshadefx::preprocessor::parse_def()
 
 	create_macro_replacement_list(m);
 
+	// Whether this succeeds depends on the macro not having been defined before
+	_referenced_macros.insert(macro_name);
+
 	if (!add_macro_definition(macro_name, m))
 		return error(location, "redefinition of '" + macro_name + "'");
 }
@@ -480,7 +871,8 @@ void reshadefx::preprocessor::parse_undef()
 	else if (_token.literal_as_string == "defined")
 		return warning(_token.location, "macro name 'defined' is reserved");
 
-	_macros.erase(_token.literal_as_string);
+	if (const std::string macro_name(_token.literal_as_string); _macros->find(macro_name) != _macros->end())
+		modify_macros().erase(macro_name);
 }
 
 void reshadefx::preprocessor::parse_if()
@@ -506,7 +898,7 @@ void reshadefx::preprocessor::parse_ifdef()
 	if (!expect(tokenid::identifier))
 		return;
 
-	level.value = _macros.find(_token.literal_as_string) != _macros.end() ||
+	level.value = _macros->find(std::string(_token.literal_as_string)) != _macros->end() ||
 		// Check built-in macros as well
 		_token.literal_as_string == "__LINE__" ||
 		_token.literal_as_string == "__FILE__" ||
@@ -518,7 +910,10 @@ void reshadefx::preprocessor::parse_ifdef()
 
 	_if_stack.push_back(std::move(level));
 	if (!parent_skipping) // Only add if this #ifdef is active
+	{
 		_used_macros.emplace(_token.literal_as_string);
+		_referenced_macros.emplace(_token.literal_as_string);
+	}
 }
 void reshadefx::preprocessor::parse_ifndef()
 {
@@ -529,7 +924,7 @@ void reshadefx::preprocessor::parse_ifndef()
 	if (!expect(tokenid::identifier))
 		return;
 
-	level.value = _macros.find(_token.literal_as_string) == _macros.end() &&
+	level.value = _macros->find(std::string(_token.literal_as_string)) == _macros->end() &&
 		_token.literal_as_string != "__LINE__" &&
 		_token.literal_as_string != "__FILE__" &&
 		_token.literal_as_string != "__FILE_NAME__" &&
@@ -540,7 +935,10 @@ void reshadefx::preprocessor::parse_ifndef()
 
 	_if_stack.push_back(std::move(level));
 	if (!parent_skipping) // Only add if this #ifndef is active
+	{
 		_used_macros.emplace(_token.literal_as_string);
+		_referenced_macros.emplace(_token.literal_as_string);
+	}
 }
 void reshadefx::preprocessor::parse_elif()
 {
@@ -591,14 +989,14 @@ void reshadefx::preprocessor::parse_error()
 	const auto keyword_location = std::move(_token.location);
 	if (!expect(tokenid::string_literal))
 		return;
-	error(keyword_location, _token.literal_as_string);
+	error(keyword_location, std::string(_token.literal_as_string));
 }
 void reshadefx::preprocessor::parse_warning()
 {
 	const auto keyword_location = std::move(_token.location);
 	if (!expect(tokenid::string_literal))
 		return;
-	warning(keyword_location, _token.literal_as_string);
+	warning(keyword_location, std::string(_token.literal_as_string));
 }
 
 void reshadefx::preprocessor::parse_pragma()
@@ -607,7 +1005,7 @@ void reshadefx::preprocessor::parse_pragma()
 	if (!expect(tokenid::identifier))
 		return;
 
-	std::string pragma = std::move(_token.literal_as_string);
+	std::string pragma(_token.literal_as_string);
 	std::vector<std::string> pragma_args;
 	int parentheses_level = accept(tokenid::parenthesis_open) ? 1 : 0;
 
@@ -627,13 +1025,18 @@ void reshadefx::preprocessor::parse_pragma()
 				continue;
 		}
 
-		pragma_args.push_back(std::move(_current_token_raw_data));
+		pragma_args.emplace_back(_current_token_raw_data);
 	}
 
 	if (pragma == "once")
 	{
+		// Clear the contents of this file, so that any following include of it is skipped
 		if (const auto it = _file_cache.find(_output_location.source); it != _file_cache.end())
-			it->second.clear();
+		{
+			it->second.data.reset();
+			it->second.tokens.reset();
+			it->second.include_guard.clear();
+		}
 		return;
 	}
 
@@ -666,15 +1069,7 @@ void reshadefx::preprocessor::parse_include()
 		return;
 	}
 
-	std::filesystem::path file_name = std::filesystem::u8path(_token.literal_as_string);
-	std::filesystem::path file_path = std::filesystem::u8path(_output_location.source);
-	file_path.replace_filename(file_name);
-
-	if (std::error_code ec; !std::filesystem::exists(file_path, ec))
-		for (const std::filesystem::path &include_path : _include_paths)
-			if (std::filesystem::exists(file_path = include_path / file_name, ec))
-				break;
-
+	const std::filesystem::path file_path = resolve_include_path(_token.literal_as_string);
 	const std::string file_path_string = file_path.u8string();
 
 	// Detect recursive include and abort to avoid infinite loop
@@ -685,28 +1080,39 @@ void reshadefx::preprocessor::parse_include()
 		return;
 	}
 
-	std::string data;
+	include_cache::file file;
 	if (auto it = _file_cache.find(file_path_string);
 		it != _file_cache.end())
 	{
-		data = it->second;
+		file = it->second;
 	}
 	else
 	{
-		if (!read_file(file_path, data))
+		if (!_include_cache->read_file(file_path, file))
 		{
 			error(keyword_location, "could not open included file '" + file_path_string + '\'');
 			consume_until(tokenid::end_of_line);
 			return;
 		}
 
-		_file_cache.emplace(file_path_string, data);
+		_file_cache.emplace(file_path_string, file);
+	}
+
+	// Skip files that were marked with '#pragma once' already, since those would not add anything to the output
+	if (file.tokens == nullptr)
+		return;
+	// The same goes for files with an include guard that is already defined
+	if (!file.include_guard.empty() && _macros->find(file.include_guard) != _macros->end())
+	{
+		_used_macros.emplace(file.include_guard);
+		_referenced_macros.insert(file.include_guard);
+		return;
 	}
 
 	// Clear out input stack before pushing include so that hidden macros do not bleed into the include
 	while (_input_stack.size() > (_next_input_index + 1))
 		_input_stack.pop_back();
-	push(std::move(data), file_path_string);
+	push(file, file_path_string);
 }
 
 bool reshadefx::preprocessor::evaluate_expression()
@@ -870,19 +1276,11 @@ bool reshadefx::preprocessor::evaluate_expression()
 				}
 				if (!expect(tokenid::string_literal))
 					return false;
-				std::filesystem::path file_name = std::filesystem::u8path(_token.literal_as_string);
+				const std::filesystem::path file_path = resolve_include_path(_token.literal_as_string);
 				if (has_parentheses && !expect(tokenid::parenthesis_close))
 					return false;
-				std::filesystem::path file_path = std::filesystem::u8path(_output_location.source);
-				file_path.replace_filename(file_name);
-
-				std::error_code ec;
-				if (!std::filesystem::exists(file_path, ec))
-					for (const std::filesystem::path &include_path : _include_paths)
-						if (std::filesystem::exists(file_path = include_path / file_name, ec))
-							break;
 
-				rpn[rpn_index++] = { std::filesystem::exists(file_path, ec) ? 1 : 0, false };
+				rpn[rpn_index++] = { _include_cache->file_exists(file_path) ? 1 : 0, false };
 				continue;
 			}
 			if (_token.literal_as_string == "defined")
@@ -890,11 +1288,12 @@ bool reshadefx::preprocessor::evaluate_expression()
 				const bool has_parentheses = accept(tokenid::parenthesis_open);
 				if (!expect(tokenid::identifier))
 					return false;
-				const std::string macro_name = std::move(_token.literal_as_string);
+				const std::string macro_name(_token.literal_as_string);
 				if (has_parentheses && !expect(tokenid::parenthesis_close))
 					return false;
 
-				rpn[rpn_index++] = { _macros.find(macro_name) != _macros.end() ? 1 : 0, false };
+				rpn[rpn_index++] = { _macros->find(macro_name) != _macros->end() ? 1 : 0, false };
+				_referenced_macros.insert(macro_name);
 				continue;
 			}
 
@@ -1062,24 +1461,27 @@ bool reshadefx::preprocessor::evaluate_identifier_as_macro()
 	}
 	if (_token.literal_as_string == "__FILE_STEM__")
 	{
-		const std::filesystem::path file_stem = std::filesystem::u8path(_token.location.source).stem();
+		const std::filesystem::path file_stem = std::filesystem::u8path(_token.location.source.str()).stem();
 		push(escape_string(file_stem.u8string()));
 		return true;
 	}
 	if (_token.literal_as_string == "__FILE_NAME__")
 	{
-		const std::filesystem::path file_name = std::filesystem::u8path(_token.location.source).filename();
+		const std::filesystem::path file_name = std::filesystem::u8path(_token.location.source.str()).filename();
 		push(escape_string(file_name.u8string()));
 		return true;
 	}
 
-	const auto it = _macros.find(_token.literal_as_string);
-	if (it == _macros.end())
+	std::string macro_name(_token.literal_as_string);
+	const auto it = _macros->find(macro_name);
+	// Keep track of identifiers that are not a macro too, since defining one of them would change the output
+	_referenced_macros.insert(std::move(macro_name));
+	if (it == _macros->end())
 		return false;
 
-	const std::unordered_set<std::string> &hidden_macros = _input_stack[_current_input_index].hidden_macros;
-	if (hidden_macros.find(_token.literal_as_string) != hidden_macros.end())
-		return false;
+	for (size_t hidden = _input_stack[_current_input_index].hidden_macros; hidden != 0; hidden = _hidden_macros[hidden - 1].parent)
+		if (_hidden_macros[hidden - 1].name == &it->first)
+			return false;
 
 	const auto macro_location = _token.location;
 	if (_recursion_count++ >= 256)
@@ -1088,16 +1490,18 @@ bool reshadefx::preprocessor::evaluate_identifier_as_macro()
 		return false;
 	}
 
-	std::vector<std::string> arguments;
+	std::shared_ptr<macro_arguments> arguments;
 	if (it->second.is_function_like)
 	{
 		if (!accept(tokenid::parenthesis_open))
 			return false;
 
+		arguments = std::make_shared<macro_arguments>();
+
 		while (true)
 		{
 			int parentheses_level = 0;
-			std::string argument;
+			macro_argument argument = { arguments->tokens.size(), arguments->input.size() };
 
 			while (true)
 			{
@@ -1115,29 +1519,56 @@ bool reshadefx::preprocessor::evaluate_identifier_as_macro()
 				if (_token == tokenid::parenthesis_close && --parentheses_level < 0)
 					break;
 
+				// Trim whitespace from the beginning of the argument
+				if (_token == tokenid::space && arguments->tokens.size() == argument.first_token)
+					continue;
+
+				token &tok = arguments->tokens.emplace_back(_token);
+				tok.offset = arguments->input.size();
+
 				// Collapse all whitespace down to a single space
 				if (_token == tokenid::space)
-					argument += ' ';
+				{
+					tok.length = 1;
+					arguments->input += ' ';
+				}
 				else
-					argument += _current_token_raw_data;
+				{
+					arguments->input += _current_token_raw_data;
+				}
 			}
 
-			// Trim whitespace from argument
-			const size_t first = argument.find_first_not_of(" \t");
-			if (first == std::string::npos)
-			{
-				argument.clear();
-			}
-			else
+			// Trim whitespace from the end of the argument
+			while (arguments->tokens.size() > argument.first_token && arguments->tokens.back() == tokenid::space)
 			{
-				const size_t last = argument.find_last_not_of(" \t");
-				argument = argument.substr(first, last - first + 1);
+				arguments->input.erase(arguments->tokens.back().offset);
+				arguments->tokens.pop_back();
 			}
-			arguments.push_back(std::move(argument));
+
+			argument.length = arguments->input.size() - argument.offset;
+
+			// Terminate argument with a marker followed by the end of file, so that the input level is popped after it was expanded
+			token &marker = arguments->tokens.emplace_back();
+			marker.id = tokenid::unknown; // 'macro_replacement_argument' is 'tokenid::unknown'
+			marker.location = _token.location;
+			marker.offset = arguments->input.size();
+			marker.length = 1;
+			arguments->input += static_cast<char>(macro_replacement_argument);
+			token &end = arguments->tokens.emplace_back(marker);
+			end.id = tokenid::end_of_file;
+			end.offset = arguments->input.size();
+			end.length = 0;
+
+			arguments->list.push_back(argument);
 
 			if (parentheses_level < 0)
 				break;
 		}
+
+		// Make tokens reference the collected argument text, since the input levels they were consumed from may be gone by the time they are replayed
+		const std::string_view input = arguments->input;
+		for (token &tok : arguments->tokens)
+			tok.literal_as_string = tok == tokenid::identifier ? input.substr(tok.offset, tok.length) : std::string_view();
 	}
 
 	std::string input;
@@ -1147,13 +1578,38 @@ bool reshadefx::preprocessor::evaluate_identifier_as_macro()
 	{
 		push(std::move(input));
 
-		_input_stack[_current_input_index].hidden_macros.insert(it->first);
+		input_level &level = _input_stack[_current_input_index];
+		_hidden_macros.push_back({ &it->first, level.hidden_macros });
+		level.hidden_macros = _hidden_macros.size();
 	}
 
 	return true;
 }
 
-void reshadefx::preprocessor::expand_macro(const std::string &name, const macro &macro, const std::vector<std::string> &arguments, std::string &out)
+std::filesystem::path reshadefx::preprocessor::resolve_include_path(std::string_view file_name_string)
+{
+	const std::filesystem::path file_name = std::filesystem::u8path(file_name_string);
+
+	// Look for the file relative to the current file first, then go through all the include paths
+	std::filesystem::path file_path = std::filesystem::u8path(_output_location.source.str());
+	file_path.replace_filename(file_name);
+
+	if (!_include_cache->file_exists(file_path))
+	{
+		// Keep track of the paths that did not exist, since a file created at any of them later would be included instead
+		_missing_include_files.insert(file_path.u8string());
+
+		for (const std::filesystem::path &include_path : _include_paths)
+			if (_include_cache->file_exists(file_path = include_path / file_name))
+				break;
+			else
+				_missing_include_files.insert(file_path.u8string());
+	}
+
+	return file_path;
+}
+
+void reshadefx::preprocessor::expand_macro(const std::string &name, const macro &macro, const std::shared_ptr<macro_arguments> &arguments, std::string &out)
 {
 	for (size_t offset = 0; offset < macro.replacement_list.size(); ++offset)
 	{
@@ -1178,18 +1634,20 @@ void reshadefx::preprocessor::expand_macro(const std::string &name, const macro
 		}
 
 		const auto index = macro.replacement_list[++offset];
-		if (static_cast<size_t>(index) >= arguments.size())
+		if (arguments == nullptr || static_cast<size_t>(index) >= arguments->list.size())
 		{
 			warning(_token.location, "not enough arguments for function-like macro invocation '" + name + "'");
 			continue;
 		}
 
+		macro_argument &argument = arguments->list[index];
+
 		switch (type)
 		{
 		case macro_replacement_stringize:
-			out.reserve(out.size() + 2 + arguments[index].size());
+			out.reserve(out.size() + 2 + argument.length);
 			out += '"';
-			for (const char c : arguments[index])
+			for (const char c : std::string_view(arguments->input).substr(argument.offset, argument.length))
 			{
 				// Adds backslashes to escape quotes
 				if (c == '"')
@@ -1199,18 +1657,37 @@ void reshadefx::preprocessor::expand_macro(const std::string &name, const macro
 			out += '"';
 			break;
 		case macro_replacement_argument:
-			push(arguments[index] + static_cast<char>(macro_replacement_argument));
-			while (true)
+			// Each argument is only expanded once, even if it is referenced multiple times in the replacement list
+			if (!argument.is_expanded)
 			{
-				// Consume all tokens here, so spaces are added to the output too
-				consume();
-				if (_token == tokenid::unknown) // 'macro_replacement_argument' is 'tokenid::unknown'
-					break;
-				if (_token == tokenid::identifier && evaluate_identifier_as_macro())
-					continue;
-				out += _current_token_raw_data;
+				argument.expanded_offset = arguments->expanded.size();
+
+				// Replay the argument tokens that were collected during the macro invocation, instead of lexing the argument text again
+				input_level level = {};
+				level.cached_input = std::shared_ptr<const std::string>(arguments, &arguments->input);
+				level.cached_tokens = std::shared_ptr<const std::vector<token>>(arguments, &arguments->tokens);
+				level.next_cached_token = argument.first_token;
+				level.next_token.id = tokenid::unknown;
+				level.next_token.location = _token.location;
+				push(std::move(level));
+
+				while (true)
+				{
+					// Consume all tokens here, so spaces are added to the output too
+					consume();
+					if (_token == tokenid::unknown) // 'macro_replacement_argument' is 'tokenid::unknown'
+						break;
+					if (_token == tokenid::identifier && evaluate_identifier_as_macro())
+						continue;
+					arguments->expanded += _current_token_raw_data;
+				}
+				assert(_current_token_raw_data[0] == macro_replacement_argument);
+
+				argument.expanded_length = arguments->expanded.size() - argument.expanded_offset;
+				argument.is_expanded = true;
 			}
-			assert(_current_token_raw_data[0] == macro_replacement_argument);
+
+			out.append(arguments->expanded, argument.expanded_offset, argument.expanded_length);
 			break;
 		}
 	}
@@ -6,13 +6,76 @@
 #pragma once
 
 #include "effect_token.hpp"
-#include <memory> // std::unique_ptr
+#include <memory> // std::unique_ptr, std::shared_ptr
 #include <filesystem>
+#include <shared_mutex>
 #include <unordered_map>
 #include <unordered_set>
 
 namespace reshadefx
 {
+	/// <summary>
+	/// A thread-safe cache of include file contents and file existence checks, which can be shared between multiple preprocessor instances.
+	/// The cached tokens reference source file names interned into the current <see cref="string_pool"/> when they were read, so that pool has to outlive the cache.
+	/// </summary>
+	class include_cache
+	{
+	public:
+		struct file
+		{
+			std::shared_ptr<const std::string> data;
+			/// <summary>
+			/// Tokens the preprocessor lexer produces for the file contents, which can be replayed instead of lexing the file again.
+			/// </summary>
+			std::shared_ptr<const std::vector<token>> tokens;
+			/// <summary>
+			/// Name of the macro used in an '#ifndef' include guard spanning the entire file, or empty if there is none.
+			/// </summary>
+			std::string include_guard;
+			/// <summary>
+			/// Last modification time of the file, queried before its contents were read.
+			/// </summary>
+			std::filesystem::file_time_type last_write_time;
+			/// <summary>
+			/// Hash of the file contents, which identifies them independent of the modification time.
+			/// </summary>
+			size_t hash = 0;
+		};
+
+		/// <summary>
+		/// Checks whether the specified file exists, using a previously cached result if available.
+		/// </summary>
+		/// <param name="path">Path to the file to check.</param>
+		bool file_exists(const std::filesystem::path &path);
+		/// <summary>
+		/// Adds the list of files in the specified directory, so that existence checks for files directly in it are answered from that list instead of querying the file system.
+		/// File names are compared case-insensitively for ASCII characters. Lookups of names containing other characters that are not in the list still query the file system.
+		/// </summary>
+		/// <param name="directory">Path to the directory that was listed.</param>
+		/// <param name="file_names">Names of all files in that directory.</param>
+		void add_directory_listing(const std::filesystem::path &directory, const std::vector<std::filesystem::path> &file_names);
+
+		/// <summary>
+		/// Reads and tokenizes the contents of the specified file, using a previously cached copy if the file was not modified since.
+		/// </summary>
+		/// <param name="path">Path to the file to read.</param>
+		/// <param name="file">Structure that is filled with the shared file contents.</param>
+		/// <returns><see langword="true"/> if the file was read successfully, <see langword="false"/> otherwise.</returns>
+		bool read_file(const std::filesystem::path &path, file &file);
+
+		/// <summary>
+		/// Removes all cached file existence checks and directory listings, so that files which were added or removed since are picked up.
+		/// File contents stay cached, since those are validated against the last modification time of the file on every read.
+		/// </summary>
+		void invalidate_file_lookups();
+
+	private:
+		std::shared_mutex _mutex;
+		std::unordered_map<std::string, bool> _exists_cache;
+		std::unordered_map<std::string, std::unordered_set<std::string>> _directory_cache;
+		std::unordered_map<std::string, file> _file_cache;
+	};
+
 	/// <summary>
 	/// A C-style preprocessor implementation.
 	/// </summary>
@@ -28,7 +91,12 @@ namespace reshadefx
 		};
 
 		// Define constructor explicitly because lexer class is not included here
-		preprocessor();
+		explicit preprocessor(std::shared_ptr<include_cache> cache = nullptr);
+		/// <summary>
+		/// Creates a copy of a preprocessor instance that is not currently parsing, including its macro definitions, include paths and output so far.
+		/// The macro definitions are shared with the original instance until either one modifies them, so that this is cheap enough to do for every effect.
+		/// </summary>
+		preprocessor(const preprocessor &base);
 		~preprocessor();
 
 		/// <summary>
@@ -81,15 +149,42 @@ namespace reshadefx
 		const std::string &output() const { return _output; }
 
 		/// <summary>
-		/// Gets a list of all included files.
+		/// Enables collecting the pre-processed output as a list of tokens in addition to the output string, which the parser can consume without lexing the output string again.
+		/// </summary>
+		void enable_output_tokens() { _output_tokens_enabled = true; }
+		/// <summary>
+		/// Gets the pre-processed output as a list of tokens, terminated by an end of file token.
+		/// Their offsets and locations refer to the output string and they do not reference any string literals, so they stay valid after the preprocessor is destroyed.
+		/// Only the first token after the source file name changed has it set in its location, the following ones leave it empty.
+		/// This is empty if not enabled or if the output contains tokens that would be lexed differently from the output string, in which case that has to be parsed instead.
+		/// </summary>
+		std::vector<token> &output_tokens() { return _output_tokens; }
+		const std::vector<token> &output_tokens() const { return _output_tokens; }
+
+		/// <summary>
+		/// Gets a list of all included files, including those that were appended via <see cref="append_file"/>.
 		/// </summary>
 		std::vector<std::filesystem::path> included_files() const;
+		/// <summary>
+		/// Gets the contents that were read for all included and appended files, indexed by their path.
+		/// Files that were skipped on subsequent includes due to '#pragma once' keep their modification time and hash, but no data.
+		/// </summary>
+		const std::unordered_map<std::string, include_cache::file> &included_file_contents() const { return _file_cache; }
+		/// <summary>
+		/// Gets the paths of all files that were looked for while resolving #include directives, but did not exist.
+		/// If any of them is created later, it may be included instead of the file that was found.
+		/// </summary>
+		const std::unordered_set<std::string> &missing_include_files() const { return _missing_include_files; }
 
 		/// <summary>
 		/// Gets a list of all defines that were used in #ifdef and #ifndef lines.
 		/// </summary>
 		/// <returns></returns>
 		std::vector<std::pair<std::string, std::string>> used_macro_definitions() const;
+		/// <summary>
+		/// Gets the names of all macros whose definition or absence affected the output, through #define, #ifdef, #ifndef, defined() in #if or #elif and expansion.
+		/// </summary>
+		const std::unordered_set<std::string> &referenced_macros() const { return _referenced_macros; }
 
 		/// <summary>
 		/// Gets a list of pragmas that occured.
@@ -108,14 +203,55 @@ namespace reshadefx
 		{
 			std::string name;
 			std::unique_ptr<class lexer> lexer;
+			std::shared_ptr<const std::string> cached_input;
+			std::shared_ptr<const std::vector<token>> cached_tokens;
+			size_t next_cached_token = 0;
 			token next_token;
-			std::unordered_set<std::string> hidden_macros;
+			/// <summary>
+			/// One-based index of the last entry in the chain of hidden macros in '_hidden_macros', or zero if no macros are hidden in this input level.
+			/// </summary>
+			size_t hidden_macros = 0;
+		};
+		struct hidden_macro
+		{
+			/// <summary>
+			/// Name of the macro, which points at the key in '_macros', so that it is sufficient to compare pointers.
+			/// </summary>
+			const std::string *name;
+			size_t parent;
+		};
+		struct macro_argument
+		{
+			size_t first_token;
+			size_t offset;
+			size_t length;
+			size_t expanded_offset = 0;
+			size_t expanded_length = 0;
+			bool is_expanded = false;
+		};
+		struct macro_arguments
+		{
+			/// <summary>
+			/// Raw text of all arguments, each followed by the argument replacement marker.
+			/// </summary>
+			std::string input;
+			/// <summary>
+			/// Tokens of all arguments, which reference the raw text above and are replayed when an argument is expanded.
+			/// Each argument is terminated by the argument replacement marker and an end of file token.
+			/// </summary>
+			std::vector<token> tokens;
+			std::vector<macro_argument> list;
+			std::string expanded;
 		};
 
 		void error(const location &location, const std::string &message);
 		void warning(const location &location, const std::string &message);
 
 		void push(std::string input, const std::string &name = std::string());
+		void push(const include_cache::file &file, const std::string &name);
+		void push(input_level &&level);
+
+		std::string_view input_string(const input_level &input) const;
 
 		bool peek(tokenid token) const;
 		bool consume();
@@ -137,26 +273,43 @@ namespace reshadefx
 		void parse_pragma();
 		void parse_include();
 
+		void skip_inactive_lines();
+
 		bool evaluate_expression();
 		bool evaluate_identifier_as_macro();
 
-		void expand_macro(const std::string &name, const macro &macro, const std::vector<std::string> &arguments, std::string &out);
+		void append_output_token(const std::string &line, size_t line_first_token);
+		void finish_output_tokens(size_t line_first_token, uint32_t line);
+
+		std::filesystem::path resolve_include_path(std::string_view file_name);
+
+		void expand_macro(const std::string &name, const macro &macro, const std::shared_ptr<macro_arguments> &arguments, std::string &out);
 		void create_macro_replacement_list(macro &macro);
 
+		std::unordered_map<std::string, macro> &modify_macros();
+
 		bool _success = true;
 		std::string _output, _errors;
-		std::string _current_token_raw_data;
+		std::string_view _current_token_raw_data;
+		bool _output_tokens_enabled = false;
+		std::vector<token> _output_tokens;
+		interned_string _output_tokens_source;
 		reshadefx::token _token;
 		std::vector<if_level> _if_stack;
 		std::vector<input_level> _input_stack;
+		std::vector<hidden_macro> _hidden_macros;
 		size_t _next_input_index = 0;
 		size_t _current_input_index = 0;
 		unsigned short _recursion_count = 0;
 		location _output_location;
 		std::unordered_set<std::string> _used_macros;
-		std::unordered_map<std::string, macro> _macros;
+		std::unordered_set<std::string> _referenced_macros;
+		// This may be shared with other preprocessor instances, so has to be copied before it is modified (see 'modify_macros')
+		std::shared_ptr<std::unordered_map<std::string, macro>> _macros;
 		std::vector<std::filesystem::path> _include_paths;
-		std::unordered_map<std::string, std::string> _file_cache;
+		std::shared_ptr<include_cache> _include_cache;
+		std::unordered_map<std::string, include_cache::file> _file_cache;
+		std::unordered_set<std::string> _missing_include_files;
 		std::unordered_map<std::string, std::vector<std::string>> _used_pragmas;
 	};
 }
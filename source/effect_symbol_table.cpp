@@ -6,8 +6,9 @@
 #include "effect_symbol_table.hpp"
 #include <cassert>
 #include <malloc.h> // alloca
-#include <algorithm> // std::upper_bound, std::sort
+#include <algorithm> // std::upper_bound, std::lower_bound, std::sort, std::stable_sort
 #include <functional> // std::greater
+#include <limits> // std::numeric_limits
 
 #pragma region Import intrinsic functions
 
@@ -114,6 +115,19 @@ static const intrinsic s_intrinsics[] =
 #undef sampler
 #undef storage
 
+// Index of all intrinsic overloads by name, with the overloads of each name sorted by their number of parameters
+static const std::unordered_map<std::string_view, std::vector<const intrinsic *>> s_intrinsic_index = []() {
+	std::unordered_map<std::string_view, std::vector<const intrinsic *>> index;
+	for (const intrinsic &intrinsic : s_intrinsics)
+		index[intrinsic.function.name].push_back(&intrinsic);
+	// Keep the declaration order between overloads with the same number of parameters, since the first one wins when they are equally viable
+	for (auto &[name, overloads] : index)
+		std::stable_sort(overloads.begin(), overloads.end(), [](const intrinsic *lhs, const intrinsic *rhs) {
+			return lhs->function.parameter_list.size() < rhs->function.parameter_list.size();
+		});
+	return index;
+}();
+
 #pragma endregion
 
 unsigned int reshadefx::type::rank(const type &src, const type &dst)
@@ -161,30 +175,35 @@ reshadefx::symbol_table::symbol_table()
 	_current_scope.name = "::";
 	_current_scope.level = 0;
 	_current_scope.namespace_level = 0;
+	_current_scope_name = intern_scope_name(_current_scope.name);
 }
 
 void reshadefx::symbol_table::enter_scope()
 {
 	_current_scope.level++;
+	_scope_constant_counts.push_back(static_cast<uint32_t>(_constants.size()));
 }
 void reshadefx::symbol_table::enter_namespace(const std::string &name)
 {
 	_current_scope.name += name + "::";
 	_current_scope.level++;
 	_current_scope.namespace_level++;
+	_current_scope_name = intern_scope_name(_current_scope.name);
 }
 void reshadefx::symbol_table::leave_scope()
 {
 	assert(_current_scope.level > 0);
 
-	for (auto &symbol : _symbol_stack)
+	// Local symbols are removed again in reverse insertion order, so only the most recently inserted ones have to be looked at
+	while (!_local_symbols.empty() && _local_symbols.back().second >= _current_scope.level)
 	{
-		std::vector<scoped_symbol> &scope_list = symbol.second;
+		std::vector<stored_symbol> &scope_list = _symbol_stack[_local_symbols.back().first];
+		_local_symbols.pop_back();
 
 		for (auto scope_it = scope_list.begin(); scope_it != scope_list.end();)
 		{
-			if (scope_it->scope.level > scope_it->scope.namespace_level &&
-				scope_it->scope.level >= _current_scope.level)
+			if (scope_it->level > scope_it->namespace_level &&
+				scope_it->level >= _current_scope.level)
 			{
 				scope_it = scope_list.erase(scope_it);
 			}
@@ -195,6 +214,10 @@ void reshadefx::symbol_table::leave_scope()
 		}
 	}
 
+	// Global constants are only ever inserted outside of local scopes, so all constants added since entering this scope belonged to the symbols just removed
+	_constants.resize(_scope_constant_counts.back());
+	_scope_constant_counts.pop_back();
+
 	_current_scope.level--;
 }
 void reshadefx::symbol_table::leave_namespace()
@@ -205,6 +228,7 @@ void reshadefx::symbol_table::leave_namespace()
 	_current_scope.name.erase(_current_scope.name.substr(0, _current_scope.name.size() - 2).rfind("::") + 2);
 	_current_scope.level--;
 	_current_scope.namespace_level--;
+	_current_scope_name = intern_scope_name(_current_scope.name);
 }
 
 bool reshadefx::symbol_table::insert_symbol(const std::string &name, const symbol &symbol, bool global)
@@ -212,41 +236,61 @@ bool reshadefx::symbol_table::insert_symbol(const std::string &name, const symbo
 	assert(symbol.id != 0 || symbol.op == symbol_type::constant);
 
 	// Make sure the symbol does not exist yet
-	if (symbol.op != symbol_type::function && find_symbol(name, _current_scope, true).id != 0)
+	if (symbol.op != symbol_type::function && find_stored_symbol(name, _current_scope, true) != nullptr)
 		return false;
 
+	stored_symbol stored = { symbol.op, symbol.id, symbol.type, symbol.function, 0 };
+	if (symbol.op == symbol_type::constant)
+	{
+		stored.constant_index = static_cast<uint32_t>(_constants.size());
+		_constants.push_back(symbol.constant);
+	}
+
 	// Insertion routine which keeps the symbol stack sorted by namespace level
-	const auto insert_sorted = [](auto &vec, const auto &item) {
-		return vec.insert(
+	const auto insert_sorted = [this](const std::string &key, const stored_symbol &item) {
+		const auto name_it = _symbol_names.try_emplace(key, static_cast<uint32_t>(_symbol_stack.size())).first;
+		if (name_it->second == _symbol_stack.size())
+			_symbol_stack.emplace_back();
+
+		std::vector<stored_symbol> &vec = _symbol_stack[name_it->second];
+		vec.insert(
 			std::upper_bound(vec.begin(), vec.end(), item,
-				[](auto lhs, auto rhs) {
-					return lhs.scope.namespace_level < rhs.scope.namespace_level;
+				[](const stored_symbol &lhs, const stored_symbol &rhs) {
+					return lhs.namespace_level < rhs.namespace_level;
 				}), item);
+		return name_it->second;
 	};
 
 	// Global symbols are accessible from every scope
 	if (global)
 	{
-		scope scope = { "", 0, 0 };
+		stored.level = stored.namespace_level = 0;
 
 		// Walk scope chain from global scope back to current one
 		for (size_t pos = 0; pos != std::string::npos; pos = _current_scope.name.find("::", pos))
 		{
 			// Extract scope name
-			scope.name = _current_scope.name.substr(0, pos += 2);
+			stored.scope_name = intern_scope_name(_current_scope.name.substr(0, pos += 2));
 			const auto previous_scope_name = _current_scope.name.substr(pos);
 
 			// Insert symbol into this scope
-			insert_sorted(_symbol_stack[previous_scope_name + name], scoped_symbol { symbol, scope });
+			insert_sorted(previous_scope_name + name, stored);
 
 			// Continue walking up the scope chain
-			scope.level = ++scope.namespace_level;
+			stored.level = ++stored.namespace_level;
 		}
 	}
 	else
 	{
 		// This is a local symbol so it's sufficient to update the symbol stack with just the current scope
-		insert_sorted(_symbol_stack[name], scoped_symbol { symbol, _current_scope });
+		stored.scope_name = _current_scope_name;
+		stored.level = _current_scope.level;
+		stored.namespace_level = _current_scope.namespace_level;
+
+		const uint32_t name_index = insert_sorted(name, stored);
+
+		if (stored.level > stored.namespace_level)
+			_local_symbols.emplace_back(name_index, stored.level);
 	}
 
 	return true;
@@ -259,32 +303,73 @@ reshadefx::scoped_symbol reshadefx::symbol_table::find_symbol(const std::string
 }
 reshadefx::scoped_symbol reshadefx::symbol_table::find_symbol(const std::string &name, const scope &scope, bool exclusive) const
 {
-	const auto stack_it = _symbol_stack.find(name);
+	if (const stored_symbol *const stored = find_stored_symbol(name, scope, exclusive))
+		return load_symbol(*stored);
+	else
+		return {};
+}
+
+uint32_t reshadefx::symbol_table::intern_scope_name(const std::string &name)
+{
+	const auto [it, inserted] = _scope_name_indices.try_emplace(name, static_cast<uint32_t>(_scope_names.size()));
+	if (inserted)
+		_scope_names.push_back(&it->first);
+	return it->second;
+}
+uint32_t reshadefx::symbol_table::find_scope_name(const std::string &name) const
+{
+	if (name == *_scope_names[_current_scope_name])
+		return _current_scope_name;
+
+	// Scopes that were never entered cannot have any symbols, so return an index that does not match any symbol
+	const auto it = _scope_name_indices.find(name);
+	return it != _scope_name_indices.end() ? it->second : std::numeric_limits<uint32_t>::max();
+}
+
+const reshadefx::symbol_table::stored_symbol *reshadefx::symbol_table::find_stored_symbol(const std::string &name, const scope &scope, bool exclusive) const
+{
+	const auto name_it = _symbol_names.find(name);
 
 	// Check if symbol does exist
-	if (stack_it == _symbol_stack.end() || stack_it->second.empty())
-		return {};
+	if (name_it == _symbol_names.end() || _symbol_stack[name_it->second].empty())
+		return nullptr;
+
+	const std::vector<stored_symbol> &scope_list = _symbol_stack[name_it->second];
+	const uint32_t scope_name = find_scope_name(scope.name);
 
 	// Walk up the scope chain starting at the requested scope level and find a matching symbol
-	scoped_symbol result = {};
+	const stored_symbol *result = nullptr;
 
-	for (auto it = stack_it->second.rbegin(), end = stack_it->second.rend(); it != end; ++it)
+	for (auto it = scope_list.rbegin(), end = scope_list.rend(); it != end; ++it)
 	{
-		if (it->scope.level > scope.level ||
-			it->scope.namespace_level > scope.namespace_level || (it->scope.namespace_level == scope.namespace_level && it->scope.name != scope.name))
+		if (it->level > scope.level ||
+			it->namespace_level > scope.namespace_level || (it->namespace_level == scope.namespace_level && it->scope_name != scope_name))
 			continue;
-		if (exclusive && it->scope.level < scope.level)
+		if (exclusive && it->level < scope.level)
 			continue;
 
 		if (it->op == symbol_type::constant || it->op == symbol_type::variable || it->op == symbol_type::structure)
-			return *it; // Variables and structures have the highest priority and are always picked immediately
-		else if (result.id == 0)
-			result = *it; // Function names have a lower priority, so continue searching in case a variable with the same name exists
+			return &*it; // Variables and structures have the highest priority and are always picked immediately
+		else if (result == nullptr)
+			result = &*it; // Function names have a lower priority, so continue searching in case a variable with the same name exists
 	}
 
 	return result;
 }
 
+reshadefx::scoped_symbol reshadefx::symbol_table::load_symbol(const stored_symbol &stored) const
+{
+	scoped_symbol symbol = {};
+	symbol.op = stored.op;
+	symbol.id = stored.id;
+	symbol.type = stored.type;
+	symbol.function = stored.function;
+	if (stored.op == symbol_type::constant)
+		symbol.constant = _constants[stored.constant_index];
+	symbol.scope = { *_scope_names[stored.scope_name], stored.level, stored.namespace_level };
+	return symbol;
+}
+
 static int compare_functions(const std::vector<reshadefx::expression> &arguments, const reshadefx::function_info *function1, const reshadefx::function_info *function2)
 {
 	const size_t num_arguments = arguments.size();
@@ -343,16 +428,18 @@ bool reshadefx::symbol_table::resolve_function_call(const std::string &name, con
 	unsigned int overload_namespace = scope.namespace_level;
 
 	// Look up function name in the symbol stack and loop through the associated symbols
-	const auto stack_it = _symbol_stack.find(name);
-
-	if (stack_it != _symbol_stack.end() && !stack_it->second.empty())
+	if (const auto name_it = _symbol_names.find(name);
+		name_it != _symbol_names.end() && !_symbol_stack[name_it->second].empty())
 	{
-		for (auto it = stack_it->second.rbegin(), end = stack_it->second.rend(); it != end; ++it)
+		const std::vector<stored_symbol> &scope_list = _symbol_stack[name_it->second];
+		const uint32_t scope_name = find_scope_name(scope.name);
+
+		for (auto it = scope_list.rbegin(), end = scope_list.rend(); it != end; ++it)
 		{
 			if (it->op != symbol_type::function)
 				continue;
-			if (it->scope.level > scope.level ||
-				it->scope.namespace_level > scope.namespace_level || (it->scope.namespace_level == scope.namespace_level && it->scope.name != scope.name))
+			if (it->level > scope.level ||
+				it->namespace_level > scope.namespace_level || (it->namespace_level == scope.namespace_level && it->scope_name != scope_name))
 				continue;
 
 			const function_info *const function = it->function;
@@ -389,9 +476,9 @@ bool reshadefx::symbol_table::resolve_function_call(const std::string &name, con
 				out_data.type = function->return_type;
 				out_data.function = result = function;
 				num_overloads = 1;
-				overload_namespace = it->scope.namespace_level;
+				overload_namespace = it->namespace_level;
 			}
-			else if (comparison == 0 && overload_namespace == it->scope.namespace_level) // Both functions are equally viable, so the call is ambiguous
+			else if (comparison == 0 && overload_namespace == it->namespace_level) // Both functions are equally viable, so the call is ambiguous
 			{
 				++num_overloads;
 			}
@@ -401,27 +488,65 @@ bool reshadefx::symbol_table::resolve_function_call(const std::string &name, con
 	// Try matching against intrinsic functions if no matching user-defined function was found up to this point
 	if (num_overloads == 0)
 	{
-		for (const intrinsic &intrinsic : s_intrinsics)
+		// Which intrinsic overload matches only depends on the name and the argument types, so the result is cached for repeated calls
+		std::string key;
+		key.reserve(name.size() + 1 + arguments.size() * 17);
+		key += name;
+		key += '\0';
+		for (const expression &argument : arguments)
 		{
-			if (intrinsic.function.name != name || intrinsic.function.parameter_list.size() != arguments.size())
-				continue;
+			const type &arg_type = argument.type;
+			key += static_cast<char>(arg_type.base);
+			key.append(reinterpret_cast<const char *>(&arg_type.rows), sizeof(arg_type.rows));
+			key.append(reinterpret_cast<const char *>(&arg_type.cols), sizeof(arg_type.cols));
+			key.append(reinterpret_cast<const char *>(&arg_type.array_length), sizeof(arg_type.array_length));
+			key.append(reinterpret_cast<const char *>(&arg_type.definition), sizeof(arg_type.definition));
+		}
 
-			// A new possibly-matching intrinsic function was found, compare it against the current result
-			const int comparison = compare_functions(arguments, &intrinsic.function, result);
+		auto cache_it = _intrinsic_overload_cache.find(key);
+		if (cache_it == _intrinsic_overload_cache.end())
+		{
+			intrinsic_overload overload = {};
 
-			if (comparison < 0) // The new function is a better match
-			{
-				out_data.op = symbol_type::intrinsic;
-				out_data.id = static_cast<uint32_t>(intrinsic.id);
-				out_data.type = intrinsic.function.return_type;
-				out_data.function = &intrinsic.function;
-				result = out_data.function;
-				num_overloads = 1;
-			}
-			else if (comparison == 0 && overload_namespace == 0) // Both functions are equally viable, so the call is ambiguous (intrinsics are always in the global namespace)
+			if (const auto index_it = s_intrinsic_index.find(name);
+				index_it != s_intrinsic_index.end())
 			{
-				++num_overloads;
+				const std::vector<const intrinsic *> &overloads = index_it->second;
+
+				for (auto it = std::lower_bound(overloads.begin(), overloads.end(), arguments.size(),
+						[](const intrinsic *intrinsic, size_t num_parameters) { return intrinsic->function.parameter_list.size() < num_parameters; });
+					it != overloads.end() && (*it)->function.parameter_list.size() == arguments.size(); ++it)
+				{
+					const intrinsic &intrinsic = **it;
+
+					// A new possibly-matching intrinsic function was found, compare it against the current result
+					const int comparison = compare_functions(arguments, &intrinsic.function, overload.function);
+
+					if (comparison < 0) // The new function is a better match
+					{
+						overload.function = &intrinsic.function;
+						overload.id = static_cast<uint32_t>(intrinsic.id);
+						overload.num_overloads = 1;
+					}
+					else if (comparison == 0) // Both functions are equally viable
+					{
+						++overload.num_overloads;
+					}
+				}
 			}
+
+			cache_it = _intrinsic_overload_cache.emplace(std::move(key), overload).first;
+		}
+
+		if (const intrinsic_overload &overload = cache_it->second;
+			overload.function != nullptr)
+		{
+			out_data.op = symbol_type::intrinsic;
+			out_data.id = overload.id;
+			out_data.type = overload.function->return_type;
+			out_data.function = overload.function;
+			// Equally viable overloads only make the call ambiguous in the global namespace, since intrinsics are always in the global namespace
+			num_overloads = overload_namespace == 0 ? overload.num_overloads : 1;
 		}
 	}
 
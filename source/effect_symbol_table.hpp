@@ -96,8 +96,48 @@ namespace reshadefx
 		bool resolve_function_call(const std::string &name, const std::vector<expression> &args, const scope &scope, symbol &data, bool &ambiguous) const;
 
 	private:
+		struct intrinsic_overload
+		{
+			const reshadefx::function_info *function = nullptr;
+			uint32_t id = 0;
+			unsigned int num_overloads = 0;
+		};
+		/// <summary>
+		/// Compact representation of a symbol in the symbol table, which references its constant value and scope name instead of storing them inline.
+		/// </summary>
+		struct stored_symbol
+		{
+			symbol_type op;
+			uint32_t id;
+			reshadefx::type type;
+			const reshadefx::function_info *function;
+			// Index into '_constants' if this is a constant symbol
+			uint32_t constant_index;
+			// Index into '_scope_names'
+			uint32_t scope_name;
+			uint32_t level, namespace_level;
+		};
+
+		uint32_t intern_scope_name(const std::string &name);
+		uint32_t find_scope_name(const std::string &name) const;
+
+		const stored_symbol *find_stored_symbol(const std::string &name, const scope &scope, bool exclusive) const;
+		scoped_symbol load_symbol(const stored_symbol &stored) const;
+
 		scope _current_scope;
-		// Lookup table from name to matching symbols
-		std::unordered_map<std::string, std::vector<scoped_symbol>> _symbol_stack;
+		uint32_t _current_scope_name = 0;
+		// Lookup table from name to the index of the list of matching symbols in the symbol stack
+		std::unordered_map<std::string, uint32_t> _symbol_names;
+		// Lists of symbols for each name, sorted by namespace level
+		std::vector<std::vector<stored_symbol>> _symbol_stack;
+		// Names of all local symbols in insertion order, together with their scope level, so that leaving a scope only has to look at those
+		std::vector<std::pair<uint32_t, uint32_t>> _local_symbols;
+		std::unordered_map<std::string, uint32_t> _scope_name_indices;
+		std::vector<const std::string *> _scope_names;
+		std::vector<reshadefx::constant> _constants;
+		// Size of the constant pool when each of the currently entered local scopes was entered
+		std::vector<uint32_t> _scope_constant_counts;
+		// Lookup table from name and argument types to the best matching intrinsic overload
+		mutable std::unordered_map<std::string, intrinsic_overload> _intrinsic_overload_cache;
 	};
 }
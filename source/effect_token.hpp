@@ -5,11 +5,85 @@
 
 #pragma once
 
+#include <mutex>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
+#include <unordered_map>
 
 namespace reshadefx
 {
+	/// <summary>
+	/// A thread-safe pool of strings, which <see cref="interned_string"/> instances reference.
+	/// Strings interned into a pool stay valid until it is destroyed, so it has to outlive all interned strings referencing it (e.g. by scoping it to one effect reload).
+	/// </summary>
+	class string_pool
+	{
+	public:
+		/// <summary>
+		/// Makes strings interned on the current thread use the specified pool while this is alive, instead of the global pool, which is never freed.
+		/// </summary>
+		class scope
+		{
+		public:
+			explicit scope(string_pool &pool);
+			~scope();
+
+			scope(const scope &) = delete;
+			scope &operator=(const scope &) = delete;
+
+		private:
+			string_pool *const _previous;
+		};
+
+		string_pool() = default;
+		string_pool(const string_pool &) = delete;
+		string_pool &operator=(const string_pool &) = delete;
+
+		/// <summary>
+		/// Adds the specified string to the pool if it is not in it yet.
+		/// </summary>
+		/// <returns>Pointer to the pooled copy of the string, or <see langword="nullptr"/> if it is empty.</returns>
+		const std::string *intern(std::string_view str);
+
+		/// <summary>
+		/// Gets the pool that strings are currently interned into on the calling thread.
+		/// </summary>
+		static string_pool &current();
+
+	private:
+		std::mutex _mutex;
+		// Keys reference the string owned by the value, which does not move when the map is rehashed
+		std::unordered_map<std::string_view, std::unique_ptr<const std::string>> _strings;
+	};
+
+	/// <summary>
+	/// An immutable string which is interned in a pool (see <see cref="string_pool"/>), so that copying and comparing it is as cheap as for a pointer.
+	/// This is used for source file names, since a copy of those is stored with every token and expression.
+	/// </summary>
+	class interned_string
+	{
+	public:
+		interned_string() : _str(nullptr) {}
+		interned_string(const char *str) : _str(string_pool::current().intern(str)) {}
+		interned_string(std::string_view str) : _str(string_pool::current().intern(str)) {}
+		interned_string(const std::string &str) : _str(string_pool::current().intern(str)) {}
+
+		operator const std::string &() const { return str(); }
+		const std::string &str() const { return _str != nullptr ? *_str : s_empty; }
+		const char *c_str() const { return str().c_str(); }
+		size_t size() const { return str().size(); }
+		bool empty() const { return _str == nullptr; }
+
+		friend bool operator==(const interned_string &lhs, const interned_string &rhs) { return lhs._str == rhs._str; }
+		friend bool operator!=(const interned_string &lhs, const interned_string &rhs) { return lhs._str != rhs._str; }
+
+	private:
+		static inline const std::string s_empty;
+		const std::string *_str;
+	};
+
 	/// <summary>
 	/// Structure which keeps track of a code location.
 	/// </summary>
@@ -17,9 +91,9 @@ namespace reshadefx
 	{
 		location() : line(1), column(1) {}
 		explicit location(uint32_t line, uint32_t column = 1) : line(line), column(column) {}
-		explicit location(std::string source, uint32_t line, uint32_t column = 1) : source(std::move(source)), line(line), column(column) {}
+		explicit location(interned_string source, uint32_t line, uint32_t column = 1) : source(source), line(line), column(column) {}
 
-		std::string source;
+		interned_string source;
 		uint32_t line, column;
 	};
 
@@ -237,7 +311,8 @@ namespace reshadefx
 			float literal_as_float;
 			double literal_as_double;
 		};
-		std::string literal_as_string;
+		// This references the input string or storage owned by the lexer that produced this token
+		std::string_view literal_as_string;
 
 		inline operator tokenid() const { return id; }
 
@@ -17,6 +17,8 @@
 #include "input_freepie.hpp"
 #include "com_ptr.hpp"
 #include "process_utils.hpp"
+#include "cache_pack.hpp"
+#include "thread_pool.hpp"
 #include <set>
 #include <thread>
 #include <cstring>
@@ -53,81 +55,393 @@ bool resolve_preset_path(std::filesystem::path &path)
 	return !resolve_path(path) || ini_file::load_cache(path).has({}, "Techniques");
 }
 
-static bool find_file(const std::vector<std::filesystem::path> &search_paths, std::filesystem::path &path)
+static std::wstring search_path_key(const std::filesystem::path &path)
+{
+	std::wstring key = path.lexically_normal().native();
+	// Drop trailing separator, so that directory paths compare equal regardless of whether they have one
+	if (key.size() > 1 && (key.back() == L'\\' || key.back() == L'/'))
+		key.pop_back();
+	// The file system is case-insensitive, so lookups have to be too
+	std::transform(key.begin(), key.end(), key.begin(), [](wchar_t c) { return static_cast<wchar_t>(towlower(c)); });
+	return key;
+}
+
+static std::shared_ptr<const reshade::search_path_snapshot> create_search_path_snapshot(const std::vector<std::filesystem::path> &effect_search_paths, const std::vector<std::filesystem::path> &texture_search_paths, reshade::thread_pool &worker_pool)
+{
+	struct search_root
+	{
+		std::filesystem::path path;
+		bool recursive = false;
+		std::vector<reshade::search_path_snapshot::directory> directories;
+	};
+
+	std::vector<search_root> roots;
+	std::unordered_map<std::wstring, size_t> root_lookup;
+	std::vector<std::pair<size_t, bool>> effect_roots, texture_roots;
+
+	const auto add_search_paths = [&roots, &root_lookup](const std::vector<std::filesystem::path> &search_paths, std::vector<std::pair<size_t, bool>> &search_roots) {
+		for (std::filesystem::path search_path : search_paths)
+		{
+			const bool recursive_search = search_path.filename() == L"**";
+			if (recursive_search)
+				search_path.remove_filename();
+
+			if (!resolve_path(search_path))
+				continue;
+
+			// Search paths that point to the same directory share a listing, which is recursive if any of them is
+			const auto insert = root_lookup.emplace(search_path_key(search_path), roots.size());
+			if (insert.second)
+				roots.push_back({ std::move(search_path), recursive_search });
+			else
+				roots[insert.first->second].recursive |= recursive_search;
+
+			search_roots.emplace_back(insert.first->second, recursive_search);
+		}
+	};
+
+	add_search_paths(effect_search_paths, effect_roots);
+	add_search_paths(texture_search_paths, texture_roots);
+
+	// List all search paths in parallel, since that is dominated by waiting on the file system (especially if it is on a network share)
+	const auto list_root = [](search_root &root) {
+		std::error_code ec;
+		std::unordered_map<std::wstring, size_t> directory_lookup;
+
+		const auto add_entry = [&root, &directory_lookup](const std::filesystem::directory_entry &entry) {
+			std::error_code ec;
+			if (entry.is_directory(ec))
+			{
+				if (!root.recursive)
+					return;
+
+				directory_lookup.emplace(search_path_key(entry.path()), root.directories.size());
+				root.directories.push_back({ entry.path() });
+				return;
+			}
+
+			const auto it = directory_lookup.find(search_path_key(entry.path().parent_path()));
+			if (it == directory_lookup.end())
+				return;
+
+			reshade::search_path_snapshot::directory &directory = root.directories[it->second];
+			directory.file_lookup.emplace(search_path_key(entry.path().filename()), directory.files.size());
+			directory.files.push_back({ entry.path(), entry.file_size(ec), entry.last_write_time(ec) });
+		};
+
+		directory_lookup.emplace(search_path_key(root.path), 0);
+		root.directories.push_back({ root.path });
+
+		if (root.recursive)
+			for (const std::filesystem::directory_entry &entry : std::filesystem::recursive_directory_iterator(root.path, std::filesystem::directory_options::skip_permission_denied, ec))
+				add_entry(entry);
+		else
+			for (const std::filesystem::directory_entry &entry : std::filesystem::directory_iterator(root.path, std::filesystem::directory_options::skip_permission_denied, ec))
+				add_entry(entry);
+	};
+
+	worker_pool.parallel_for(roots.size(), [&list_root, &roots](size_t i) { list_root(roots[i]); });
+
+	const auto snapshot = std::make_shared<reshade::search_path_snapshot>();
+
+	std::vector<size_t> root_offsets;
+	for (search_root &root : roots)
+	{
+		root_offsets.push_back(snapshot->directories.size());
+		for (reshade::search_path_snapshot::directory &directory : root.directories)
+		{
+			snapshot->directory_lookup.emplace(search_path_key(directory.path), snapshot->directories.size());
+			snapshot->directories.push_back(std::move(directory));
+		}
+	}
+
+	// Directories of a search path are ordered with the search path itself first, followed by all its subdirectories if it is recursive
+	const auto add_directories = [&roots, &root_offsets](const std::vector<std::pair<size_t, bool>> &search_roots, std::vector<size_t> &directories) {
+		for (const auto &[root_index, recursive_search] : search_roots)
+			for (size_t i = 0; i < (recursive_search ? roots[root_index].directories.size() : 1); ++i)
+				directories.push_back(root_offsets[root_index] + i);
+	};
+
+	add_directories(effect_roots, snapshot->effect_directories);
+	add_directories(texture_roots, snapshot->texture_directories);
+
+	return snapshot;
+}
+
+static const reshade::search_path_snapshot::file *find_snapshot_file(const reshade::search_path_snapshot &snapshot, const std::filesystem::path &path)
+{
+	const auto directory_it = snapshot.directory_lookup.find(search_path_key(path.parent_path()));
+	if (directory_it == snapshot.directory_lookup.end())
+		return nullptr;
+
+	const reshade::search_path_snapshot::directory &directory = snapshot.directories[directory_it->second];
+	const auto file_it = directory.file_lookup.find(search_path_key(path.filename()));
+	if (file_it == directory.file_lookup.end())
+		return nullptr;
+
+	return &directory.files[file_it->second];
+}
+
+static bool find_file(const reshade::search_path_snapshot &snapshot, const std::vector<size_t> &search_directories, std::filesystem::path &path)
 {
 	std::error_code ec;
 	// Do not have to perform a search if the path is already absolute
 	if (path.is_absolute())
 		return std::filesystem::exists(path, ec);
 
-	for (std::filesystem::path search_path : search_paths)
+	for (const size_t directory_index : search_directories)
 	{
-		const bool recursive_search = search_path.filename() == L"**";
-		if (recursive_search)
-			search_path.remove_filename();
-
 		// Append relative file path to absolute search path
-		if (std::filesystem::path search_sub_path = search_path / path;
+		std::filesystem::path search_sub_path = snapshot.directories[directory_index].path / path;
+
+		if (const reshade::search_path_snapshot::file *const file = find_snapshot_file(snapshot, search_sub_path))
+		{
+			path = file->path;
+			return true;
+		}
+
+		// Fall back to querying the file system for paths that point outside the listed directories
+		if (snapshot.directory_lookup.find(search_path_key(search_sub_path.parent_path())) == snapshot.directory_lookup.end() &&
 			resolve_path(search_sub_path))
 		{
 			path = std::move(search_sub_path);
 			return true;
 		}
+	}
+
+	return false;
+}
+static std::vector<std::filesystem::path> find_files(const reshade::search_path_snapshot &snapshot, const std::vector<size_t> &search_directories, std::initializer_list<std::filesystem::path> extensions)
+{
+	std::vector<std::filesystem::path> files;
 
-		if (recursive_search)
+	for (const size_t directory_index : search_directories)
+	{
+		for (const reshade::search_path_snapshot::file &file : snapshot.directories[directory_index].files)
 		{
-			for (const std::filesystem::directory_entry &entry : std::filesystem::recursive_directory_iterator(search_path, std::filesystem::directory_options::skip_permission_denied, ec))
-			{
-				if (!entry.is_directory(ec))
-					continue;
+			if (std::find(extensions.begin(), extensions.end(), file.path.extension()) != extensions.end())
+				files.push_back(file.path);
+		}
+	}
 
-				if (std::filesystem::path search_sub_path = entry / path;
-					resolve_path(search_sub_path))
-				{
-					path = std::move(search_sub_path);
-					return true;
-				}
-			}
+	return files;
+}
+
+// Effect dependency lists consist of one line per file, with the hash of its contents, its last modification time and its path separated by spaces
+// Files that were looked for while resolving includes, but did not exist, follow in lines starting with '?' and their path
+// They may end with a line starting with '#', which lists the names of all macros the pre-processed output depends on, separated by spaces
+static void append_effect_dependency(std::string &dependencies, const std::filesystem::path &path, long long last_write_time, size_t hash)
+{
+	dependencies += std::to_string(hash) + ' ' + std::to_string(last_write_time) + ' ' + path.u8string() + '\n';
+}
+static void append_effect_missing_dependency(std::string &dependencies, const std::filesystem::path &path)
+{
+	dependencies += "? " + path.u8string() + '\n';
+}
+static void append_effect_referenced_macros(std::string &dependencies, const std::unordered_set<std::string> &referenced_macros)
+{
+	// Sort names, so that the list does not depend on the iteration order of the set
+	std::vector<std::string_view> names(referenced_macros.begin(), referenced_macros.end());
+	std::sort(names.begin(), names.end());
+
+	dependencies += '#';
+	for (const std::string_view name : names)
+	{
+		dependencies += ' ';
+		dependencies += name;
+	}
+	dependencies += '\n';
+}
+static size_t find_effect_referenced_macros(const std::string &dependencies)
+{
+	// Lines of files start with a number, so the first line starting with '#' is the list of macros
+	if (!dependencies.empty() && dependencies[0] == '#')
+		return 0;
+	const size_t offset = dependencies.find("\n#");
+	return offset != std::string::npos ? offset + 1 : dependencies.size();
+}
+static bool parse_effect_referenced_macros(const std::string &dependencies, std::unordered_set<std::string> &referenced_macros)
+{
+	size_t offset = find_effect_referenced_macros(dependencies);
+	if (offset == dependencies.size())
+		return false;
+
+	referenced_macros.clear();
+	for (size_t name_end; (offset = dependencies.find_first_not_of(" \n", offset + 1)) != std::string::npos; offset = name_end)
+	{
+		name_end = dependencies.find_first_of(" \n", offset);
+		referenced_macros.emplace(dependencies, offset, name_end - offset);
+	}
+	return true;
+}
+static bool parse_effect_dependency(const std::string &dependencies, size_t &offset, std::filesystem::path &path, long long &last_write_time, size_t &hash)
+{
+	const size_t line_end = dependencies.find('\n', offset);
+	if (line_end == std::string::npos)
+		return false;
+
+	char *path_begin = nullptr;
+	hash = static_cast<size_t>(std::strtoull(dependencies.c_str() + offset, &path_begin, 10));
+	last_write_time = std::strtoll(path_begin, &path_begin, 10);
+	if (*path_begin++ != ' ')
+		return false;
+
+	path = std::filesystem::u8path(path_begin, dependencies.c_str() + line_end);
+	offset = line_end + 1;
+	return true;
+}
+static bool parse_effect_missing_dependency(const std::string &dependencies, size_t &offset, std::filesystem::path &path)
+{
+	const size_t line_end = dependencies.find('\n', offset);
+	if (line_end == std::string::npos || line_end < offset + 2 || dependencies.compare(offset, 2, "? ") != 0)
+		return false;
+
+	path = std::filesystem::u8path(dependencies.c_str() + offset + 2, dependencies.c_str() + line_end);
+	offset = line_end + 1;
+	return true;
+}
+static bool hash_file_contents(const std::filesystem::path &path, size_t &hash)
+{
+	FILE *file = nullptr;
+	if (_wfopen_s(&file, path.c_str(), L"rb") != 0)
+		return false;
+
+	std::string data(static_cast<size_t>(_filelengthi64(_fileno(file))) + 1, '\0');
+	const size_t eof = fread(data.data(), 1, data.size() - 1, file);
+	fclose(file);
+
+	// Hash the contents exactly like the preprocessor does after reading a file (with a line feed appended and without BOM), so that the hashes match those it reports
+	data[eof] = '\n';
+	data.resize(eof + 1);
+	std::string_view contents = data;
+	if (contents.size() >= 3 && contents.compare(0, 3, "\xef\xbb\xbf") == 0)
+		contents.remove_prefix(3);
+
+	hash = std::hash<std::string_view>()(contents);
+	return true;
+}
+
+// Checks that all files in the dependency list still exist and updates the hashes of those that were modified since it was written (which only needs to look up the modification time of each file)
+// Also checks that none of the files that were missing exist now, since those would be included instead of the ones that were found before (e.g. a header added to an earlier include path)
+static bool update_effect_dependencies(const reshade::search_path_snapshot &snapshot, std::string &dependencies, bool &modified)
+{
+	std::string updated_dependencies;
+	bool contents_modified = false;
+
+	const size_t dependencies_end = find_effect_referenced_macros(dependencies);
+	for (size_t offset = 0; offset < dependencies_end;)
+	{
+		if (dependencies[offset] == '?')
+		{
+			std::filesystem::path path;
+			if (!parse_effect_missing_dependency(dependencies, offset, path))
+				return false;
+
+			// Directories in the snapshot were listed completely, so only query the file system for paths outside of them
+			if (find_snapshot_file(snapshot, path) != nullptr)
+				return false;
+			if (std::error_code ec; snapshot.directory_lookup.find(search_path_key(path.parent_path())) == snapshot.directory_lookup.end() && std::filesystem::exists(path, ec))
+				return false;
+
+			append_effect_missing_dependency(updated_dependencies, path);
+			continue;
+		}
+
+		std::filesystem::path path; long long last_write_time; size_t hash;
+		if (!parse_effect_dependency(dependencies, offset, path, last_write_time, hash))
+			return false;
+
+		long long current_write_time;
+		if (const reshade::search_path_snapshot::file *const file = find_snapshot_file(snapshot, path))
+		{
+			current_write_time = file->last_write_time.time_since_epoch().count();
+		}
+		else
+		{
+			// Files outside the search paths (e.g. included via a relative path) are not part of the snapshot
+			std::error_code ec;
+			current_write_time = std::filesystem::last_write_time(path, ec).time_since_epoch().count();
+			if (ec)
+				return false;
+		}
+
+		if (current_write_time != last_write_time)
+		{
+			// Only the contents are part of the source hash, so files that were touched without changing them do not invalidate anything
+			const size_t previous_hash = hash;
+			if (!hash_file_contents(path, hash))
+				return false;
+
+			contents_modified |= hash != previous_hash;
+
+			last_write_time = current_write_time;
+			modified = true;
 		}
+
+		append_effect_dependency(updated_dependencies, path, last_write_time, hash);
 	}
 
-	return false;
+	// The list of referenced macros is only known for the contents it was collected from, so drop it if those changed
+	if (!contents_modified)
+		updated_dependencies.append(dependencies, dependencies_end);
+
+	dependencies = std::move(updated_dependencies);
+	return true;
 }
-static std::vector<std::filesystem::path> find_files(const std::vector<std::filesystem::path> &search_paths, std::initializer_list<std::filesystem::path> extensions)
+static size_t hash_effect_dependencies(size_t attributes_hash, const std::string &dependencies)
 {
-	std::error_code ec;
-	std::vector<std::filesystem::path> files;
+	std::string data = std::to_string(attributes_hash) + ';';
 
-	for (std::filesystem::path search_path : search_paths)
+	const size_t dependencies_end = find_effect_referenced_macros(dependencies);
+	for (size_t offset = 0; offset < dependencies_end;)
 	{
-		const bool recursive_search = search_path.filename() == L"**";
-		if (recursive_search)
-			search_path.remove_filename();
+		// Missing files do not contribute to the output, so are not part of the hash
+		if (dependencies[offset] == '?')
+		{
+			if (std::filesystem::path path; !parse_effect_missing_dependency(dependencies, offset, path))
+				return 0;
+			continue;
+		}
+
+		std::filesystem::path path; long long last_write_time; size_t hash;
+		if (!parse_effect_dependency(dependencies, offset, path, last_write_time, hash))
+			return 0;
+
+		data += path.u8string() + '?' + std::to_string(hash) + ';';
+	}
+
+	return std::hash<std::string>()(data);
+}
+
+// Fills the specified specialization constants with their values from the preset and returns a hash of those values, which identifies the variant of the effect they result in
+static size_t apply_spec_constant_values(std::vector<reshadefx::uniform_info> &spec_constants, const ini_file &preset, const std::string &effect_name)
+{
+	std::string spec_constant_values;
 
-		if (resolve_path(search_path))
+	for (reshadefx::uniform_info &constant : spec_constants)
+	{
+		switch (constant.type.base)
 		{
-			if (recursive_search)
-			{
-				for (const std::filesystem::directory_entry &entry : std::filesystem::recursive_directory_iterator(search_path, std::filesystem::directory_options::skip_permission_denied, ec))
-				{
-					if (!entry.is_directory(ec) &&
-						std::find(extensions.begin(), extensions.end(), entry.path().extension()) != extensions.end())
-						files.emplace_back(entry); // Construct path from directory entry in-place
-				}
-			}
-			else
-			{
-				for (const std::filesystem::directory_entry &entry : std::filesystem::directory_iterator(search_path, std::filesystem::directory_options::skip_permission_denied, ec))
-				{
-					if (!entry.is_directory(ec) &&
-						std::find(extensions.begin(), extensions.end(), entry.path().extension()) != extensions.end())
-						files.emplace_back(entry);
-				}
-			}
+		case reshadefx::type::t_int:
+			preset.get(effect_name, constant.name, constant.initializer_value.as_int);
+			break;
+		case reshadefx::type::t_bool:
+		case reshadefx::type::t_uint:
+			preset.get(effect_name, constant.name, constant.initializer_value.as_uint);
+			break;
+		case reshadefx::type::t_float:
+			preset.get(effect_name, constant.name, constant.initializer_value.as_float);
+			break;
 		}
+
+		// Check if this is a split specialization constant and move data accordingly
+		if (constant.type.is_scalar() && constant.offset != 0)
+			constant.initializer_value.as_uint[0] = constant.initializer_value.as_uint[constant.offset];
+
+		spec_constant_values.append(reinterpret_cast<const char *>(constant.initializer_value.as_uint), constant.type.components() * sizeof(uint32_t));
 	}
 
-	return files;
+	return std::hash<std::string>()(spec_constant_values);
 }
 
 static inline int format_color_bit_depth(reshade::api::format value)
@@ -180,6 +494,9 @@ reshade::runtime::runtime(api::device *device, api::command_queue *graphics_queu
 
 	_needs_update = check_for_update(_latest_version);
 
+	// Keep one core free for the application, but always have at least one worker thread
+	_worker_pool = std::make_unique<thread_pool>(std::max<size_t>(std::thread::hardware_concurrency(), 2u) - 1);
+
 	// Default shortcut PrtScrn
 	_screenshot_key_data[0] = 0x2C;
 
@@ -199,7 +516,6 @@ reshade::runtime::runtime(api::device *device, api::command_queue *graphics_queu
 }
 reshade::runtime::~runtime()
 {
-	assert(_worker_threads.empty());
 #if RESHADE_FX
 	assert(!_is_initialized && _techniques.empty());
 #endif
@@ -502,10 +818,7 @@ void reshade::runtime::on_reset()
 	_device->destroy_resource_view(_effect_stencil_dsv);
 	_effect_stencil_dsv = {};
 #else
-	for (std::thread &thread : _worker_threads)
-		if (thread.joinable())
-			thread.join();
-	_worker_threads.clear();
+	_worker_pool->wait();
 #endif
 
 	_device->destroy_pipeline(_copy_pipeline);
@@ -761,6 +1074,8 @@ void reshade::runtime::load_config()
 
 	config.get("GENERAL", "NoDebugInfo", _no_debug_info);
 	config.get("GENERAL", "NoEffectCache", _no_effect_cache);
+	config.get("GENERAL", "EffectCacheCompression", _effect_cache_compression);
+	config.get("GENERAL", "EffectCacheSizeLimit", _effect_cache_size_limit);
 	config.get("GENERAL", "NoReloadOnInit", _no_reload_on_init);
 	config.get("GENERAL", "NoReloadOnInitForNonVR", _no_reload_for_non_vr);
 
@@ -785,6 +1100,20 @@ void reshade::runtime::load_config()
 		std::filesystem::create_directory(_intermediate_cache_path, ec);
 	}
 
+	// All cached data of an application is stored in a single pack file, so that different applications sharing the same cache directory do not compete for it
+	std::shared_ptr<cache_pack> effect_cache;
+	if (!_no_effect_cache)
+	{
+		effect_cache = cache_pack::open(g_reshade_base_path / _intermediate_cache_path / (L"reshade-" + g_target_executable_path.stem().native() + L".pack"));
+		if (effect_cache != nullptr)
+			effect_cache->configure(static_cast<uint64_t>(_effect_cache_size_limit) * 1024 * 1024, _effect_cache_compression);
+		else
+			LOG(WARN) << "Failed to open effect cache in " << _intermediate_cache_path << ", effects will not be cached.";
+	}
+
+	// Effects may still be loading in the background when the configuration is reloaded
+	std::atomic_store(&_effect_cache, effect_cache);
+
 	// Use default if the preset file does not exist yet
 	if (!resolve_preset_path(_current_preset_path))
 		_current_preset_path = g_reshade_base_path / L"ReShadePreset.ini";
@@ -826,6 +1155,8 @@ void reshade::runtime::save_config() const
 
 	config.set("GENERAL", "NoDebugInfo", _no_debug_info);
 	config.set("GENERAL", "NoEffectCache", _no_effect_cache);
+	config.set("GENERAL", "EffectCacheCompression", _effect_cache_compression);
+	config.set("GENERAL", "EffectCacheSizeLimit", _effect_cache_size_limit);
 	config.set("GENERAL", "NoReloadOnInit", _no_reload_on_init);
 	config.set("GENERAL", "NoReloadOnInitForNonVR", _no_reload_for_non_vr);
 
@@ -869,7 +1200,7 @@ void reshade::runtime::save_config() const
 }
 
 #if RESHADE_FX
-void reshade::runtime::load_current_preset()
+void reshade::runtime::load_current_preset(size_t only_effect_index)
 {
 	_preset_save_successfull = true;
 
@@ -884,15 +1215,30 @@ void reshade::runtime::load_current_preset()
 	preset.get({}, "PreprocessorDefinitions", preset_preprocessor_definitions);
 
 	// Recompile effects if preprocessor definitions have changed or running in performance mode (in which case all preset values are compile-time constants)
-	if (_reload_remaining_effects != 0) // ... unless this is the 'load_current_preset' call in 'update_effects'
+	if (_reload_remaining_effects != 0 && only_effect_index == std::numeric_limits<size_t>::max()) // ... unless this is one of the 'load_current_preset' calls in 'update_effects'
 	{
-		if (_performance_mode || preset_preprocessor_definitions != _preset_preprocessor_definitions)
+		if (_performance_mode && preset_preprocessor_definitions != _preset_preprocessor_definitions)
 		{
 			_preset_preprocessor_definitions = std::move(preset_preprocessor_definitions);
 			reload_effects();
 			return; // Preset values are loaded in 'update_effects' during effect loading
 		}
 
+		// Collect names of all definitions that were added, removed or changed value
+		std::unordered_set<std::string> changed_definitions;
+		if (preset_preprocessor_definitions != _preset_preprocessor_definitions)
+		{
+			const auto collect_changed_definitions = [&changed_definitions](const std::vector<std::string> &definitions, const std::vector<std::string> &other_definitions) {
+				for (const std::string &definition : definitions)
+					if (std::find(other_definitions.begin(), other_definitions.end(), definition) == other_definitions.end())
+						changed_definitions.insert(definition.substr(0, definition.find('=')));
+			};
+			collect_changed_definitions(preset_preprocessor_definitions, _preset_preprocessor_definitions);
+			collect_changed_definitions(_preset_preprocessor_definitions, preset_preprocessor_definitions);
+
+			_preset_preprocessor_definitions = std::move(preset_preprocessor_definitions);
+		}
+
 		if (std::find_if(technique_list.begin(), technique_list.end(), [this](const std::string &technique_name) {
 				if (const size_t at_pos = technique_name.find('@'); at_pos == std::string::npos)
 					return true;
@@ -905,6 +1251,59 @@ void reshade::runtime::load_current_preset()
 			reload_effects();
 			return;
 		}
+
+		if (!changed_definitions.empty())
+		{
+			// Only reload effects that actually depend on one of the definitions that changed
+			std::vector<size_t> effects_to_reload;
+			for (size_t effect_index = 0; effect_index < _effects.size(); ++effect_index)
+			{
+				const effect &effect = _effects[effect_index];
+				if (effect.skipped)
+					continue; // Skipped effects are loaded from scratch with the current definitions once they are needed
+
+				// Effects that failed to pre-process (or were loaded from a cache written without a list of macros) have no record of the macros they depend on, so always reload those
+				if (effect.referenced_definitions_known && std::none_of(changed_definitions.begin(), changed_definitions.end(),
+						[&effect](const std::string &name) { return effect.referenced_definitions.find(name) != effect.referenced_definitions.end(); }))
+					continue;
+
+				effects_to_reload.push_back(effect_index);
+			}
+
+			if (!effects_to_reload.empty())
+			{
+				reload_effects(effects_to_reload);
+				return; // Preset values are loaded in 'update_effects' after the reloaded effects finished loading
+			}
+		}
+
+		if (_performance_mode)
+		{
+			// Only the values of specialization constants may have changed, so reload effects from the modules that were compiled before, which only compiles the shaders again (see 'load_effect')
+			// Skip effects whose specialization constants have the same values in the new preset, since they would result in the same shaders
+			std::vector<size_t> effects_to_reload;
+			for (size_t effect_index = 0; effect_index < _effects.size(); ++effect_index)
+			{
+				const effect &effect = _effects[effect_index];
+				if (effect.skipped)
+					continue;
+
+				if (effect.unspecialized_module != nullptr)
+				{
+					std::vector<reshadefx::uniform_info> spec_constants = effect.unspecialized_module->spec_constants;
+					if (apply_spec_constant_values(spec_constants, preset, effect.source_file.filename().u8string()) == effect.spec_constants_hash)
+						continue;
+				}
+
+				effects_to_reload.push_back(effect_index);
+			}
+
+			if (!effects_to_reload.empty())
+			{
+				reload_effects(effects_to_reload);
+				return; // Preset values are loaded in 'update_effects' after the reloaded effects finished loading
+			}
+		}
 	}
 
 	if (sorted_technique_list.empty())
@@ -936,6 +1335,10 @@ void reshade::runtime::load_current_preset()
 
 	for (effect &effect : _effects)
 	{
+		// Only touch the specified effect, since others may still be loading
+		if (only_effect_index != std::numeric_limits<size_t>::max() && &effect != &_effects[only_effect_index])
+			continue;
+
 		for (uniform &variable : effect.uniforms)
 		{
 			if (variable.special != special_uniform::none)
@@ -988,6 +1391,9 @@ void reshade::runtime::load_current_preset()
 
 	for (technique &tech : _techniques)
 	{
+		if (only_effect_index != std::numeric_limits<size_t>::max() && tech.effect_index != only_effect_index)
+			continue;
+
 		const std::string unique_name =
 			tech.name + '@' + _effects[tech.effect_index].source_file.filename().u8string();
 
@@ -1010,7 +1416,8 @@ void reshade::runtime::load_current_preset()
 	}
 
 	// Reverse queue so that effects are enabled in the order they are defined in the preset (since the queue is worked from back to front)
-	std::reverse(_reload_create_queue.begin(), _reload_create_queue.end());
+	if (only_effect_index == std::numeric_limits<size_t>::max())
+		std::reverse(_reload_create_queue.begin(), _reload_create_queue.end());
 }
 void reshade::runtime::save_current_preset() const
 {
@@ -1156,6 +1563,10 @@ bool reshade::runtime::switch_to_next_preset(std::filesystem::path filter_path,
 
 bool reshade::runtime::load_effect(const std::filesystem::path &source_file, const ini_file &preset, size_t effect_index, bool preprocess_required)
 {
+	// Intern source file names into the pool of the current reload, so that they are freed again once its effects are destroyed, while copying them stays a plain pointer copy
+	assert(_string_pool != nullptr);
+	const reshadefx::string_pool::scope string_pool_scope(*_string_pool);
+
 	// Generate a unique string identifying this effect
 	std::string attributes;
 	attributes += "app=" + g_target_executable_path.stem().u8string() + ';';
@@ -1168,47 +1579,18 @@ bool reshade::runtime::load_effect(const std::filesystem::path &source_file, con
 	attributes += "vendor=" + std::to_string(_vendor_id) + ';';
 	attributes += "device=" + std::to_string(_device_id) + ';';
 
+	const std::shared_ptr<const search_path_snapshot> snapshot = std::atomic_load(&_search_path_snapshot);
+	assert(snapshot != nullptr);
+
 	std::set<std::filesystem::path> include_paths;
 	if (source_file.is_absolute())
 		include_paths.emplace(source_file.parent_path());
-	for (std::filesystem::path include_path : _effect_search_paths)
-	{
-		const bool recursive_search = include_path.filename() == L"**";
-		if (recursive_search)
-			include_path.remove_filename();
-
-		if (resolve_path(include_path))
-		{
-			include_paths.emplace(include_path);
-
-			if (recursive_search)
-			{
-				std::error_code ec;
-				for (const std::filesystem::directory_entry &entry : std::filesystem::recursive_directory_iterator(include_path, std::filesystem::directory_options::skip_permission_denied, ec))
-					if (entry.is_directory(ec))
-						include_paths.emplace(entry);
-			}
-		}
-	}
+	for (const size_t directory_index : snapshot->effect_directories)
+		include_paths.emplace(snapshot->directories[directory_index].path);
 
+	// The files the effect actually depends on are tracked separately (see below), so only the list of paths they are looked up in is part of the attributes
 	for (const std::filesystem::path &include_path : include_paths)
-	{
-		std::error_code ec;
-
-		attributes += include_path.u8string();
-		for (const auto &entry : std::filesystem::directory_iterator(include_path, std::filesystem::directory_options::skip_permission_denied, ec))
-		{
-			const std::filesystem::path filename = entry.path().filename();
-			if (filename == source_file.filename() || filename.extension() == L".fxh")
-			{
-				attributes += ',';
-				attributes += filename.u8string();
-				attributes += '?';
-				attributes += std::to_string(entry.last_write_time(ec).time_since_epoch().count());
-			}
-		}
-		attributes += ';';
-	}
+		attributes += include_path.u8string() + ';';
 
 	std::vector<std::string> preprocessor_definitions = _global_preprocessor_definitions;
 	// Insert preset preprocessor definitions before global ones, so that if there are duplicates, the preset ones are used (since 'add_macro_definition' succeeds only for the first occurance)
@@ -1216,19 +1598,51 @@ bool reshade::runtime::load_effect(const std::filesystem::path &source_file, con
 	for (const std::string &definition : preprocessor_definitions)
 		attributes += definition + ';';
 
-	const size_t source_hash = std::hash<std::string>()(attributes);
+	const size_t attributes_hash = std::hash<std::string>()(attributes);
 
 	effect &effect = _effects[effect_index];
 	const std::string effect_name = source_file.filename().u8string();
-	if (source_file != effect.source_file || source_hash != effect.source_hash)
+
+	// The source hash combines the attributes with the contents of the source file and all files it included the last time it was pre-processed, which are listed in a dependency list that is kept with the effect and in the cache
+	// Validating it only requires querying the modification time of each of those files, and only those that were modified are read again to update their hash
+	const std::string dependencies_cache_id = source_file.stem().u8string() + '-' + std::to_string(_renderer_id) + '-' + std::to_string(attributes_hash);
+
+	std::string dependencies;
+	if (source_file == effect.source_file && attributes_hash == effect.attributes_hash)
+		dependencies = effect.dependencies;
+	else
+		load_effect_cache(dependencies_cache_id, "deps", dependencies);
+
+	size_t source_hash = 0; // Zero if the dependencies are not known, in which case the effect has to be pre-processed again
+	if (bool dependencies_modified = false;
+		!dependencies.empty() && update_effect_dependencies(*snapshot, dependencies, dependencies_modified))
+	{
+		source_hash = hash_effect_dependencies(attributes_hash, dependencies);
+
+		if (dependencies_modified)
+			save_effect_cache(dependencies_cache_id, "deps", dependencies);
+	}
+	else
+	{
+		dependencies.clear();
+	}
+
+	if (source_file != effect.source_file || attributes_hash != effect.attributes_hash || source_hash != effect.source_hash || source_hash == 0)
 	{
 		// Source hash has changed, reset effect and load from scratch, rather than updating
 		effect = {};
 		effect.source_file = source_file;
 		effect.source_hash = source_hash;
+		effect.attributes_hash = attributes_hash;
 	}
 
-	if (_effect_load_skipping && !_load_option_disable_skipping && !_worker_threads.empty()) // Only skip during 'load_effects'
+	effect.dependencies = dependencies;
+
+	// Restore the macros the effect depends on from the dependency list, so that effects loaded from the cache are not reloaded when a definition they do not reference changes either
+	if (parse_effect_referenced_macros(dependencies, effect.referenced_definitions))
+		effect.referenced_definitions_known = true;
+
+	if (_effect_load_skipping && !_load_option_disable_skipping && is_loading() && _reload_remaining_effects != 0) // Only skip during 'load_effects'
 	{
 		if (std::vector<std::string> techniques;
 			preset.get({}, "Techniques", techniques))
@@ -1249,53 +1663,90 @@ bool reshade::runtime::load_effect(const std::filesystem::path &source_file, con
 	bool skip_optimization = false;
 	std::string pragma_warnings;
 
-	bool source_cached = false; std::string source;
-	if (!effect.preprocessed && (preprocess_required || (source_cached = load_effect_cache(source_file.stem().u8string() + '-' + std::to_string(_renderer_id) + '-' + std::to_string(source_hash), "i", source)) == false))
-	{
-		reshadefx::preprocessor pp;
-		pp.add_macro_definition("__RESHADE__", std::to_string(VERSION_MAJOR * 10000 + VERSION_MINOR * 100 + VERSION_REVISION));
-		pp.add_macro_definition("__RESHADE_PERFORMANCE_MODE__", _performance_mode ? "1" : "0");
-		pp.add_macro_definition("__VENDOR__", std::to_string(_vendor_id));
-		pp.add_macro_definition("__DEVICE__", std::to_string(_device_id));
-		pp.add_macro_definition("__RENDERER__", std::to_string(_renderer_id));
-		pp.add_macro_definition("__APPLICATION__", std::to_string( // Truncate hash to 32-bit, since lexer currently only supports 32-bit numbers anyway
-			std::hash<std::string>()(g_target_executable_path.stem().u8string()) & 0xFFFFFFFF));
-		pp.add_macro_definition("BUFFER_WIDTH", std::to_string(_width));
-		pp.add_macro_definition("BUFFER_HEIGHT", std::to_string(_height));
-		pp.add_macro_definition("BUFFER_RCP_WIDTH", "(1.0 / BUFFER_WIDTH)");
-		pp.add_macro_definition("BUFFER_RCP_HEIGHT", "(1.0 / BUFFER_HEIGHT)");
-		pp.add_macro_definition("BUFFER_COLOR_SPACE", std::to_string(static_cast<uint32_t>(_back_buffer_color_space)));
-		pp.add_macro_definition("BUFFER_COLOR_BIT_DEPTH", std::to_string(format_color_bit_depth(_back_buffer_format)));
-
-		for (const std::string &definition : preprocessor_definitions)
+	// The effect module additionally depends on whether debug information is generated
+	std::string module_cache_id = source_file.stem().u8string() + '-' + std::to_string(_renderer_id) + '-' + std::to_string(source_hash) + (_no_debug_info ? "-0" : "-1");
+
+	bool source_cached = false, module_loaded = false; std::string source; std::vector<reshadefx::token> source_tokens;
+
+	// Reuse the module that was compiled before if the effect is reloaded only because the values of specialization constants changed (see 'load_current_preset')
+	if (effect.unspecialized_module != nullptr && !preprocess_required)
+	{
+		effect.module = *effect.unspecialized_module;
+		effect.errors.clear();
+		effect.compiled = source_cached = module_loaded = true;
+	}
+	// Try to load the effect module from the cache next, in which case neither pre-processing nor compiling the effect is necessary
+	else if (!effect.preprocessed && !effect.compiled && !preprocess_required && source_hash != 0)
+	{
+		if (std::string module_data;
+			load_effect_cache(module_cache_id, "module", module_data) && reshadefx::deserialize_module(module_data, effect.module))
+			effect.compiled = source_cached = module_loaded = true;
+	}
+
+	if (!effect.preprocessed && !module_loaded && (preprocess_required || source_hash == 0 || (source_cached = load_effect_cache(source_file.stem().u8string() + '-' + std::to_string(_renderer_id) + '-' + std::to_string(source_hash), "i", source)) == false))
+	{
+		std::shared_ptr<const reshadefx::preprocessor> pp_base;
 		{
-			if (definition.empty() || definition == "=")
-				continue; // Skip invalid definitions
-
-			const size_t equals_index = definition.find('=');
-			if (equals_index != std::string::npos)
-				pp.add_macro_definition(
-					definition.substr(0, equals_index),
-					definition.substr(equals_index + 1));
-			else
-				pp.add_macro_definition(definition);
+			const std::unique_lock<std::mutex> lock(_preprocessor_base_mutex);
+
+			// Build the preprocessor state that is the same for all effects only once and then fork it for every effect, until the definitions change
+			if (_preprocessor_base == nullptr || _preprocessor_base_definitions != preprocessor_definitions)
+			{
+				const auto base = std::make_shared<reshadefx::preprocessor>(_include_cache);
+				base->add_macro_definition("__RESHADE__", std::to_string(VERSION_MAJOR * 10000 + VERSION_MINOR * 100 + VERSION_REVISION));
+				base->add_macro_definition("__RESHADE_PERFORMANCE_MODE__", _performance_mode ? "1" : "0");
+				base->add_macro_definition("__VENDOR__", std::to_string(_vendor_id));
+				base->add_macro_definition("__DEVICE__", std::to_string(_device_id));
+				base->add_macro_definition("__RENDERER__", std::to_string(_renderer_id));
+				base->add_macro_definition("__APPLICATION__", std::to_string( // Truncate hash to 32-bit, since lexer currently only supports 32-bit numbers anyway
+					std::hash<std::string>()(g_target_executable_path.stem().u8string()) & 0xFFFFFFFF));
+				base->add_macro_definition("BUFFER_WIDTH", std::to_string(_width));
+				base->add_macro_definition("BUFFER_HEIGHT", std::to_string(_height));
+				base->add_macro_definition("BUFFER_RCP_WIDTH", "(1.0 / BUFFER_WIDTH)");
+				base->add_macro_definition("BUFFER_RCP_HEIGHT", "(1.0 / BUFFER_HEIGHT)");
+				base->add_macro_definition("BUFFER_COLOR_SPACE", std::to_string(static_cast<uint32_t>(_back_buffer_color_space)));
+				base->add_macro_definition("BUFFER_COLOR_BIT_DEPTH", std::to_string(format_color_bit_depth(_back_buffer_format)));
+
+				for (const std::string &definition : preprocessor_definitions)
+				{
+					if (definition.empty() || definition == "=")
+						continue; // Skip invalid definitions
+
+					const size_t equals_index = definition.find('=');
+					if (equals_index != std::string::npos)
+						base->add_macro_definition(
+							definition.substr(0, equals_index),
+							definition.substr(equals_index + 1));
+					else
+						base->add_macro_definition(definition);
+				}
+
+				// Add some conversion macros for compatibility with older versions of ReShade
+				base->append_string(
+					"#define tex2Doffset(s, coords, offset) tex2D(s, coords, offset)\n"
+					"#define tex2Dlodoffset(s, coords, offset) tex2Dlod(s, coords, offset)\n"
+					"#define tex2Dgather(s, t, c) tex2Dgather##c(s, t)\n"
+					"#define tex2Dgatheroffset(s, t, o, c) tex2Dgather##c(s, t, o)\n"
+					"#define tex2Dgather0 tex2DgatherR\n"
+					"#define tex2Dgather1 tex2DgatherG\n"
+					"#define tex2Dgather2 tex2DgatherB\n"
+					"#define tex2Dgather3 tex2DgatherA\n");
+
+				_preprocessor_base = base;
+				_preprocessor_base_definitions = preprocessor_definitions;
+			}
+
+			pp_base = _preprocessor_base;
 		}
 
+		reshadefx::preprocessor pp(*pp_base);
+		pp.enable_output_tokens();
+
 		for (const std::filesystem::path &include_path : include_paths)
 			pp.add_include_path(include_path);
 
-		// Add some conversion macros for compatibility with older versions of ReShade
-		pp.append_string(
-			"#define tex2Doffset(s, coords, offset) tex2D(s, coords, offset)\n"
-			"#define tex2Dlodoffset(s, coords, offset) tex2Dlod(s, coords, offset)\n"
-			"#define tex2Dgather(s, t, c) tex2Dgather##c(s, t)\n"
-			"#define tex2Dgatheroffset(s, t, o, c) tex2Dgather##c(s, t, o)\n"
-			"#define tex2Dgather0 tex2DgatherR\n"
-			"#define tex2Dgather1 tex2DgatherG\n"
-			"#define tex2Dgather2 tex2DgatherB\n"
-			"#define tex2Dgather3 tex2DgatherA\n");
-
-		// Load and preprocess the source file
+		// Load and preprocess the source file (which collects the referenced macros again)
+		effect.referenced_definitions_known = false;
 		effect.preprocessed = pp.append_file(source_file);
 
 		// Append preprocessor errors to the error list
@@ -1304,6 +1755,46 @@ bool reshade::runtime::load_effect(const std::filesystem::path &source_file, con
 		if (effect.preprocessed)
 		{
 			source = std::move(pp.output());
+			source_tokens = std::move(pp.output_tokens());
+
+			// Update the dependency list with the files that were actually read, sorted by path so that the source hash does not depend on the include order
+			// The hashes are those of the data the preprocessor read (with the modification time queried before reading it), so they always match the output cached under them
+			const reshadefx::include_cache::file *source_file_contents = nullptr;
+			std::vector<std::pair<std::filesystem::path, const reshadefx::include_cache::file *>> included_files;
+			for (const auto &[path, file] : pp.included_file_contents())
+				if (std::filesystem::path included_file = std::filesystem::u8path(path); included_file == source_file)
+					source_file_contents = &file;
+				else
+					included_files.emplace_back(std::move(included_file), &file);
+			std::sort(included_files.begin(), included_files.end(),
+				[](const auto &lhs, const auto &rhs) { return lhs.first < rhs.first; });
+
+			assert(source_file_contents != nullptr);
+
+			dependencies.clear();
+			append_effect_dependency(dependencies, source_file, source_file_contents->last_write_time.time_since_epoch().count(), source_file_contents->hash);
+			for (const auto &[path, file] : included_files)
+				append_effect_dependency(dependencies, path, file->last_write_time.time_since_epoch().count(), file->hash);
+
+			std::vector<std::filesystem::path> missing_files;
+			for (const std::string &path : pp.missing_include_files())
+				missing_files.push_back(std::filesystem::u8path(path));
+			std::sort(missing_files.begin(), missing_files.end());
+			for (const std::filesystem::path &path : missing_files)
+				append_effect_missing_dependency(dependencies, path);
+
+			source_hash = hash_effect_dependencies(attributes_hash, dependencies);
+			module_cache_id = source_file.stem().u8string() + '-' + std::to_string(_renderer_id) + '-' + std::to_string(source_hash) + (_no_debug_info ? "-0" : "-1");
+
+			// Keep track of all macros the output depends on, so that changing a definition only reloads the effects that reference it
+			// These are stored with the dependency list, so that this also works for effects that are loaded from the cache next time
+			effect.referenced_definitions = pp.referenced_macros();
+			effect.referenced_definitions_known = true;
+			append_effect_referenced_macros(dependencies, effect.referenced_definitions);
+
+			effect.source_hash = source_hash;
+			effect.dependencies = dependencies;
+			save_effect_cache(dependencies_cache_id, "deps", dependencies);
 
 			for (const auto &pragma : pp.used_pragmas())
 			{
@@ -1340,9 +1831,10 @@ bool reshade::runtime::load_effect(const std::filesystem::path &source_file, con
 
 			std::sort(effect.definitions.begin(), effect.definitions.end());
 
-			// Keep track of included files
-			effect.included_files = pp.included_files();
-			std::sort(effect.included_files.begin(), effect.included_files.end()); // Sort file names alphabetically
+			// Keep track of included files (without the source file itself, and already sorted alphabetically)
+			effect.included_files.clear();
+			for (const auto &[path, file] : included_files)
+				effect.included_files.push_back(path);
 		}
 	}
 
@@ -1366,12 +1858,12 @@ bool reshade::runtime::load_effect(const std::filesystem::path &source_file, con
 		else if (_renderer_id < 0x20000)
 			codegen.reset(reshadefx::create_codegen_glsl(false, !_no_debug_info, _performance_mode, false, true));
 		else // Vulkan uses SPIR-V input
-			codegen.reset(reshadefx::create_codegen_spirv(true, !_no_debug_info, _performance_mode, false, false));
+			codegen.reset(reshadefx::create_codegen_spirv(true, !_no_debug_info, _performance_mode, false, false, _performance_mode));
 
 		reshadefx::parser parser;
 
 		// Compile the pre-processed source code (try the compile even if the preprocessor step failed to get additional error information)
-		effect.compiled = parser.parse(std::move(source), codegen.get());
+		effect.compiled = parser.parse(std::move(source), std::move(source_tokens), codegen.get());
 
 		// Append parser errors to the error list
 		effect.errors  += parser.errors();
@@ -1379,536 +1871,581 @@ bool reshade::runtime::load_effect(const std::filesystem::path &source_file, con
 		// Write result to effect module
 		codegen->write_result(effect.module);
 
-		if (effect.compiled)
+		module_loaded = effect.compiled;
+
+		// Only cache modules of effects that compiled without warnings and whose pre-processed source could be cached too (so no pragmas were used), since neither of those would be reported again on a cache hit
+		if (effect.compiled && source_cached && parser.errors().empty())
 		{
-			effect.uniforms.clear();
+			std::string module_data;
+			reshadefx::serialize_module(effect.module, module_data);
+			save_effect_cache(module_cache_id, "module", module_data);
+		}
+	}
 
-			// Create space for all variables (aligned to 16 bytes)
-			effect.uniform_data_storage.resize((effect.module.total_uniform_size + 15) & ~15);
+	if (module_loaded)
+	{
+		// Keep a copy of the module before the preset values are applied to it below in performance mode, unless there were warnings or pragmas that would not be reported again when it is reused
+		if (_performance_mode && source_cached && effect.errors.empty() && effect.unspecialized_module == nullptr)
+			effect.unspecialized_module = std::make_shared<const reshadefx::module>(effect.module);
 
-			for (uniform variable : effect.module.uniforms)
-			{
-				variable.effect_index = effect_index;
+		effect.uniforms.clear();
 
-				// Copy initial data into uniform storage area
-				reset_uniform_value(variable);
+		// Create space for all variables (aligned to 16 bytes)
+		effect.uniform_data_storage.resize((effect.module.total_uniform_size + 15) & ~15);
 
-				const std::string_view special = variable.annotation_as_string("source");
-				if (special.empty()) /* Ignore if annotation is missing */
-					variable.special = special_uniform::none;
-				else if (special == "frametime")
-					variable.special = special_uniform::frame_time;
-				else if (special == "framecount")
-					variable.special = special_uniform::frame_count;
-				else if (special == "random")
-					variable.special = special_uniform::random;
-				else if (special == "pingpong")
-					variable.special = special_uniform::ping_pong;
-				else if (special == "date")
-					variable.special = special_uniform::date;
-				else if (special == "timer")
-					variable.special = special_uniform::timer;
-				else if (special == "key")
-					variable.special = special_uniform::key;
-				else if (special == "mousepoint")
-					variable.special = special_uniform::mouse_point;
-				else if (special == "mousedelta")
-					variable.special = special_uniform::mouse_delta;
-				else if (special == "mousebutton")
-					variable.special = special_uniform::mouse_button;
-				else if (special == "mousewheel")
-					variable.special = special_uniform::mouse_wheel;
-				else if (special == "freepie")
-					variable.special = special_uniform::freepie;
-				else if (special == "ui_open" || special == "overlay_open")
-					variable.special = special_uniform::overlay_open;
-				else if (special == "ui_active" || special == "overlay_active")
-					variable.special = special_uniform::overlay_active;
-				else if (special == "ui_hovered" || special == "overlay_hovered")
-					variable.special = special_uniform::overlay_hovered;
-				else
-					variable.special = special_uniform::unknown;
+		for (uniform variable : effect.module.uniforms)
+		{
+			variable.effect_index = effect_index;
+
+			// Copy initial data into uniform storage area
+			reset_uniform_value(variable);
+
+			const std::string_view special = variable.annotation_as_string("source");
+			if (special.empty()) /* Ignore if annotation is missing */
+				variable.special = special_uniform::none;
+			else if (special == "frametime")
+				variable.special = special_uniform::frame_time;
+			else if (special == "framecount")
+				variable.special = special_uniform::frame_count;
+			else if (special == "random")
+				variable.special = special_uniform::random;
+			else if (special == "pingpong")
+				variable.special = special_uniform::ping_pong;
+			else if (special == "date")
+				variable.special = special_uniform::date;
+			else if (special == "timer")
+				variable.special = special_uniform::timer;
+			else if (special == "key")
+				variable.special = special_uniform::key;
+			else if (special == "mousepoint")
+				variable.special = special_uniform::mouse_point;
+			else if (special == "mousedelta")
+				variable.special = special_uniform::mouse_delta;
+			else if (special == "mousebutton")
+				variable.special = special_uniform::mouse_button;
+			else if (special == "mousewheel")
+				variable.special = special_uniform::mouse_wheel;
+			else if (special == "freepie")
+				variable.special = special_uniform::freepie;
+			else if (special == "ui_open" || special == "overlay_open")
+				variable.special = special_uniform::overlay_open;
+			else if (special == "ui_active" || special == "overlay_active")
+				variable.special = special_uniform::overlay_active;
+			else if (special == "ui_hovered" || special == "overlay_hovered")
+				variable.special = special_uniform::overlay_hovered;
+			else
+				variable.special = special_uniform::unknown;
 
-				effect.uniforms.push_back(std::move(variable));
-			}
+			effect.uniforms.push_back(std::move(variable));
+		}
 
-			// Fill all specialization constants with values from the current preset
-			if (_performance_mode)
+		// Fill all specialization constants with values from the current preset
+		if (_performance_mode)
+		{
+			std::string preamble;
+
+			effect.spec_constants_hash = apply_spec_constant_values(effect.module.spec_constants, preset, effect_name);
+
+			for (const reshadefx::uniform_info &constant : effect.module.spec_constants)
 			{
-				std::string preamble;
+				if (effect.module.hlsl.empty())
+					continue;
 
-				for (reshadefx::uniform_info &constant : effect.module.spec_constants)
+				preamble += "#define SPEC_CONSTANT_" + constant.name + ' ';
+
+				for (unsigned int i = 0; i < constant.type.components(); ++i)
 				{
 					switch (constant.type.base)
 					{
+					case reshadefx::type::t_bool:
+						preamble += constant.initializer_value.as_uint[i] ? "true" : "false";
+						break;
 					case reshadefx::type::t_int:
-						preset.get(effect_name, constant.name, constant.initializer_value.as_int);
+						preamble += std::to_string(constant.initializer_value.as_int[i]);
 						break;
-					case reshadefx::type::t_bool:
 					case reshadefx::type::t_uint:
-						preset.get(effect_name, constant.name, constant.initializer_value.as_uint);
+						preamble += std::to_string(constant.initializer_value.as_uint[i]);
 						break;
 					case reshadefx::type::t_float:
-						preset.get(effect_name, constant.name, constant.initializer_value.as_float);
+						preamble += std::to_string(constant.initializer_value.as_float[i]);
 						break;
 					}
 
-					// Check if this is a split specialization constant and move data accordingly
-					if (constant.type.is_scalar() && constant.offset != 0)
-						constant.initializer_value.as_uint[0] = constant.initializer_value.as_uint[constant.offset];
-
-					if (effect.module.hlsl.empty())
-						continue;
-
-					preamble += "#define SPEC_CONSTANT_" + constant.name + ' ';
-
-					for (unsigned int i = 0; i < constant.type.components(); ++i)
-					{
-						switch (constant.type.base)
-						{
-						case reshadefx::type::t_bool:
-							preamble += constant.initializer_value.as_uint[i] ? "true" : "false";
-							break;
-						case reshadefx::type::t_int:
-							preamble += std::to_string(constant.initializer_value.as_int[i]);
-							break;
-						case reshadefx::type::t_uint:
-							preamble += std::to_string(constant.initializer_value.as_uint[i]);
-							break;
-						case reshadefx::type::t_float:
-							preamble += std::to_string(constant.initializer_value.as_float[i]);
-							break;
-						}
-
-						if (i + 1 < constant.type.components())
-							preamble += ", ";
-					}
-
-					preamble += '\n';
+					if (i + 1 < constant.type.components())
+						preamble += ", ";
 				}
 
-				effect.module.hlsl = preamble + effect.module.hlsl;
+				preamble += '\n';
 			}
+
+			effect.module.hlsl = preamble + effect.module.hlsl;
 		}
 	}
 
+	bool staged = false;
 	if ( effect.compiled && (effect.preprocessed || source_cached))
 	{
 		// Compile shader modules
-		for (const reshadefx::entry_point &entry_point : effect.module.entry_points)
+		if (!_device->check_capability(api::device_caps::compute_shader) &&
+			std::any_of(effect.module.entry_points.cbegin(), effect.module.entry_points.cend(),
+				[](const reshadefx::entry_point &entry_point) { return entry_point.type == reshadefx::shader_type::cs; }))
 		{
-			if (entry_point.type == reshadefx::shader_type::cs && !_device->check_capability(api::device_caps::compute_shader))
-			{
-				effect.errors += "Compute shaders are not supported in D3D9/D3D10.";
-				effect.compiled = false;
-				break;
-			}
+			effect.errors += "Compute shaders are not supported in D3D9/D3D10.";
+			effect.compiled = false;
+		}
+		else
+		{
+			// Add all entries before compiling, so that the tasks below only access existing elements and never modify the map itself
+			for (const reshadefx::entry_point &entry_point : effect.module.entry_points)
+				effect.assembly[entry_point.name];
 
-			auto &assembly = effect.assembly[entry_point.name];
-			std::string &cso = assembly.first;
-			std::string &cso_text = assembly.second;
+			std::vector<std::string> entry_point_errors(effect.module.entry_points.size());
+			std::vector<uint8_t> entry_point_failed(effect.module.entry_points.size());
 
-			if ((_renderer_id & 0xF0000) == 0)
-			{
-				assert(_d3d_compiler_module != nullptr);
-
-				// Add specialization constant defines to source code
-				const std::string hlsl =
-					pragma_warnings +
-					"#define COLOR_PIXEL_SIZE 1.0 / " + std::to_string(_width) + ", 1.0 / " + std::to_string(_height) + "\n"
-					"#define DEPTH_PIXEL_SIZE COLOR_PIXEL_SIZE\n"
-					"#define SV_DEPTH_PIXEL_SIZE DEPTH_PIXEL_SIZE\n"
-					"#define SV_TARGET_PIXEL_SIZE COLOR_PIXEL_SIZE\n"
-					"#line 1\n" + // Reset line number, so it matches what is shown when viewing the generated code
-					effect.module.hlsl;
-
-				// Overwrite position semantic in pixel shaders
-				const D3D_SHADER_MACRO ps_defines[] = {
-					{ "POSITION", "VPOS" }, { nullptr, nullptr }
-				};
+			// Compile entry points in parallel too, since compiling effects with many passes can otherwise hold up a worker thread for a long time
+			_worker_pool->parallel_for(effect.module.entry_points.size(), [&](size_t entry_point_index) {
+				const reshadefx::entry_point &entry_point = effect.module.entry_points[entry_point_index];
 
-				std::string profile;
-				switch (entry_point.type)
-				{
-				case reshadefx::shader_type::vs:
-					profile = "vs";
-					break;
-				case reshadefx::shader_type::ps:
-					profile = "ps";
-					break;
-				case reshadefx::shader_type::cs:
-					profile = "cs";
-					break;
-				}
+				auto &assembly = effect.assembly.at(entry_point.name);
+				std::string &cso = assembly.first;
+				std::string &cso_text = assembly.second;
 
-				switch (_renderer_id)
+				if ((_renderer_id & 0xF0000) == 0)
 				{
-				default:
-				case D3D_FEATURE_LEVEL_11_0:
-					profile += "_5_0";
-					break;
-				case D3D_FEATURE_LEVEL_10_1:
-					profile += "_4_1";
-					break;
-				case D3D_FEATURE_LEVEL_10_0:
-					profile += "_4_0";
-					break;
-				case D3D_FEATURE_LEVEL_9_1:
-				case D3D_FEATURE_LEVEL_9_2:
-					profile += "_4_0_level_9_1";
-					break;
-				case D3D_FEATURE_LEVEL_9_3:
-					profile += "_4_0_level_9_3";
-					break;
-				case 0x9000:
-					profile += "_3_0";
-					break;
-				}
+					assert(_d3d_compiler_module != nullptr);
+
+					// Add specialization constant defines to source code
+					const std::string hlsl =
+						pragma_warnings +
+						"#define COLOR_PIXEL_SIZE 1.0 / " + std::to_string(_width) + ", 1.0 / " + std::to_string(_height) + "\n"
+						"#define DEPTH_PIXEL_SIZE COLOR_PIXEL_SIZE\n"
+						"#define SV_DEPTH_PIXEL_SIZE DEPTH_PIXEL_SIZE\n"
+						"#define SV_TARGET_PIXEL_SIZE COLOR_PIXEL_SIZE\n"
+						"#line 1\n" + // Reset line number, so it matches what is shown when viewing the generated code
+						effect.module.hlsl;
+
+					// Define the entry point name, so that code only other entry points depend on is skipped, and overwrite position semantic in pixel shaders
+					const std::string entry_point_define = "ENTRY_POINT_" + entry_point.name;
+					const D3D_SHADER_MACRO defines[] = {
+						{ entry_point_define.c_str(), "1" },
+						{ entry_point.type == reshadefx::shader_type::ps ? "POSITION" : nullptr, "VPOS" },
+						{ nullptr, nullptr }
+					};
 
-				UINT compile_flags = 0;
-				if (skip_optimization)
-					compile_flags |= D3DCOMPILE_SKIP_OPTIMIZATION;
-				else if (_performance_mode)
-					compile_flags |= D3DCOMPILE_OPTIMIZATION_LEVEL3;
-				if (_renderer_id >= D3D_FEATURE_LEVEL_10_0)
-					compile_flags |= D3DCOMPILE_ENABLE_STRICTNESS;
+					std::string profile;
+					switch (entry_point.type)
+					{
+					case reshadefx::shader_type::vs:
+						profile = "vs";
+						break;
+					case reshadefx::shader_type::ps:
+						profile = "ps";
+						break;
+					case reshadefx::shader_type::cs:
+						profile = "cs";
+						break;
+					}
+
+					switch (_renderer_id)
+					{
+					default:
+					case D3D_FEATURE_LEVEL_11_0:
+						profile += "_5_0";
+						break;
+					case D3D_FEATURE_LEVEL_10_1:
+						profile += "_4_1";
+						break;
+					case D3D_FEATURE_LEVEL_10_0:
+						profile += "_4_0";
+						break;
+					case D3D_FEATURE_LEVEL_9_1:
+					case D3D_FEATURE_LEVEL_9_2:
+						profile += "_4_0_level_9_1";
+						break;
+					case D3D_FEATURE_LEVEL_9_3:
+						profile += "_4_0_level_9_3";
+						break;
+					case 0x9000:
+						profile += "_3_0";
+						break;
+					}
+
+					UINT compile_flags = 0;
+					if (skip_optimization)
+						compile_flags |= D3DCOMPILE_SKIP_OPTIMIZATION;
+					else if (_performance_mode)
+						compile_flags |= D3DCOMPILE_OPTIMIZATION_LEVEL3;
+					if (_renderer_id >= D3D_FEATURE_LEVEL_10_0)
+						compile_flags |= D3DCOMPILE_ENABLE_STRICTNESS;
 #ifndef NDEBUG
-				compile_flags |= D3DCOMPILE_DEBUG;
+					compile_flags |= D3DCOMPILE_DEBUG;
 #endif
 
-				std::string hlsl_attributes;
-				hlsl_attributes += "entrypoint=" + entry_point.name + ';';
-				hlsl_attributes += "profile=" + profile + ';';
-				hlsl_attributes += "flags=" + std::to_string(compile_flags) + ';';
+					std::string hlsl_attributes;
+					hlsl_attributes += "entrypoint=" + entry_point.name + ';';
+					hlsl_attributes += "profile=" + profile + ';';
+					hlsl_attributes += "flags=" + std::to_string(compile_flags) + ';';
 
-				const std::string cache_id =
-					effect.source_file.stem().u8string() + '-' + entry_point.name + '-' + std::to_string(_renderer_id) + '-' +
-					std::to_string(std::hash<std::string_view>()(hlsl_attributes) ^ std::hash<std::string_view>()(hlsl));
+					const std::string cache_id =
+						effect.source_file.stem().u8string() + '-' + entry_point.name + '-' + std::to_string(_renderer_id) + '-' +
+						std::to_string(std::hash<std::string_view>()(hlsl_attributes) ^ std::hash<std::string_view>()(hlsl));
 
-				if (!load_effect_cache(cache_id, "cso", cso))
-				{
-					const auto D3DCompile = reinterpret_cast<pD3DCompile>(GetProcAddress(static_cast<HMODULE>(_d3d_compiler_module), "D3DCompile"));
-					assert(D3DCompile != nullptr);
-
-					com_ptr<ID3DBlob> d3d_compiled, d3d_errors;
-					const HRESULT hr = D3DCompile(
-						hlsl.data(), hlsl.size(),
-						nullptr, entry_point.type == reshadefx::shader_type::ps ? ps_defines : nullptr, nullptr,
-						entry_point.name.c_str(),
-						profile.c_str(),
-						compile_flags, 0,
-						&d3d_compiled, &d3d_errors);
-
-					std::string d3d_errors_string;
-					if (d3d_errors != nullptr) // Append warnings to the output error string as well
-						d3d_errors_string.assign(static_cast<const char *>(d3d_errors->GetBufferPointer()), d3d_errors->GetBufferSize() - 1); // Subtracting one to not append the null-terminator as well
-
-					// De-duplicate error lines (D3DCompiler sometimes repeats the same error multiple times)
-					for (size_t line_offset = 0, next_line_offset;
-						(next_line_offset = d3d_errors_string.find('\n', line_offset)) != std::string::npos; line_offset = next_line_offset + 1)
+					if (!load_effect_cache(cache_id, "cso", cso))
 					{
-						const std::string_view cur_line(d3d_errors_string.c_str() + line_offset, next_line_offset - line_offset);
-
-						if (const size_t end_offset = d3d_errors_string.find('\n', next_line_offset + 1);
-							end_offset != std::string::npos)
+						const auto D3DCompile = reinterpret_cast<pD3DCompile>(GetProcAddress(static_cast<HMODULE>(_d3d_compiler_module), "D3DCompile"));
+						assert(D3DCompile != nullptr);
+
+						com_ptr<ID3DBlob> d3d_compiled, d3d_errors;
+						const HRESULT hr = D3DCompile(
+							hlsl.data(), hlsl.size(),
+							nullptr, defines, nullptr,
+							entry_point.name.c_str(),
+							profile.c_str(),
+							compile_flags, 0,
+							&d3d_compiled, &d3d_errors);
+
+						std::string d3d_errors_string;
+						if (d3d_errors != nullptr) // Append warnings to the output error string as well
+							d3d_errors_string.assign(static_cast<const char *>(d3d_errors->GetBufferPointer()), d3d_errors->GetBufferSize() - 1); // Subtracting one to not append the null-terminator as well
+
+						// De-duplicate error lines (D3DCompiler sometimes repeats the same error multiple times)
+						for (size_t line_offset = 0, next_line_offset;
+							(next_line_offset = d3d_errors_string.find('\n', line_offset)) != std::string::npos; line_offset = next_line_offset + 1)
 						{
-							const std::string_view next_line(d3d_errors_string.c_str() + next_line_offset + 1, end_offset - next_line_offset - 1);
-							if (cur_line == next_line)
+							const std::string_view cur_line(d3d_errors_string.c_str() + line_offset, next_line_offset - line_offset);
+
+							if (const size_t end_offset = d3d_errors_string.find('\n', next_line_offset + 1);
+								end_offset != std::string::npos)
 							{
-								d3d_errors_string.erase(next_line_offset, end_offset - next_line_offset);
+								const std::string_view next_line(d3d_errors_string.c_str() + next_line_offset + 1, end_offset - next_line_offset - 1);
+								if (cur_line == next_line)
+								{
+									d3d_errors_string.erase(next_line_offset, end_offset - next_line_offset);
+									next_line_offset = line_offset - 1;
+								}
+							}
+
+							// Also remove D3DCompiler warnings about 'groupshared' specifier used in VS/PS modules
+							if (cur_line.find("X3579") != std::string_view::npos)
+							{
+								d3d_errors_string.erase(line_offset, next_line_offset + 1 - line_offset);
 								next_line_offset = line_offset - 1;
 							}
 						}
 
-						// Also remove D3DCompiler warnings about 'groupshared' specifier used in VS/PS modules
-						if (cur_line.find("X3579") != std::string_view::npos)
+						entry_point_errors[entry_point_index] = std::move(d3d_errors_string);
+
+						if (FAILED(hr))
 						{
-							d3d_errors_string.erase(line_offset, next_line_offset + 1 - line_offset);
-							next_line_offset = line_offset - 1;
+							entry_point_failed[entry_point_index] = true;
+							return;
 						}
+
+						cso.resize(d3d_compiled->GetBufferSize());
+						std::memcpy(cso.data(), d3d_compiled->GetBufferPointer(), cso.size());
+
+						save_effect_cache(cache_id, "cso", cso);
+					}
+
+					if (!load_effect_cache(cache_id, "asm", cso_text))
+					{
+						const auto D3DDisassemble = reinterpret_cast<pD3DDisassemble>(GetProcAddress(static_cast<HMODULE>(_d3d_compiler_module), "D3DDisassemble"));
+						assert(D3DDisassemble != nullptr);
+
+						if (com_ptr<ID3DBlob> d3d_disassembled; SUCCEEDED(D3DDisassemble(cso.data(), cso.size(), 0, nullptr, &d3d_disassembled)))
+							cso_text.assign(static_cast<const char *>(d3d_disassembled->GetBufferPointer()), d3d_disassembled->GetBufferSize() - 1);
+
+						save_effect_cache(cache_id, "asm", cso_text);
+					}
+				}
+				else if (effect.module.spirv.empty())
+				{
+					cso = "#version 430\n#define ENTRY_POINT_" + entry_point.name + " 1\n";
+
+					if (entry_point.type != reshadefx::shader_type::ps)
+					{
+						// OpenGL does not allow using 'discard' in the vertex shader profile
+						cso += "#define discard\n";
+						// 'dFdx', 'dFdx' and 'fwidth' too are only available in fragment shaders
+						cso += "#define dFdx(x) x\n";
+						cso += "#define dFdy(y) y\n";
+						cso += "#define fwidth(p) p\n";
+					}
+					if (entry_point.type != reshadefx::shader_type::cs)
+					{
+						// OpenGL does not allow using 'shared' in vertex/fragment shader profile
+						cso += "#define shared\n";
+						cso += "#define atomicAdd(a, b) a\n";
+						cso += "#define atomicAnd(a, b) a\n";
+						cso += "#define atomicOr(a, b) a\n";
+						cso += "#define atomicXor(a, b) a\n";
+						cso += "#define atomicMin(a, b) a\n";
+						cso += "#define atomicMax(a, b) a\n";
+						cso += "#define atomicExchange(a, b) a\n";
+						cso += "#define atomicCompSwap(a, b, c) a\n";
+						// Barrier intrinsics are only available in compute shaders
+						cso += "#define barrier()\n";
+						cso += "#define memoryBarrier()\n";
+						cso += "#define groupMemoryBarrier()\n";
 					}
 
-					effect.errors += d3d_errors_string;
+					cso += "#line 1 0\n"; // Reset line number, so it matches what is shown when viewing the generated code
+					cso += effect.module.hlsl;
 
-					if (FAILED(hr))
+					cso_text = cso;
+				}
+				else
+				{
+					assert(_renderer_id >= 0x14600); // Core since OpenGL 4.6 (see https://www.khronos.org/opengl/wiki/SPIR-V)
+
+					// There are various issues with SPIR-V modules that have multiple entry points on all major GPU vendors.
+					// On AMD for instance creating a graphics pipeline just fails with a generic VK_ERROR_OUT_OF_HOST_MEMORY. On NVIDIA artifacts occur on some driver versions.
+					// To work around these problems, create a separate shader module for every entry point and rewrite the SPIR-V module for each to remove all but a single entry point (and associated functions/variables).
+					uint32_t current_function = 0, current_function_offset = 0;
+					std::vector<uint32_t> spirv = effect.module.spirv; // Copy SPIR-V, so that all but the current entry point are only removed from that copy
+					std::vector<uint32_t> functions_to_remove, variables_to_remove;
+
+					for (uint32_t inst = 5 /* Skip SPIR-V header information */; inst < spirv.size();)
 					{
-						effect.compiled = false;
+						const uint32_t op = spirv[inst] & 0xFFFF;
+						const uint32_t len = (spirv[inst] >> 16) & 0xFFFF;
+						assert(len != 0);
 
-						d3d_errors.reset();
-						d3d_compiled.reset();
-						break;
+						switch (op)
+						{
+						case 15 /* OpEntryPoint */:
+							// Look for any non-matching entry points
+							if (entry_point.name != reinterpret_cast<const char *>(&spirv[inst + 3]))
+							{
+								functions_to_remove.push_back(spirv[inst + 2]);
+
+								// Get interface variables
+								for (uint32_t k = inst + 3 + static_cast<uint32_t>((strlen(reinterpret_cast<const char *>(&spirv[inst + 3])) + 4) / 4); k < inst + len; ++k)
+									variables_to_remove.push_back(spirv[k]);
+
+								// Remove this entry point from the module
+								spirv.erase(spirv.begin() + inst, spirv.begin() + inst + len);
+								continue;
+							}
+							break;
+						case 16 /* OpExecutionMode */:
+							if (std::find(functions_to_remove.begin(), functions_to_remove.end(), spirv[inst + 1]) != functions_to_remove.end())
+							{
+								spirv.erase(spirv.begin() + inst, spirv.begin() + inst + len);
+								continue;
+							}
+							break;
+						case 59 /* OpVariable */:
+							// Remove all declarations of the interface variables for non-matching entry points
+							if (std::find(variables_to_remove.begin(), variables_to_remove.end(), spirv[inst + 2]) != variables_to_remove.end())
+							{
+								spirv.erase(spirv.begin() + inst, spirv.begin() + inst + len);
+								continue;
+							}
+							break;
+						case 71 /* OpDecorate */:
+							// Remove all decorations targeting any of the interface variables for non-matching entry points
+							if (std::find(variables_to_remove.begin(), variables_to_remove.end(), spirv[inst + 1]) != variables_to_remove.end())
+							{
+								spirv.erase(spirv.begin() + inst, spirv.begin() + inst + len);
+								continue;
+							}
+							break;
+						case 54 /* OpFunction */:
+							current_function = spirv[inst + 2];
+							current_function_offset = inst;
+							break;
+						case 56 /* OpFunctionEnd */:
+							// Remove all function definitions for non-matching entry points
+							if (std::find(functions_to_remove.begin(), functions_to_remove.end(), current_function) != functions_to_remove.end())
+							{
+								spirv.erase(spirv.begin() + current_function_offset, spirv.begin() + inst + len);
+								inst = current_function_offset;
+								continue;
+							}
+							break;
+						}
+
+						inst += len;
 					}
 
-					cso.resize(d3d_compiled->GetBufferSize());
-					std::memcpy(cso.data(), d3d_compiled->GetBufferPointer(), cso.size());
+					cso.resize(spirv.size() * sizeof(uint32_t));
+					std::memcpy(cso.data(), spirv.data(), cso.size());
+				}
+			});
 
-					save_effect_cache(cache_id, "cso", cso);
+			// Report errors in entry point order and only up to the first entry point that failed to compile, same as when compiling them one after another
+			for (size_t entry_point_index = 0; entry_point_index < entry_point_errors.size(); ++entry_point_index)
+			{
+				effect.errors += entry_point_errors[entry_point_index];
+
+				if (entry_point_failed[entry_point_index])
+				{
+					effect.compiled = false;
+					break;
 				}
+			}
+		}
+
+		// Effects that are loaded in the background only leave their textures and techniques in the module, which are then added on the thread that renders effects (see 'update_effects')
+		if (is_loading() && _reload_remaining_effects != 0)
+			staged = true;
+		else
+			merge_effect_textures_and_techniques(effect_index);
+	}
+
+	const bool success = effect.compiled && (effect.preprocessed || source_cached);
+	if (success)
+	{
+		if (effect.errors.empty())
+			LOG(INFO) << "Successfully compiled " << source_file << '.';
+		else
+			LOG(WARN) << "Successfully compiled " << source_file << " with warnings:\n" << effect.errors;
+	}
+	else
+	{
+		_last_reload_successfull = false;
+
+		if (effect.errors.empty())
+			LOG(ERROR) << "Failed to compile " << source_file << '!';
+		else
+			LOG(ERROR) << "Failed to compile " << source_file << ":\n" << effect.errors;
+	}
+
+	// Hand the effect over to 'update_effects' only after it is no longer accessed here, so that it can be set up and rendered while other effects are still loading
+	if (is_loading() && _reload_remaining_effects != 0)
+	{
+		const std::unique_lock<std::shared_mutex> lock(_reload_mutex);
+		if (staged)
+			_reload_staged_effects.push_back(effect_index);
+		_reload_ready_effects.push_back(effect_index);
+	}
+
+	if (_reload_remaining_effects != 0 && _reload_remaining_effects != std::numeric_limits<size_t>::max())
+		_reload_remaining_effects--;
+	else
+		_reload_remaining_effects = 0; // Force effect initialization in 'update_effects'
 
-				if (!load_effect_cache(cache_id, "asm", cso_text))
-				{
-					const auto D3DDisassemble = reinterpret_cast<pD3DDisassemble>(GetProcAddress(static_cast<HMODULE>(_d3d_compiler_module), "D3DDisassemble"));
-					assert(D3DDisassemble != nullptr);
+	return success;
+}
+void reshade::runtime::merge_effect_textures_and_techniques(size_t effect_index)
+{
+	effect &effect = _effects[effect_index];
 
-					if (com_ptr<ID3DBlob> d3d_disassembled; SUCCEEDED(D3DDisassemble(cso.data(), cso.size(), 0, nullptr, &d3d_disassembled)))
-						cso_text.assign(static_cast<const char *>(d3d_disassembled->GetBufferPointer()), d3d_disassembled->GetBufferSize() - 1);
+	for (texture new_texture : effect.module.textures)
+	{
+		new_texture.effect_index = effect_index;
 
-					save_effect_cache(cache_id, "asm", cso_text);
-				}
-			}
-			else if (effect.module.spirv.empty())
+		// Try to share textures with the same name across effects
+		if (const auto existing_texture = std::find_if(_textures.begin(), _textures.end(),
+			[&new_texture](const auto &item) { return item.unique_name == new_texture.unique_name; });
+			existing_texture != _textures.end())
+		{
+			// Cannot share texture if this is a normal one, but the existing one is a reference and vice versa
+			if (new_texture.semantic != existing_texture->semantic)
 			{
-				cso = "#version 430\n#define ENTRY_POINT_" + entry_point.name + " 1\n";
-
-				if (entry_point.type != reshadefx::shader_type::ps)
-				{
-					// OpenGL does not allow using 'discard' in the vertex shader profile
-					cso += "#define discard\n";
-					// 'dFdx', 'dFdx' and 'fwidth' too are only available in fragment shaders
-					cso += "#define dFdx(x) x\n";
-					cso += "#define dFdy(y) y\n";
-					cso += "#define fwidth(p) p\n";
-				}
-				if (entry_point.type != reshadefx::shader_type::cs)
-				{
-					// OpenGL does not allow using 'shared' in vertex/fragment shader profile
-					cso += "#define shared\n";
-					cso += "#define atomicAdd(a, b) a\n";
-					cso += "#define atomicAnd(a, b) a\n";
-					cso += "#define atomicOr(a, b) a\n";
-					cso += "#define atomicXor(a, b) a\n";
-					cso += "#define atomicMin(a, b) a\n";
-					cso += "#define atomicMax(a, b) a\n";
-					cso += "#define atomicExchange(a, b) a\n";
-					cso += "#define atomicCompSwap(a, b, c) a\n";
-					// Barrier intrinsics are only available in compute shaders
-					cso += "#define barrier()\n";
-					cso += "#define memoryBarrier()\n";
-					cso += "#define groupMemoryBarrier()\n";
-				}
-
-				cso += "#line 1 0\n"; // Reset line number, so it matches what is shown when viewing the generated code
-				cso += effect.module.hlsl;
+				effect.errors += "error: " + new_texture.unique_name + ": another effect (";
+				effect.errors += _effects[existing_texture->effect_index].source_file.filename().u8string();
+				effect.errors += ") already created a texture with the same name but different semantic\n";
+				effect.compiled = false;
+				break;
+			}
 
-				cso_text = cso;
+			if (new_texture.semantic.empty() && !existing_texture->matches_description(new_texture))
+			{
+				effect.errors += "warning: " + new_texture.unique_name + ": another effect (";
+				effect.errors += _effects[existing_texture->effect_index].source_file.filename().u8string();
+				effect.errors += ") already created a texture with the same name but different dimensions\n";
 			}
-			else
+			if (new_texture.semantic.empty() && (existing_texture->annotation_as_string("source") != new_texture.annotation_as_string("source")))
 			{
-				assert(_renderer_id >= 0x14600); // Core since OpenGL 4.6 (see https://www.khronos.org/opengl/wiki/SPIR-V)
-
-				// There are various issues with SPIR-V modules that have multiple entry points on all major GPU vendors.
-				// On AMD for instance creating a graphics pipeline just fails with a generic VK_ERROR_OUT_OF_HOST_MEMORY. On NVIDIA artifacts occur on some driver versions.
-				// To work around these problems, create a separate shader module for every entry point and rewrite the SPIR-V module for each to remove all but a single entry point (and associated functions/variables).
-				uint32_t current_function = 0, current_function_offset = 0;
-				std::vector<uint32_t> spirv = effect.module.spirv; // Copy SPIR-V, so that all but the current entry point are only removed from that copy
-				std::vector<uint32_t> functions_to_remove, variables_to_remove;
+				effect.errors += "warning: " + new_texture.unique_name + ": another effect (";
+				effect.errors += _effects[existing_texture->effect_index].source_file.filename().u8string();
+				effect.errors += ") already created a texture with a different image file\n";
+			}
 
-				for (uint32_t inst = 5 /* Skip SPIR-V header information */; inst < spirv.size();)
+			if (existing_texture->semantic == "COLOR" && format_color_bit_depth(_back_buffer_format) != 8)
+			{
+				for (const auto &sampler_info : effect.module.samplers)
 				{
-					const uint32_t op = spirv[inst] & 0xFFFF;
-					const uint32_t len = (spirv[inst] >> 16) & 0xFFFF;
-					assert(len != 0);
-
-					switch (op)
+					if (sampler_info.srgb && sampler_info.texture_name == new_texture.unique_name)
 					{
-					case 15 /* OpEntryPoint */:
-						// Look for any non-matching entry points
-						if (entry_point.name != reinterpret_cast<const char *>(&spirv[inst + 3]))
-						{
-							functions_to_remove.push_back(spirv[inst + 2]);
-
-							// Get interface variables
-							for (uint32_t k = inst + 3 + static_cast<uint32_t>((strlen(reinterpret_cast<const char *>(&spirv[inst + 3])) + 4) / 4); k < inst + len; ++k)
-								variables_to_remove.push_back(spirv[k]);
-
-							// Remove this entry point from the module
-							spirv.erase(spirv.begin() + inst, spirv.begin() + inst + len);
-							continue;
-						}
-						break;
-					case 16 /* OpExecutionMode */:
-						if (std::find(functions_to_remove.begin(), functions_to_remove.end(), spirv[inst + 1]) != functions_to_remove.end())
-						{
-							spirv.erase(spirv.begin() + inst, spirv.begin() + inst + len);
-							continue;
-						}
-						break;
-					case 59 /* OpVariable */:
-						// Remove all declarations of the interface variables for non-matching entry points
-						if (std::find(variables_to_remove.begin(), variables_to_remove.end(), spirv[inst + 2]) != variables_to_remove.end())
-						{
-							spirv.erase(spirv.begin() + inst, spirv.begin() + inst + len);
-							continue;
-						}
-						break;
-					case 71 /* OpDecorate */:
-						// Remove all decorations targeting any of the interface variables for non-matching entry points
-						if (std::find(variables_to_remove.begin(), variables_to_remove.end(), spirv[inst + 1]) != variables_to_remove.end())
-						{
-							spirv.erase(spirv.begin() + inst, spirv.begin() + inst + len);
-							continue;
-						}
-						break;
-					case 54 /* OpFunction */:
-						current_function = spirv[inst + 2];
-						current_function_offset = inst;
-						break;
-					case 56 /* OpFunctionEnd */:
-						// Remove all function definitions for non-matching entry points
-						if (std::find(functions_to_remove.begin(), functions_to_remove.end(), current_function) != functions_to_remove.end())
-						{
-							spirv.erase(spirv.begin() + current_function_offset, spirv.begin() + inst + len);
-							inst = current_function_offset;
-							continue;
-						}
-						break;
+						effect.errors += "warning: " + sampler_info.unique_name + ": texture does not support sRGB sampling (back buffer format is not RGBA8)";
 					}
-
-					inst += len;
 				}
-
-				cso.resize(spirv.size() * sizeof(uint32_t));
-				std::memcpy(cso.data(), spirv.data(), cso.size());
 			}
-		}
 
-		const std::unique_lock<std::shared_mutex> lock(_reload_mutex);
+			if (std::find(existing_texture->shared.begin(), existing_texture->shared.end(), effect_index) == existing_texture->shared.end())
+				existing_texture->shared.push_back(effect_index);
 
-		for (texture new_texture : effect.module.textures)
-		{
-			new_texture.effect_index = effect_index;
+			// The texture may already have been created for an effect that finished loading earlier, in which case it has to be created again with the additional usage (see 'update_effects')
+			if (existing_texture->resource != 0 && (!existing_texture->render_target || !existing_texture->storage_access))
+				_reload_recreate_textures.push_back(existing_texture->unique_name);
 
-			// Try to share textures with the same name across effects
+			// Always make shared textures render targets, since they may be used as such in a different effect
+			existing_texture->render_target = true;
+			existing_texture->storage_access = true;
+			continue;
+		}
+
+		if (new_texture.annotation_as_int("pooled") && new_texture.semantic.empty())
+		{
+			// Try to find another pooled texture to share with (and do not share within the same effect or with one that was already created without the usage needed for sharing)
 			if (const auto existing_texture = std::find_if(_textures.begin(), _textures.end(),
-				[&new_texture](const auto &item) { return item.unique_name == new_texture.unique_name; });
+				[&new_texture](const auto &item) { return item.annotation_as_int("pooled") && item.effect_index != new_texture.effect_index && item.matches_description(new_texture) && (item.resource == 0 || (item.render_target && item.storage_access)); });
 				existing_texture != _textures.end())
 			{
-				// Cannot share texture if this is a normal one, but the existing one is a reference and vice versa
-				if (new_texture.semantic != existing_texture->semantic)
-				{
-					effect.errors += "error: " + new_texture.unique_name + ": another effect (";
-					effect.errors += _effects[existing_texture->effect_index].source_file.filename().u8string();
-					effect.errors += ") already created a texture with the same name but different semantic\n";
-					effect.compiled = false;
-					break;
-				}
-
-				if (new_texture.semantic.empty() && !existing_texture->matches_description(new_texture))
-				{
-					effect.errors += "warning: " + new_texture.unique_name + ": another effect (";
-					effect.errors += _effects[existing_texture->effect_index].source_file.filename().u8string();
-					effect.errors += ") already created a texture with the same name but different dimensions\n";
-				}
-				if (new_texture.semantic.empty() && (existing_texture->annotation_as_string("source") != new_texture.annotation_as_string("source")))
-				{
-					effect.errors += "warning: " + new_texture.unique_name + ": another effect (";
-					effect.errors += _effects[existing_texture->effect_index].source_file.filename().u8string();
-					effect.errors += ") already created a texture with a different image file\n";
-				}
-
-				if (existing_texture->semantic == "COLOR" && format_color_bit_depth(_back_buffer_format) != 8)
+				// Overwrite referenced texture in samplers with the pooled one
+				for (auto &sampler_info : effect.module.samplers)
+					if (sampler_info.texture_name == new_texture.unique_name)
+						sampler_info.texture_name  = existing_texture->unique_name;
+				// Overwrite referenced texture in storages with the pooled one
+				for (auto &storage_info : effect.module.storages)
+					if (storage_info.texture_name == new_texture.unique_name)
+						storage_info.texture_name  = existing_texture->unique_name;
+				// Overwrite referenced texture in render targets with the pooled one
+				for (auto &technique_info : effect.module.techniques)
 				{
-					for (const auto &sampler_info : effect.module.samplers)
+					for (auto &pass_info : technique_info.passes)
 					{
-						if (sampler_info.srgb && sampler_info.texture_name == new_texture.unique_name)
-						{
-							effect.errors += "warning: " + sampler_info.unique_name + ": texture does not support sRGB sampling (back buffer format is not RGBA8)";
-						}
+						std::replace(std::begin(pass_info.render_target_names), std::end(pass_info.render_target_names),
+							new_texture.unique_name, existing_texture->unique_name);
+
+						for (auto &sampler_info : pass_info.samplers)
+							if (sampler_info.texture_name == new_texture.unique_name)
+								sampler_info.texture_name  = existing_texture->unique_name;
+						for (auto &storage_info : pass_info.storages)
+							if (storage_info.texture_name == new_texture.unique_name)
+								storage_info.texture_name  = existing_texture->unique_name;
 					}
 				}
 
 				if (std::find(existing_texture->shared.begin(), existing_texture->shared.end(), effect_index) == existing_texture->shared.end())
 					existing_texture->shared.push_back(effect_index);
 
-				// Always make shared textures render targets, since they may be used as such in a different effect
 				existing_texture->render_target = true;
 				existing_texture->storage_access = true;
 				continue;
 			}
-
-			if (new_texture.annotation_as_int("pooled") && new_texture.semantic.empty())
-			{
-				// Try to find another pooled texture to share with (and do not share within the same effect)
-				if (const auto existing_texture = std::find_if(_textures.begin(), _textures.end(),
-					[&new_texture](const auto &item) { return item.annotation_as_int("pooled") && item.effect_index != new_texture.effect_index && item.matches_description(new_texture); });
-					existing_texture != _textures.end())
-				{
-					// Overwrite referenced texture in samplers with the pooled one
-					for (auto &sampler_info : effect.module.samplers)
-						if (sampler_info.texture_name == new_texture.unique_name)
-							sampler_info.texture_name  = existing_texture->unique_name;
-					// Overwrite referenced texture in storages with the pooled one
-					for (auto &storage_info : effect.module.storages)
-						if (storage_info.texture_name == new_texture.unique_name)
-							storage_info.texture_name  = existing_texture->unique_name;
-					// Overwrite referenced texture in render targets with the pooled one
-					for (auto &technique_info : effect.module.techniques)
-					{
-						for (auto &pass_info : technique_info.passes)
-						{
-							std::replace(std::begin(pass_info.render_target_names), std::end(pass_info.render_target_names),
-								new_texture.unique_name, existing_texture->unique_name);
-
-							for (auto &sampler_info : pass_info.samplers)
-								if (sampler_info.texture_name == new_texture.unique_name)
-									sampler_info.texture_name  = existing_texture->unique_name;
-							for (auto &storage_info : pass_info.storages)
-								if (storage_info.texture_name == new_texture.unique_name)
-									storage_info.texture_name  = existing_texture->unique_name;
-						}
-					}
-
-					if (std::find(existing_texture->shared.begin(), existing_texture->shared.end(), effect_index) == existing_texture->shared.end())
-						existing_texture->shared.push_back(effect_index);
-
-					existing_texture->render_target = true;
-					existing_texture->storage_access = true;
-					continue;
-				}
-			}
-
-			// This is the first effect using this texture
-			new_texture.shared.push_back(effect_index);
-
-			_textures.push_back(std::move(new_texture));
 		}
 
-		for (technique new_technique : effect.module.techniques)
-		{
-			new_technique.effect_index = effect_index;
-
-			new_technique.hidden = new_technique.annotation_as_int("hidden") != 0;
-			new_technique.enabled_in_screenshot = new_technique.annotation_as_int("enabled_in_screenshot", 0, true) != 0;
+		// This is the first effect using this texture
+		new_texture.shared.push_back(effect_index);
 
-			if (new_technique.annotation_as_int("enabled"))
-				enable_technique(new_technique);
-
-			_techniques.push_back(std::move(new_technique));
-		}
+		_textures.push_back(std::move(new_texture));
 	}
 
-	if (_reload_remaining_effects != 0 && _reload_remaining_effects != std::numeric_limits<size_t>::max())
-		_reload_remaining_effects--;
-	else
-		_reload_remaining_effects = 0; // Force effect initialization in 'update_effects'
-
-	if ( effect.compiled && (effect.preprocessed || source_cached))
-	{
-		if (effect.errors.empty())
-			LOG(INFO) << "Successfully compiled " << source_file << '.';
-		else
-			LOG(WARN) << "Successfully compiled " << source_file << " with warnings:\n" << effect.errors;
-		return true;
-	}
-	else
+	for (technique new_technique : effect.module.techniques)
 	{
-		_last_reload_successfull = false;
+		new_technique.effect_index = effect_index;
 
-		if (effect.errors.empty())
-			LOG(ERROR) << "Failed to compile " << source_file << '!';
-		else
-			LOG(ERROR) << "Failed to compile " << source_file << ":\n" << effect.errors;
-		return false;
+		new_technique.hidden = new_technique.annotation_as_int("hidden") != 0;
+		new_technique.enabled_in_screenshot = new_technique.annotation_as_int("enabled_in_screenshot", 0, true) != 0;
+
+		if (new_technique.annotation_as_int("enabled"))
+			enable_technique(new_technique);
+
+		_techniques.push_back(std::move(new_technique));
 	}
 }
 bool reshade::runtime::create_effect(size_t effect_index)
@@ -2004,8 +2541,16 @@ bool reshade::runtime::create_effect(size_t effect_index)
 		layout_params[3].descriptor_set.ranges = &layout_ranges[3];
 	}
 
+	// Reuse the pipeline layout and pipelines of a previously loaded variant of this effect with the same specialization constant values (e.g. when switching back to a preset in performance mode)
+	const auto variant = std::find_if(_effect_variants.begin(), _effect_variants.end(),
+		[&effect](const effect_variant &item) {
+			return item.source_file == effect.source_file && item.source_hash == effect.source_hash && item.spec_constants_hash == effect.spec_constants_hash;
+		});
+	if (variant != _effect_variants.end())
+		effect.layout = variant->layout;
+
 	// Create pipeline layout for this effect
-	if (!_device->create_pipeline_layout(sampler_with_resource_view ? 3 : 4, layout_params, &effect.layout))
+	if (effect.layout == 0 && !_device->create_pipeline_layout(sampler_with_resource_view ? 3 : 4, layout_params, &effect.layout))
 	{
 		effect.compiled = false;
 		_last_reload_successfull = false;
@@ -2183,7 +2728,9 @@ bool reshade::runtime::create_effect(size_t effect_index)
 
 				subobjects.push_back({ api::pipeline_subobject_type::compute_shader, 1, &cs_desc });
 
-				if (!_device->create_pipeline(effect.layout, static_cast<uint32_t>(subobjects.size()), subobjects.data(), &pass_data.pipeline))
+				if (variant != _effect_variants.end())
+					pass_data.pipeline = variant->pipelines[total_pass_index];
+				else if (!_device->create_pipeline(effect.layout, static_cast<uint32_t>(subobjects.size()), subobjects.data(), &pass_data.pipeline))
 				{
 					effect.compiled = false;
 					_last_reload_successfull = false;
@@ -2367,7 +2914,9 @@ bool reshade::runtime::create_effect(size_t effect_index)
 
 				subobjects.push_back({ api::pipeline_subobject_type::depth_stencil_state, 1, &depth_stencil_state });
 
-				if (!_device->create_pipeline(effect.layout, static_cast<uint32_t>(subobjects.size()), subobjects.data(), &pass_data.pipeline))
+				if (variant != _effect_variants.end())
+					pass_data.pipeline = variant->pipelines[total_pass_index];
+				else if (!_device->create_pipeline(effect.layout, static_cast<uint32_t>(subobjects.size()), subobjects.data(), &pass_data.pipeline))
 				{
 					effect.compiled = false;
 					_last_reload_successfull = false;
@@ -2483,6 +3032,10 @@ bool reshade::runtime::create_effect(size_t effect_index)
 	if (!descriptor_writes.empty())
 		_device->update_descriptor_sets(static_cast<uint32_t>(descriptor_writes.size()), descriptor_writes.data());
 
+	// The effect owns the objects of the variant now
+	if (variant != _effect_variants.end())
+		_effect_variants.erase(variant);
+
 	return true;
 }
 bool reshade::runtime::create_effect_sampler_state(const api::sampler_desc &desc, api::sampler &sampler)
@@ -2516,23 +3069,52 @@ void reshade::runtime::destroy_effect(size_t effect_index)
 	// Make sure no effect resources are currently in use
 	_graphics_queue->wait_idle();
 
-	for (technique &tech : _techniques)
-	{
-		if (tech.effect_index != effect_index)
-			continue;
+	{	effect &effect = _effects[effect_index];
+
+		// Keep the pipelines of successfully created effects in performance mode, so that they do not have to be created again when the same specialization constant values are used later
+		effect_variant variant = { effect.source_file, effect.source_hash, effect.spec_constants_hash, effect.layout };
+		bool keep_variant = _performance_mode && effect.compiled && effect.layout != 0;
 
-		for (const technique::pass_data &pass : tech.passes_data)
+		for (technique &tech : _techniques)
 		{
-			_device->destroy_pipeline(pass.pipeline);
+			if (tech.effect_index != effect_index)
+				continue;
+
+			for (const technique::pass_data &pass : tech.passes_data)
+			{
+				variant.pipelines.push_back(pass.pipeline);
+				keep_variant &= pass.pipeline != 0;
+
+				_device->free_descriptor_set(pass.texture_set);
+				_device->free_descriptor_set(pass.storage_set);
+			}
 
-			_device->free_descriptor_set(pass.texture_set);
-			_device->free_descriptor_set(pass.storage_set);
+			tech.passes_data.clear();
 		}
 
-		tech.passes_data.clear();
-	}
+		if (keep_variant)
+		{
+			// Evict the least recently used variant of this effect if there are too many already
+			const auto is_same_effect = [&effect](const effect_variant &item) { return item.source_file == effect.source_file; };
+			if (std::count_if(_effect_variants.begin(), _effect_variants.end(), is_same_effect) >= 4)
+				destroy_effect_variant(std::find_if(_effect_variants.begin(), _effect_variants.end(), is_same_effect) - _effect_variants.begin());
 
-	{	effect &effect = _effects[effect_index];
+			_effect_variants.push_back(std::move(variant));
+		}
+		else if (const auto it = std::find_if(_effect_variants.begin(), _effect_variants.end(), [&effect](const effect_variant &item) { return item.layout == effect.layout; });
+			it != _effect_variants.end())
+		{
+			// Creating the effect failed while it was reusing the objects of a variant, so destroy that variant along with it
+			destroy_effect_variant(it - _effect_variants.begin());
+		}
+		else
+		{
+			for (const api::pipeline pipeline : variant.pipelines)
+				_device->destroy_pipeline(pipeline);
+			_device->destroy_pipeline_layout(effect.layout);
+		}
+
+		effect.layout = {};
 
 		_device->destroy_resource(effect.cb);
 		effect.cb = {};
@@ -2542,9 +3124,6 @@ void reshade::runtime::destroy_effect(size_t effect_index)
 		_device->free_descriptor_set(effect.sampler_set);
 		effect.sampler_set = {};
 
-		_device->destroy_pipeline_layout(effect.layout);
-		effect.layout = {};
-
 		_device->destroy_query_pool(effect.query_pool);
 		effect.query_pool = {};
 
@@ -2580,6 +3159,16 @@ void reshade::runtime::destroy_effect(size_t effect_index)
 
 	// Do not clear effect here, since it is common to be re-used immediately
 }
+void reshade::runtime::destroy_effect_variant(size_t variant_index)
+{
+	const effect_variant &variant = _effect_variants[variant_index];
+
+	for (const api::pipeline pipeline : variant.pipelines)
+		_device->destroy_pipeline(pipeline);
+	_device->destroy_pipeline_layout(variant.layout);
+
+	_effect_variants.erase(_effect_variants.begin() + variant_index);
+}
 
 bool reshade::runtime::create_texture(texture &tex)
 {
@@ -2727,6 +3316,7 @@ void reshade::runtime::destroy_texture(texture &tex)
 {
 	_device->destroy_resource(tex.resource);
 	tex.resource = {};
+	tex.loaded = false;
 
 	_device->destroy_resource_view(tex.srv[0]);
 	if (tex.srv[1] != tex.srv[0])
@@ -2799,6 +3389,11 @@ void reshade::runtime::disable_technique(technique &tech)
 	if (status_changed) // Decrease rendering reference count
 		_effects[tech.effect_index].rendering--;
 }
+bool reshade::runtime::is_effect_available(size_t effect_index) const
+{
+	// While effects are being loaded, only those that were already handed over to 'update_effects' may be accessed
+	return !is_loading() || std::find(_reload_available_effects.begin(), _reload_available_effects.end(), effect_index) != _reload_available_effects.end();
+}
 
 void reshade::runtime::load_effects()
 {
@@ -2807,14 +3402,17 @@ void reshade::runtime::load_effects()
 	ini_file &preset = ini_file::load_cache(_current_preset_path);
 	preset.get({}, "PreprocessorDefinitions", _preset_preprocessor_definitions);
 
-	// Build a list of effect files by walking through the effect search paths
+	// Walk through all search paths once, which effect discovery, include resolution and texture lookup then share for this reload
+	update_search_path_snapshot();
+
+	// Build a list of effect files from the effect search paths
 	const std::vector<std::filesystem::path> effect_files =
-		find_files(_effect_search_paths, { L".fx" });
+		find_files(*_search_path_snapshot, _search_path_snapshot->effect_directories, { L".fx" });
 
 	if (effect_files.empty())
 		return; // No effect files found, so nothing more to do
 
-	// Have to be initialized at this point or else the threads spawned below will immediately exit without reducing the remaining effects count
+	// Have to be initialized at this point or else the tasks queued below will immediately exit without reducing the remaining effects count
 	assert(_is_initialized);
 
 	// Ensure HLSL compiler is loaded before trying to compile effects in Direct3D
@@ -2828,25 +3426,53 @@ void reshade::runtime::load_effects()
 		}
 	}
 
+	// Rebuild the preprocessor state shared between all effects, in case any of its inputs changed
+	_preprocessor_base.reset();
+
 	// Allocate space for effects which are placed in this array during the 'load_effect' call
 	const size_t offset = _effects.size();
 	_effects.resize(offset + effect_files.size());
 	_reload_remaining_effects = effect_files.size();
 
+	std::vector<std::string> technique_list;
+	preset.get({}, "Techniques", technique_list);
+
 	// Now that we have a list of files, load them in parallel
-	// Split workload into batches instead of launching a thread for every file to avoid launch overhead and stutters due to too many threads being in flight
-	const size_t num_splits = std::min<size_t>(effect_files.size(), std::max<size_t>(std::thread::hardware_concurrency(), 2u) - 1);
+	// Queue effects used by the current preset first, so that they can start rendering as soon as possible (see 'update_effects'), and the largest files first after that, so that the worker threads do not end up waiting on a single big effect that was started last
+	std::vector<size_t> load_order(effect_files.size());
+	std::vector<uint8_t> enabled_in_preset(effect_files.size());
+	std::vector<uintmax_t> file_sizes(effect_files.size());
+	for (size_t i = 0; i < effect_files.size(); ++i)
+	{
+		load_order[i] = i;
+
+		const std::string effect_name = effect_files[i].filename().u8string();
+		enabled_in_preset[i] = std::find_if(technique_list.cbegin(), technique_list.cend(), [&effect_name](const std::string &technique) {
+			const size_t at_pos = technique.find('@') + 1;
+			return at_pos == 0 || technique.compare(at_pos, std::string::npos, effect_name) == 0; }) != technique_list.cend();
+
+		if (const search_path_snapshot::file *const file = find_snapshot_file(*_search_path_snapshot, effect_files[i]))
+			file_sizes[i] = file->size;
+	}
+
+	std::stable_sort(load_order.begin(), load_order.end(), [&enabled_in_preset, &file_sizes](size_t lhs, size_t rhs) {
+		return enabled_in_preset[lhs] != enabled_in_preset[rhs] ? enabled_in_preset[lhs] > enabled_in_preset[rhs] : file_sizes[lhs] > file_sizes[rhs]; });
+
+	for (const size_t i : load_order)
+		_worker_pool->submit([this, effect_file = effect_files[i], effect_index = offset + i, background = !enabled_in_preset[i], &preset]() {
+			// Load the remaining effects at a lower priority, so that they interfere less with the application and the effects that are already rendering
+			if (background)
+				SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
 
-	// Keep track of the spawned threads, so the runtime cannot be destroyed while they are still running
-	for (size_t n = 0; n < num_splits; ++n)
-		_worker_threads.emplace_back([this, effect_files, offset, num_splits, n, &preset]() {
 			// Abort loading when initialization state changes (indicating that 'on_reset' was called in the meantime)
-			for (size_t i = 0; i < effect_files.size() && _is_initialized; ++i)
-				if (i * num_splits / effect_files.size() == n)
-					load_effect(effect_files[i], preset, offset + i);
+			if (_is_initialized)
+				load_effect(effect_file, preset, effect_index);
+
+			if (background)
+				SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_NORMAL);
 		});
 }
-void reshade::runtime::load_textures()
+void reshade::runtime::load_textures(size_t only_effect_index)
 {
 	LOG(INFO) << "Loading image files for textures ...";
 
@@ -2854,6 +3480,13 @@ void reshade::runtime::load_textures()
 	{
 		if (tex.resource == 0 || !tex.semantic.empty())
 			continue; // Ignore textures that are not created yet and those that are handled in the runtime implementation
+		if (tex.loaded)
+			continue; // Ignore textures whose image file was already loaded (e.g. for an effect that was created while others were still loading)
+		if (only_effect_index != std::numeric_limits<size_t>::max() && std::find(tex.shared.begin(), tex.shared.end(), only_effect_index) == tex.shared.end())
+			continue;
+
+		// Report errors on the effect the texture is loaded for, since the effect that declared it first may still be loading
+		effect &tex_effect = _effects[only_effect_index != std::numeric_limits<size_t>::max() ? only_effect_index : tex.effect_index];
 
 		std::filesystem::path source_path = std::filesystem::u8path(tex.annotation_as_string("source"));
 		// Ignore textures that have no image file attached to them (e.g. plain render targets)
@@ -2861,10 +3494,10 @@ void reshade::runtime::load_textures()
 			continue;
 
 		// Search for image file using the provided search paths unless the path provided is already absolute
-		if (!find_file(_texture_search_paths, source_path))
+		if (!find_file(*_search_path_snapshot, _search_path_snapshot->texture_directories, source_path))
 		{
-			if (_effects[tex.effect_index].errors.find(source_path.u8string()) == std::string::npos)
-				_effects[tex.effect_index].errors += "warning: " + tex.unique_name + ": source \"" + source_path.u8string() + "\" was not found.\n";
+			if (tex_effect.errors.find(source_path.u8string()) == std::string::npos)
+				tex_effect.errors += "warning: " + tex.unique_name + ": source \"" + source_path.u8string() + "\" was not found.\n";
 
 			LOG(ERROR) << "Source " << source_path << " for texture '" << tex.unique_name << "' was not found in any of the texture search paths!";
 			continue;
@@ -2888,8 +3521,8 @@ void reshade::runtime::load_textures()
 
 		if (filedata == nullptr)
 		{
-			if (_effects[tex.effect_index].errors.find(source_path.u8string()) == std::string::npos)
-				_effects[tex.effect_index].errors += "warning: " + tex.unique_name + ": source \"" + source_path.u8string() + "\" could not be loaded.\n";
+			if (tex_effect.errors.find(source_path.u8string()) == std::string::npos)
+				tex_effect.errors += "warning: " + tex.unique_name + ": source \"" + source_path.u8string() + "\" could not be loaded.\n";
 
 			LOG(ERROR) << "Source " << source_path << " for texture '" << tex.unique_name << "' could not be loaded! Make sure it is of a compatible file format.";
 			continue;
@@ -2902,7 +3535,8 @@ void reshade::runtime::load_textures()
 		tex.loaded = true;
 	}
 
-	_textures_loaded = true;
+	if (only_effect_index == std::numeric_limits<size_t>::max())
+		_textures_loaded = true;
 }
 bool reshade::runtime::reload_effect(size_t effect_index, bool preprocess_required)
 {
@@ -2912,10 +3546,84 @@ bool reshade::runtime::reload_effect(size_t effect_index, bool preprocess_requir
 
 	const std::filesystem::path source_file = _effects[effect_index].source_file;
 	destroy_effect(effect_index);
+
+	// This uses the current search path snapshot, which callers update first if files may have changed since it was taken (see 'update_search_path_snapshot')
 	return load_effect(source_file, ini_file::load_cache(_current_preset_path), effect_index, preprocess_required);
 }
+void reshade::runtime::update_search_path_snapshot()
+{
+	const std::shared_ptr<const search_path_snapshot> snapshot = create_search_path_snapshot(_effect_search_paths, _texture_search_paths, *_worker_pool);
+
+	// Share include files and file system lookups between all effects, so that common headers are only read once per reload
+	// Source file names in the cached tokens are interned into a pool that is created along with the cache and destroyed together with it and all effects (see 'destroy_effects')
+	if (_include_cache == nullptr)
+	{
+		_string_pool = std::make_shared<reshadefx::string_pool>();
+		_include_cache = std::make_shared<reshadefx::include_cache>();
+	}
+	else
+		_include_cache->invalidate_file_lookups();
+
+	// Resolve includes from the snapshot too, so that looking through all include paths does not have to query the file system for every one of them
+	for (const size_t directory_index : snapshot->effect_directories)
+	{
+		const search_path_snapshot::directory &directory = snapshot->directories[directory_index];
+
+		std::vector<std::filesystem::path> file_names;
+		file_names.reserve(directory.files.size());
+		for (const search_path_snapshot::file &file : directory.files)
+			file_names.push_back(file.path.filename());
+
+		_include_cache->add_directory_listing(directory.path, file_names);
+	}
+
+	// Effects that are still loading in the background may be reading the previous snapshot
+	std::atomic_store(&_search_path_snapshot, snapshot);
+}
+void reshade::runtime::reload_effects(const std::vector<size_t> &effect_indices)
+{
+	// Cannot reload only some effects while others are still loading, since the loading state is shared
+	if (is_loading())
+	{
+		reload_effects();
+		return;
+	}
+
+	// Walk through all search paths once for all effects that are reloaded
+	update_search_path_snapshot();
+
+	for (const size_t effect_index : effect_indices)
+		destroy_effect(effect_index);
+
+	// Keep rendering all other effects while the reloaded ones are loading (see 'is_effect_available')
+	for (size_t effect_index = 0; effect_index < _effects.size(); ++effect_index)
+		if (std::find(effect_indices.begin(), effect_indices.end(), effect_index) == effect_indices.end())
+			_reload_available_effects.push_back(effect_index);
+
+	// These effects were not skipped before, so do not skip them now either
+	_load_option_disable_skipping = true;
+
+	_reload_remaining_effects = effect_indices.size();
+
+	// Load the effects in the background, like in 'load_effects', so that the application does not stall until all are compiled
+	const ini_file &preset = ini_file::load_cache(_current_preset_path);
+	for (const size_t effect_index : effect_indices)
+		_worker_pool->submit([this, source_file = _effects[effect_index].source_file, effect_index, &preset]() {
+			// Abort loading when initialization state changes (indicating that 'on_reset' was called in the meantime)
+			if (_is_initialized)
+				load_effect(source_file, preset, effect_index);
+		});
+}
 void reshade::runtime::reload_effects()
 {
+	// Effects that finished loading are set up and rendered while others are still loading, which invokes add-on events that may request a reload
+	// Destroying effects at that point would stall the application until all loading tasks finished, so defer the reload until all effects finished loading instead (see 'update_effects')
+	if (is_loading() && _reload_remaining_effects != 0)
+	{
+		_reload_deferred = true;
+		return;
+	}
+
 	// Clear out any previous effects
 	destroy_effects();
 
@@ -2929,15 +3637,26 @@ void reshade::runtime::reload_effects()
 }
 void reshade::runtime::destroy_effects()
 {
-	// Make sure no threads are still accessing effect data
-	for (std::thread &thread : _worker_threads)
-		if (thread.joinable())
-			thread.join();
-	_worker_threads.clear();
+	// Make sure no tasks are still accessing effect data
+	_worker_pool->wait();
+
+	// No effects are loading anymore after this (e.g. if loading was aborted by 'on_reset'), so do not defer any later reload either
+	_reload_remaining_effects = std::numeric_limits<size_t>::max();
+	_reload_deferred = false;
+
+	_reload_ready_effects.clear();
+	_reload_staged_effects.clear();
+	_reload_available_effects.clear();
+	_reload_recreate_textures.clear();
 
 	for (size_t effect_index = 0; effect_index < _effects.size(); ++effect_index)
 		destroy_effect(effect_index);
 
+	// Only keep effect variants around while in performance mode and as long as the device is not reset
+	if (!_performance_mode || !_is_initialized)
+		while (!_effect_variants.empty())
+			destroy_effect_variant(0);
+
 	// Clean up sampler objects
 	for (const auto &[hash, sampler] : _effect_sampler_states)
 		_device->destroy_sampler(sampler);
@@ -2957,6 +3676,11 @@ void reshade::runtime::destroy_effects()
 	assert(_textures.empty());
 	assert(_techniques.empty());
 
+	// Nothing references the source file names interned during this reload anymore, so free them along with the cached include files
+	_preprocessor_base.reset();
+	_include_cache.reset();
+	_string_pool.reset();
+
 	_textures_loaded = false;
 }
 
@@ -2965,41 +3689,25 @@ bool reshade::runtime::load_effect_cache(const std::string &id, const std::strin
 	if (_no_effect_cache)
 		return false;
 
-	std::filesystem::path path = g_reshade_base_path / _intermediate_cache_path;
-	path /= std::filesystem::u8path("reshade-" + id + '.' + type);
-
-	{	const HANDLE file = CreateFileW(path.c_str(), FILE_GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
-		if (file == INVALID_HANDLE_VALUE)
-			return false;
-		DWORD size = GetFileSize(file, nullptr);
-		data.resize(size);
-		const BOOL result = ReadFile(file, data.data(), size, &size, nullptr);
-		CloseHandle(file);
-		return result != FALSE;
-	}
+	const std::shared_ptr<cache_pack> effect_cache = std::atomic_load(&_effect_cache);
+	return effect_cache != nullptr && effect_cache->load(id + '.' + type, data);
 }
 bool reshade::runtime::save_effect_cache(const std::string &id, const std::string &type, const std::string &data) const
 {
 	if (_no_effect_cache)
 		return false;
 
-	std::filesystem::path path = g_reshade_base_path / _intermediate_cache_path;
-	path /= std::filesystem::u8path("reshade-" + id + '.' + type);
-
-	{	const HANDLE file = CreateFileW(path.c_str(), FILE_GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_NEW, FILE_ATTRIBUTE_ARCHIVE | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
-		if (file == INVALID_HANDLE_VALUE)
-			return false;
-		DWORD size = static_cast<DWORD>(data.size());
-		const BOOL result = WriteFile(file, data.data(), size, &size, nullptr);
-		CloseHandle(file);
-		return result != FALSE;
-	}
+	const std::shared_ptr<cache_pack> effect_cache = std::atomic_load(&_effect_cache);
+	return effect_cache != nullptr && effect_cache->save(id + '.' + type, data);
 }
 void reshade::runtime::clear_effect_cache()
 {
+	if (const std::shared_ptr<cache_pack> effect_cache = std::atomic_load(&_effect_cache))
+		effect_cache->clear();
+
 	std::error_code ec;
 
-	// Find all cached effect files and delete them
+	// Find all cached effect files written by older versions, which stored each entry in a separate file, and delete them
 	for (const std::filesystem::directory_entry &entry : std::filesystem::directory_iterator(g_reshade_base_path / _intermediate_cache_path, std::filesystem::directory_options::skip_permission_denied, ec))
 	{
 		if (entry.is_directory(ec))
@@ -3007,7 +3715,7 @@ void reshade::runtime::clear_effect_cache()
 
 		const std::filesystem::path filename = entry.path().filename();
 		const std::filesystem::path extension = entry.path().extension();
-		if (filename.native().compare(0, 8, L"reshade-") != 0 || (extension != L".i" && extension != L".cso" && extension != L".asm"))
+		if (filename.native().compare(0, 8, L"reshade-") != 0 || (extension != L".i" && extension != L".cso" && extension != L".asm" && extension != L".module" && extension != L".deps"))
 			continue;
 
 		std::filesystem::remove(entry, ec);
@@ -3100,13 +3808,98 @@ void reshade::runtime::update_effects()
 	if (_framecount == 0 && !_no_reload_on_init && !(_no_reload_for_non_vr && !_is_vr))
 		reload_effects();
 
+	// Effects that were loaded in the background only staged their textures and techniques (see 'load_effect'), so add them here, on the same thread that renders effects
+	const auto merge_staged_effects = [this](const std::vector<size_t> &staged_effects) {
+		for (const size_t effect_index : staged_effects)
+		{
+			effect &effect = _effects[effect_index];
+
+			const size_t errors_offset = effect.errors.size();
+			const bool compiled = effect.compiled;
+
+			merge_effect_textures_and_techniques(effect_index);
+
+			// The result of compiling the effect was logged already, so only log what was added to it here
+			if (compiled && !effect.compiled)
+			{
+				_last_reload_successfull = false;
+
+				LOG(ERROR) << "Failed to add textures of " << effect.source_file << ":\n" << std::string_view(effect.errors).substr(errors_offset);
+			}
+			else if (effect.errors.size() != errors_offset)
+			{
+				LOG(WARN) << "Added textures of " << effect.source_file << " with warnings:\n" << std::string_view(effect.errors).substr(errors_offset);
+			}
+		}
+	};
+
 	if (_reload_remaining_effects == 0)
 	{
-		// Clear the thread list now that they all have finished
-		for (std::thread &thread : _worker_threads)
-			if (thread.joinable())
-				thread.join(); // Threads have exited, but still need to join them prior to destruction
-		_worker_threads.clear();
+		// Start over if a reload was requested while effects were still loading (see 'reload_effects')
+		if (_reload_deferred)
+		{
+			_reload_remaining_effects = std::numeric_limits<size_t>::max();
+			reload_effects();
+			return;
+		}
+
+		// No loading tasks are running anymore at this point, so the list of staged effects can be accessed without locking
+		merge_staged_effects(_reload_staged_effects);
+		_reload_staged_effects.clear();
+
+		// Effects that finished loading first may have been created already with textures that effects which finished later share and need additional usage on, so create those again
+		if (!_reload_recreate_textures.empty())
+		{
+			std::vector<size_t> effects_to_recreate;
+			for (const std::string &texture_name : _reload_recreate_textures)
+			{
+				const auto tex = std::find_if(_textures.begin(), _textures.end(),
+					[&texture_name](const texture &item) { return item.unique_name == texture_name; });
+				if (tex == _textures.end() || tex->resource == 0)
+					continue;
+
+				for (const size_t effect_index : tex->shared)
+					if (std::find(effects_to_recreate.begin(), effects_to_recreate.end(), effect_index) == effects_to_recreate.end() &&
+						std::any_of(_techniques.begin(), _techniques.end(), [effect_index](const technique &tech) { return tech.effect_index == effect_index && !tech.passes_data.empty(); }))
+						effects_to_recreate.push_back(effect_index);
+			}
+
+			for (const size_t effect_index : effects_to_recreate)
+				destroy_effect(effect_index);
+
+			for (const std::string &texture_name : _reload_recreate_textures)
+				if (const auto tex = std::find_if(_textures.begin(), _textures.end(),
+						[&texture_name](const texture &item) { return item.unique_name == texture_name; });
+					tex != _textures.end())
+					destroy_texture(*tex);
+
+			_reload_recreate_textures.clear();
+
+			if (!effects_to_recreate.empty())
+			{
+				// Keep rendering all other effects while these are loaded again (see 'is_effect_available')
+				_reload_available_effects.erase(std::remove_if(_reload_available_effects.begin(), _reload_available_effects.end(),
+					[&effects_to_recreate](size_t effect_index) { return std::find(effects_to_recreate.begin(), effects_to_recreate.end(), effect_index) != effects_to_recreate.end(); }), _reload_available_effects.end());
+
+				// These effects were not skipped before, so do not skip them now either
+				_load_option_disable_skipping = true;
+
+				_reload_remaining_effects = effects_to_recreate.size();
+
+				// Effect data is kept after destroying, so this only has to add its textures and techniques again, which is still done in the background like in 'reload_effects' to not stall the application
+				const ini_file &preset = ini_file::load_cache(_current_preset_path);
+				for (const size_t effect_index : effects_to_recreate)
+					_worker_pool->submit([this, source_file = _effects[effect_index].source_file, effect_index, &preset]() {
+						// Abort loading when initialization state changes (indicating that 'on_reset' was called in the meantime)
+						if (_is_initialized)
+							load_effect(source_file, preset, effect_index);
+					});
+				return;
+			}
+		}
+
+		_reload_ready_effects.clear();
+		_reload_available_effects.clear();
 
 		// Finished loading effects, so apply preset to figure out which ones need compiling
 		load_current_preset();
@@ -3117,6 +3910,10 @@ void reshade::runtime::update_effects()
 		// Reset all effect loading options
 		_load_option_disable_skipping = false;
 
+		// Reclaim space of replaced and evicted effect cache entries only now that no effects are loading anymore, since that blocks all access to the cache while it runs
+		if (std::shared_ptr<cache_pack> effect_cache = std::atomic_load(&_effect_cache); effect_cache != nullptr)
+			_worker_pool->submit([effect_cache = std::move(effect_cache)]() { effect_cache->compact(); });
+
 #if RESHADE_GUI
 		// Update all editors after a reload
 		for (editor_instance &instance : _editors)
@@ -3142,7 +3939,56 @@ void reshade::runtime::update_effects()
 	}
 	else if (_reload_remaining_effects != std::numeric_limits<size_t>::max())
 	{
-		return; // Cannot render while effects are still being loaded
+		// Set up effects that finished loading while others are still being loaded, so that those used by the current preset can already be rendered
+		// Only take the lists of those effects under the lock, so that loading tasks are not blocked while they are set up below
+		std::vector<size_t> ready_effects, staged_effects;
+		{
+			const std::unique_lock<std::shared_mutex> lock(_reload_mutex);
+			ready_effects.swap(_reload_ready_effects);
+			staged_effects.swap(_reload_staged_effects);
+		}
+
+		merge_staged_effects(staged_effects);
+
+		for (const size_t effect_index : ready_effects)
+		{
+			_reload_available_effects.push_back(effect_index);
+
+			load_current_preset(effect_index);
+		}
+
+		// Only create effects that are available already, one per frame like below
+		// Effects that share a texture which was already created without the usage they need are only created after it was created again at the end of loading (see above)
+		const auto queue_it = std::find_if(_reload_create_queue.rbegin(), _reload_create_queue.rend(), [this](size_t effect_index) {
+			return std::find(_reload_available_effects.begin(), _reload_available_effects.end(), effect_index) != _reload_available_effects.end() &&
+				std::none_of(_textures.begin(), _textures.end(), [this, effect_index](const texture &tex) {
+					return std::find(tex.shared.begin(), tex.shared.end(), effect_index) != tex.shared.end() &&
+						std::find(_reload_recreate_textures.begin(), _reload_recreate_textures.end(), tex.unique_name) != _reload_recreate_textures.end(); }); });
+		if (queue_it == _reload_create_queue.rend())
+			return;
+
+		const size_t effect_index = *queue_it;
+		_reload_create_queue.erase(std::next(queue_it).base());
+
+		if (create_effect(effect_index))
+		{
+			load_textures(effect_index);
+		}
+		else
+		{
+			for (texture &tex : _textures)
+				if (tex.effect_index == effect_index && tex.shared.size() <= 1)
+					destroy_texture(tex);
+			for (technique &tech : _techniques)
+				if (tech.effect_index == effect_index)
+					disable_technique(tech);
+
+			_last_reload_successfull = false;
+		}
+
+		// Load image files of all textures again once all effects were created
+		_textures_loaded = false;
+		return;
 	}
 	else if (!_reload_create_queue.empty())
 	{
@@ -3198,12 +4044,15 @@ void reshade::runtime::render_effects(api::command_list *cmd_list, api::resource
 {
 	_effects_rendered_this_frame = true;
 
-	if (is_loading() || rtv == 0)
+	if (rtv == 0)
 		return;
 
 	if (rtv_srgb == 0)
 		rtv_srgb = rtv;
 
+	// Effects that finished loading are rendered while others are still being loaded (see 'update_effects')
+	const bool effects_loading = is_loading();
+
 	// Nothing to do here if effects are disabled globally
 	if (!_effects_enabled || _techniques.empty())
 		return;
@@ -3225,12 +4074,17 @@ void reshade::runtime::render_effects(api::command_list *cmd_list, api::resource
 	// Update special uniform variables
 	for (effect &effect : _effects)
 	{
+		// Skip effects that are still being loaded
+		if (!is_effect_available(&effect - _effects.data()))
+			continue;
+
 		if (!effect.rendering)
 			continue;
 
 		for (uniform &variable : effect.uniforms)
 		{
-			if (!_ignore_shortcuts && _input != nullptr && _input->is_key_pressed(variable.toggle_key_data, _force_shortcut_modifiers))
+			// Shortcuts are ignored while loading, since the preset cannot be saved before all effects are loaded
+			if (!effects_loading && !_ignore_shortcuts && _input != nullptr && _input->is_key_pressed(variable.toggle_key_data, _force_shortcut_modifiers))
 			{
 				assert(variable.supports_toggle_key());
 
@@ -3461,7 +4315,7 @@ void reshade::runtime::render_effects(api::command_list *cmd_list, api::resource
 	// Render all enabled techniques
 	for (technique &tech : _techniques)
 	{
-		if (!_ignore_shortcuts && _input != nullptr && _input->is_key_pressed(tech.toggle_key_data, _force_shortcut_modifiers))
+		if (!effects_loading && !_ignore_shortcuts && _input != nullptr && _input->is_key_pressed(tech.toggle_key_data, _force_shortcut_modifiers))
 		{
 			if (!tech.enabled)
 				enable_technique(tech);
@@ -3705,7 +4559,7 @@ void reshade::runtime::save_texture(const texture &tex)
 	if (std::vector<uint8_t> data(static_cast<size_t>(tex.width) * static_cast<size_t>(tex.height * 4));
 		get_texture_data(tex.resource, api::resource_usage::shader_resource, data.data()))
 	{
-		_worker_threads.emplace_back([this, screenshot_path, data = std::move(data), width = tex.width, height = tex.height]() mutable {
+		_worker_pool->submit([this, screenshot_path, data = std::move(data), width = tex.width, height = tex.height]() mutable {
 			// Default to a save failure unless it is reported to succeed below
 			bool save_success = false;
 
@@ -4147,7 +5001,7 @@ void reshade::runtime::save_screenshot(const std::string &postfix)
 		const bool include_preset = false;
 #endif
 
-		_worker_threads.emplace_back([this, screenshot_path, data = std::move(data), include_preset]() mutable {
+		_worker_pool->submit([this, screenshot_path, data = std::move(data), include_preset]() mutable {
 			// Remove alpha channel
 			int comp = 4;
 			if (_screenshot_clear_alpha)
@@ -20,6 +20,13 @@
 
 class ini_file;
 
+namespace reshadefx
+{
+	class include_cache;
+	class preprocessor;
+	class string_pool;
+}
+
 namespace reshade
 {
 	// Forward declarations to avoid excessive #include
@@ -27,6 +34,9 @@ namespace reshade
 	struct uniform;
 	struct texture;
 	struct technique;
+	struct search_path_snapshot;
+	class cache_pack;
+	class thread_pool;
 
 	/// <summary>
 	/// The main ReShade post-processing effect runtime.
@@ -274,26 +284,31 @@ namespace reshade
 		void save_config() const;
 
 #if RESHADE_FX
-		void load_current_preset();
+		void load_current_preset(size_t only_effect_index = std::numeric_limits<size_t>::max());
 		void save_current_preset() const;
 
 		bool switch_to_next_preset(std::filesystem::path filter_path, bool reversed = false);
 
 		bool load_effect(const std::filesystem::path &source_file, const ini_file &preset, size_t effect_index, bool preprocess_required = false);
+		void merge_effect_textures_and_techniques(size_t effect_index);
 		bool create_effect(size_t effect_index);
 		bool create_effect_sampler_state(const api::sampler_desc &desc, api::sampler &sampler);
 		void destroy_effect(size_t effect_index);
+		void destroy_effect_variant(size_t variant_index);
 
 		bool create_texture(texture &texture);
 		void destroy_texture(texture &texture);
 
 		void enable_technique(technique &technique);
 		void disable_technique(technique &technique);
+		bool is_effect_available(size_t effect_index) const;
 
 		void load_effects();
-		void load_textures();
+		void load_textures(size_t only_effect_index = std::numeric_limits<size_t>::max());
+		void update_search_path_snapshot();
 		bool reload_effect(size_t effect_index, bool preprocess_required = false);
 		void reload_effects();
+		void reload_effects(const std::vector<size_t> &effect_indices);
 		void destroy_effects();
 
 		bool load_effect_cache(const std::string &id, const std::string &type, std::string &data) const;
@@ -363,6 +378,8 @@ namespace reshade
 #if RESHADE_FX
 		bool _no_debug_info = 0;
 		bool _no_effect_cache = false;
+		bool _effect_cache_compression = true;
+		unsigned int _effect_cache_size_limit = 512;
 		bool _no_reload_on_init = false;
 		bool _no_reload_for_non_vr = false;
 		bool _performance_mode = false;
@@ -373,21 +390,33 @@ namespace reshade
 		std::vector<std::string> _global_preprocessor_definitions;
 		std::vector<std::string> _preset_preprocessor_definitions;
 		std::filesystem::path _intermediate_cache_path;
+		std::shared_ptr<cache_pack> _effect_cache;
 		std::vector<std::filesystem::path> _effect_search_paths;
 		std::vector<std::filesystem::path> _texture_search_paths;
+		std::shared_ptr<const search_path_snapshot> _search_path_snapshot;
 
 		std::atomic<bool> _last_reload_successfull = true;
 		bool _textures_loaded = false;
 		std::shared_mutex _reload_mutex;
 		std::vector<size_t> _reload_create_queue;
+		std::vector<size_t> _reload_ready_effects;
+		std::vector<size_t> _reload_staged_effects;
+		std::vector<size_t> _reload_available_effects;
+		std::vector<std::string> _reload_recreate_textures;
 		std::atomic<size_t> _reload_remaining_effects = std::numeric_limits<size_t>::max();
+		bool _reload_deferred = false;
 		void *_d3d_compiler_module = nullptr;
 
 		std::vector<effect> _effects;
 		std::vector<texture> _textures;
 		std::vector<technique> _techniques;
+		std::shared_ptr<reshadefx::string_pool> _string_pool;
+		std::shared_ptr<reshadefx::include_cache> _include_cache;
+		std::mutex _preprocessor_base_mutex;
+		std::shared_ptr<const reshadefx::preprocessor> _preprocessor_base;
+		std::vector<std::string> _preprocessor_base_definitions;
 #endif
-		std::vector<std::thread> _worker_threads;
+		std::unique_ptr<thread_pool> _worker_pool;
 		std::chrono::high_resolution_clock::time_point _last_reload_time;
 		#pragma endregion
 
@@ -403,6 +432,18 @@ namespace reshade
 		api::resource_view _effect_stencil_dsv = {};
 
 		std::unordered_map<size_t, api::sampler> _effect_sampler_states;
+
+		struct effect_variant
+		{
+			std::filesystem::path source_file;
+			size_t source_hash;
+			size_t spec_constants_hash;
+			api::pipeline_layout layout;
+			std::vector<api::pipeline> pipelines;
+		};
+
+		// Pipelines of effects compiled in performance mode that are not currently loaded, least recently used first
+		std::vector<effect_variant> _effect_variants;
 		std::unordered_map<std::string, std::pair<api::resource_view, api::resource_view>> _texture_semantic_bindings;
 		std::unordered_map<std::string, std::pair<api::resource_view, api::resource_view>> _backup_texture_semantic_bindings;
 #endif
@@ -617,13 +617,18 @@ void reshade::runtime::update_texture_bindings(const char *semantic, api::resour
 	// Update texture bindings
 	size_t num_bindings = 0;
 	for (effect &effect_data : _effects)
-		num_bindings += effect_data.texture_semantic_to_binding.size();
+		if (is_effect_available(&effect_data - _effects.data()))
+			num_bindings += effect_data.texture_semantic_to_binding.size();
 
 	std::vector<api::descriptor_set_update> descriptor_writes;
 	std::vector<api::sampler_with_resource_view> sampler_descriptors(num_bindings);
 
 	for (effect &effect_data : _effects)
 	{
+		// Effects that are still being loaded are bound when they are created
+		if (!is_effect_available(&effect_data - _effects.data()))
+			continue;
+
 		for (const auto &binding : effect_data.texture_semantic_to_binding)
 		{
 			if (binding.semantic != semantic)
@@ -15,6 +15,7 @@
 #include "input.hpp"
 #include "imgui_widgets.hpp"
 #include "process_utils.hpp"
+#include "cache_pack.hpp"
 #include "fonts/forkawesome.inl"
 #include <fstream>
 #include <algorithm>
@@ -1766,6 +1767,7 @@ void reshade::runtime::draw_gui_statistics()
 	unsigned int cpu_digits = 1;
 	uint64_t post_processing_time_cpu = 0;
 	uint64_t post_processing_time_gpu = 0;
+	const std::shared_ptr<cache_pack> effect_cache = std::atomic_load(&_effect_cache);
 
 	if (!is_loading() && _effects_enabled)
 	{
@@ -1804,6 +1806,8 @@ void reshade::runtime::draw_gui_statistics()
 		ImGui::Text("Frame %llu:", _framecount + 1);
 #if RESHADE_FX
 		ImGui::TextUnformatted("Post-Processing:");
+		if (effect_cache != nullptr)
+			ImGui::TextUnformatted("Effect Cache:");
 #endif
 
 		ImGui::EndGroup();
@@ -1843,6 +1847,8 @@ void reshade::runtime::draw_gui_statistics()
 		ImGui::Text("%.2f fps", _imgui_context->IO.Framerate);
 #if RESHADE_FX
 		ImGui::Text("%*.3f ms CPU", cpu_digits + 4, post_processing_time_cpu * 1e-6f);
+		if (effect_cache != nullptr)
+			ImGui::Text("%llu hits, %llu misses", effect_cache->hits(), effect_cache->misses());
 #endif
 
 		ImGui::EndGroup();
@@ -1860,6 +1866,10 @@ void reshade::runtime::draw_gui_statistics()
 #if RESHADE_FX
 		if (_gather_gpu_statistics && post_processing_time_gpu != 0)
 			ImGui::Text("%*.3f ms GPU", gpu_digits + 4, (post_processing_time_gpu * 1e-6f));
+		else if (effect_cache != nullptr)
+			ImGui::NewLine();
+		if (effect_cache != nullptr)
+			ImGui::Text("%.1f MiB", effect_cache->size() / (1024.0f * 1024.0f));
 #endif
 
 		ImGui::EndGroup();
@@ -2972,6 +2982,8 @@ void reshade::runtime::draw_variable_editor()
 
 			const bool reload_successful_before = _last_reload_successfull;
 
+			update_search_path_snapshot();
+
 			// Reload current effect file
 			if (!reload_effect(effect_index, true) &&
 				modified_definition != _preset_preprocessor_definitions.end())
@@ -3320,6 +3332,8 @@ void reshade::runtime::draw_technique_editor()
 
 	if (force_reload_effect != std::numeric_limits<size_t>::max())
 	{
+		update_search_path_snapshot();
+
 		reload_effect(force_reload_effect, true);
 
 		// Reloading an effect file invalidates all textures, but the statistics window may already have drawn references to those, so need to reset it
@@ -3421,6 +3435,9 @@ void reshade::runtime::draw_code_editor(editor_instance &instance)
 			// Clear modified flag, so that errors are updated next frame (see 'update_and_render_effects')
 			instance.editor.clear_modified();
 
+			// The file was just written, so take a new snapshot for its modification time to be picked up
+			update_search_path_snapshot();
+
 			reload_effect(instance.effect_index);
 
 			// Reloading an effect file invalidates all textures, but the statistics window may already have drawn references to those, so need to reset it
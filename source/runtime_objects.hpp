@@ -251,10 +251,16 @@ namespace reshade
 		bool preprocessed = false;
 		std::string errors;
 		reshadefx::module module;
+		std::shared_ptr<const reshadefx::module> unspecialized_module;
 		size_t source_hash = 0;
+		size_t attributes_hash = 0;
+		size_t spec_constants_hash = 0;
 		std::filesystem::path source_file;
+		std::string dependencies;
 		std::vector<std::filesystem::path> included_files;
 		std::vector<std::pair<std::string, std::string>> definitions;
+		std::unordered_set<std::string> referenced_definitions;
+		bool referenced_definitions_known = false;
 		std::unordered_map<std::string, std::pair<std::string, std::string>> assembly;
 		std::vector<uniform> uniforms;
 		std::vector<uint8_t> uniform_data_storage;
@@ -275,5 +281,27 @@ namespace reshade
 		api::query_pool query_pool = {};
 		std::vector<binding_data> texture_semantic_to_binding;
 	};
+
+	// Listing of all files in the effect and texture search paths, which is taken once per reload and shared by all lookups during it
+	struct search_path_snapshot
+	{
+		struct file
+		{
+			std::filesystem::path path;
+			uintmax_t size = 0;
+			std::filesystem::file_time_type last_write_time;
+		};
+		struct directory
+		{
+			std::filesystem::path path;
+			std::vector<file> files;
+			std::unordered_map<std::wstring, size_t> file_lookup;
+		};
+
+		std::vector<directory> directories;
+		std::unordered_map<std::wstring, size_t> directory_lookup;
+		std::vector<size_t> effect_directories;
+		std::vector<size_t> texture_directories;
+	};
 #endif
 }
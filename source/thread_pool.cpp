@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2014 Patrick Mours
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "thread_pool.hpp"
+#include <cassert>
+#include <algorithm>
+
+// Identifies the pool and queue of the worker thread that is currently executing, so that tasks it queues are added to its own queue
+static thread_local const reshade::thread_pool *s_current_pool = nullptr;
+static thread_local size_t s_current_queue_index = 0;
+
+reshade::thread_pool::thread_pool(size_t num_threads)
+{
+	num_threads = std::max<size_t>(num_threads, 1);
+
+	for (size_t i = 0; i < num_threads; ++i)
+		_queues.push_back(std::make_unique<task_queue>());
+
+	for (size_t i = 0; i < num_threads; ++i)
+		_threads.emplace_back(&thread_pool::worker_main, this, i);
+}
+reshade::thread_pool::~thread_pool()
+{
+	wait();
+
+	{	const std::unique_lock<std::mutex> lock(_mutex);
+		_shutdown = true;
+	}
+
+	_task_available.notify_all();
+
+	for (std::thread &thread : _threads)
+		thread.join();
+}
+
+void reshade::thread_pool::submit(std::function<void()> task)
+{
+	const size_t queue_index = (s_current_pool == this) ? s_current_queue_index : _next_queue_index++ % _queues.size();
+
+	_num_pending_tasks++;
+
+	// Update the count before the task becomes visible, so that a worker taking it cannot decrement the count below zero
+	// This happens while holding the lock the workers wait with, so that none of them can miss the notification
+	{	const std::unique_lock<std::mutex> lock(_mutex);
+		_num_queued_tasks++;
+	}
+
+	{	const std::unique_lock<std::mutex> lock(_queues[queue_index]->mutex);
+		_queues[queue_index]->tasks.push_back(std::move(task));
+	}
+
+	_task_available.notify_one();
+}
+
+void reshade::thread_pool::parallel_for(size_t count, const std::function<void(size_t)> &func)
+{
+	if (count == 0)
+		return;
+
+	struct shared_state
+	{
+		std::atomic<size_t> next_index = 0;
+		std::atomic<size_t> remaining = 0;
+		std::mutex mutex;
+		std::condition_variable finished;
+	};
+
+	const auto state = std::make_shared<shared_state>();
+	state->remaining = count;
+
+	// Every participating thread keeps taking the next index until all are taken, so it does not matter how many helpers actually get to run
+	// Helpers that only start after all indices were taken return without touching the function, which may no longer exist at that point
+	const auto run = [state, count, &func]() {
+		for (size_t index; (index = state->next_index++) < count;)
+		{
+			func(index);
+
+			if (--state->remaining == 0)
+			{
+				const std::unique_lock<std::mutex> lock(state->mutex);
+				state->finished.notify_all();
+			}
+		}
+	};
+
+	for (size_t i = 0; i < std::min(count - 1, _threads.size()); ++i)
+		submit(run);
+
+	run();
+
+	// Only indices that other threads are already executing can be left at this point, so this does not depend on any queued task and cannot deadlock
+	std::unique_lock<std::mutex> lock(state->mutex);
+	state->finished.wait(lock, [&state]() { return state->remaining == 0; });
+}
+
+void reshade::thread_pool::wait()
+{
+	assert(s_current_pool != this);
+
+	std::unique_lock<std::mutex> lock(_mutex);
+	_tasks_finished.wait(lock, [this]() { return _num_pending_tasks == 0; });
+}
+
+bool reshade::thread_pool::pop_task(size_t queue_index, std::function<void()> &task)
+{
+	// Take tasks from the front of the own queue first, so that they are executed in the order they were queued
+	{	task_queue &queue = *_queues[queue_index];
+		const std::unique_lock<std::mutex> lock(queue.mutex);
+
+		if (!queue.tasks.empty())
+		{
+			task = std::move(queue.tasks.front());
+			queue.tasks.pop_front();
+			return true;
+		}
+	}
+
+	// Otherwise steal from the front of the queues of the other workers too, since tasks are queued in order of priority (e.g. effects used by the current preset first)
+	for (size_t i = 1; i < _queues.size(); ++i)
+	{
+		task_queue &queue = *_queues[(queue_index + i) % _queues.size()];
+		const std::unique_lock<std::mutex> lock(queue.mutex);
+
+		if (!queue.tasks.empty())
+		{
+			task = std::move(queue.tasks.front());
+			queue.tasks.pop_front();
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void reshade::thread_pool::worker_main(size_t queue_index)
+{
+	s_current_pool = this;
+	s_current_queue_index = queue_index;
+
+	while (true)
+	{
+		std::function<void()> task;
+		if (!pop_task(queue_index, task))
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_task_available.wait(lock, [this]() { return _shutdown || _num_queued_tasks != 0; });
+
+			if (_shutdown && _num_queued_tasks == 0)
+				break;
+			continue;
+		}
+
+		_num_queued_tasks--;
+
+		task();
+		task = nullptr;
+
+		if (--_num_pending_tasks == 0)
+		{
+			const std::unique_lock<std::mutex> lock(_mutex);
+			_tasks_finished.notify_all();
+		}
+	}
+}
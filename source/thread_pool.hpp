@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2014 Patrick Mours
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#pragma once
+
+#include <mutex>
+#include <deque>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+namespace reshade
+{
+	/// <summary>
+	/// A pool of persistent worker threads that execute queued tasks.
+	/// Every worker has its own queue, and workers that run out of tasks steal them from the queues of other workers, so that a single long-running task does not hold up others.
+	/// </summary>
+	class thread_pool
+	{
+	public:
+		/// <summary>
+		/// Starts the worker threads.
+		/// </summary>
+		/// <param name="num_threads">Number of worker threads to start.</param>
+		explicit thread_pool(size_t num_threads);
+		/// <summary>
+		/// Waits for all queued tasks to finish and then stops the worker threads.
+		/// </summary>
+		~thread_pool();
+
+		thread_pool(const thread_pool &) = delete;
+		thread_pool &operator=(const thread_pool &) = delete;
+
+		/// <summary>
+		/// Gets the number of worker threads.
+		/// </summary>
+		size_t num_threads() const { return _threads.size(); }
+
+		/// <summary>
+		/// Queues a task for execution on one of the worker threads.
+		/// Tasks queued from a worker thread are added to the queue of that worker, tasks queued from other threads are distributed across all queues.
+		/// </summary>
+		/// <param name="task">Function to execute.</param>
+		void submit(std::function<void()> task);
+
+		/// <summary>
+		/// Calls the specified function for every index in the range [0, <paramref name="count"/>), in parallel on the calling thread and the worker threads, and returns once all calls finished.
+		/// This may be called from within a task too.
+		/// </summary>
+		/// <param name="count">Number of indices.</param>
+		/// <param name="func">Function to call with every index.</param>
+		void parallel_for(size_t count, const std::function<void(size_t)> &func);
+
+		/// <summary>
+		/// Blocks until all queued tasks finished executing.
+		/// This must not be called from within a task.
+		/// </summary>
+		void wait();
+
+	private:
+		struct task_queue
+		{
+			std::mutex mutex;
+			std::deque<std::function<void()>> tasks;
+		};
+
+		bool pop_task(size_t queue_index, std::function<void()> &task);
+		void worker_main(size_t queue_index);
+
+		std::vector<std::unique_ptr<task_queue>> _queues;
+		std::vector<std::thread> _threads;
+		std::mutex _mutex;
+		std::condition_variable _task_available;
+		std::condition_variable _tasks_finished;
+		std::atomic<size_t> _num_queued_tasks = 0;
+		std::atomic<size_t> _num_pending_tasks = 0;
+		std::atomic<size_t> _next_queue_index = 0;
+		bool _shutdown = false;
+	};
+}
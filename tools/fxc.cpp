@@ -3,15 +3,49 @@
  * SPDX-License-Identifier: BSD-3-Clause
  */
 
+#include "effect_lexer.hpp"
 #include "effect_parser.hpp"
 #include "effect_codegen.hpp"
 #include "effect_preprocessor.hpp"
 #include "version.h"
+#include <atomic>
+#include <chrono>
 #include <cstdlib>
 #include <cstring>
 #include <fstream>
 #include <iostream>
 
+// Count heap allocations, so that the benchmark can report them alongside the time spent in each step (only enabled while benchmarking)
+static bool s_count_allocations = false;
+static std::atomic<size_t> s_allocation_count = 0;
+
+void *operator new(size_t size)
+{
+	if (s_count_allocations)
+		s_allocation_count.fetch_add(1, std::memory_order_relaxed);
+	if (void *const ptr = std::malloc(size != 0 ? size : 1))
+		return ptr;
+	throw std::bad_alloc();
+}
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+	if (s_count_allocations)
+		s_allocation_count.fetch_add(1, std::memory_order_relaxed);
+	return std::malloc(size != 0 ? size : 1);
+}
+void operator delete(void *ptr) noexcept
+{
+	std::free(ptr);
+}
+void operator delete(void *ptr, size_t) noexcept
+{
+	std::free(ptr);
+}
+void operator delete(void *ptr, const std::nothrow_t &) noexcept
+{
+	std::free(ptr);
+}
+
 static void print_usage(const char *path)
 {
 	printf(R"(usage: %s [options] <filename>
@@ -36,8 +70,11 @@ Options:
   --invert-y                Insert code to invert the Y component of the output position in vertex shaders (only applies to SPIR-V).
   --spec-constants          Convert uniform variables to specialization constants.
   --vulkan-semantics        Generate GLSL/SPIR-V code under Vulkan semantics, instead of OpenGL semantics.
+  --optimize                Run optimization passes on the generated SPIR-V code (dead code elimination, constant folding, load forwarding and common subexpression elimination).
 
   -Zi                       Enable debug information.
+
+  --benchmark <count>       Pre-process and compile the input file the specified number of times and print the time spent and heap allocations made in each step, followed by the lexer throughput on the pre-processed result and the size of the generated SPIR-V code.
 	)", path);
 }
 
@@ -55,12 +92,14 @@ int main(int argc, char *argv[])
 	bool invert_y_axis = false;
 	bool spec_constants = false;
 	bool vulkan_semantics = false;
+	bool optimize = false;
 	unsigned int shader_model = 50;
+	unsigned int benchmark_count = 0;
 
-	reshadefx::parser parser;
-	reshadefx::preprocessor pp;
-	pp.add_macro_definition("__RESHADE__", std::to_string(VERSION_MAJOR * 10000 + VERSION_MINOR * 100 + VERSION_REVISION));
-	pp.add_macro_definition("__RESHADE_PERFORMANCE_MODE__", "0");
+	std::vector<std::string> include_paths;
+	std::vector<std::pair<std::string, std::string>> macro_definitions;
+	macro_definitions.emplace_back("__RESHADE__", std::to_string(VERSION_MAJOR * 10000 + VERSION_MINOR * 100 + VERSION_REVISION));
+	macro_definitions.emplace_back("__RESHADE_PERFORMANCE_MODE__", "0");
 
 	// Parse command-line arguments
 	for (int i = 1; i < argc; ++i)
@@ -83,13 +122,13 @@ int main(int argc, char *argv[])
 				char *macro = argv[++i];
 				char *value = std::strchr(macro, '=');
 				if (value) *value++ = '\0';
-				pp.add_macro_definition(macro, value ? value : "1");
+				macro_definitions.emplace_back(macro, value ? value : "1");
 				continue;
 			}
 
 			if (0 == std::strcmp(arg, "-I"))
 			{
-				pp.add_include_path(argv[++i]);
+				include_paths.emplace_back(argv[++i]);
 				continue;
 			}
 
@@ -105,6 +144,8 @@ int main(int argc, char *argv[])
 				spec_constants = true;
 			else if (0 == std::strcmp(arg, "--vulkan-semantics"))
 				vulkan_semantics = true;
+			else if (0 == std::strcmp(arg, "--optimize"))
+				optimize = true;
 
 			if (i + 1 >= argc)
 				continue;
@@ -120,6 +161,8 @@ int main(int argc, char *argv[])
 				buffer_width = argv[++i];
 			else if (0 == std::strcmp(arg, "--height"))
 				buffer_height = argv[++i];
+			else if (0 == std::strcmp(arg, "--benchmark"))
+				benchmark_count = std::strtoul(argv[++i], nullptr, 10);
 		}
 		else
 		{
@@ -139,10 +182,125 @@ int main(int argc, char *argv[])
 		return 1;
 	}
 
-	pp.add_macro_definition("BUFFER_WIDTH", buffer_width);
-	pp.add_macro_definition("BUFFER_HEIGHT", buffer_height);
-	pp.add_macro_definition("BUFFER_RCP_WIDTH", "(1.0 / BUFFER_WIDTH)");
-	pp.add_macro_definition("BUFFER_RCP_HEIGHT", "(1.0 / BUFFER_HEIGHT)");
+	macro_definitions.emplace_back("BUFFER_WIDTH", buffer_width);
+	macro_definitions.emplace_back("BUFFER_HEIGHT", buffer_height);
+	macro_definitions.emplace_back("BUFFER_RCP_WIDTH", "(1.0 / BUFFER_WIDTH)");
+	macro_definitions.emplace_back("BUFFER_RCP_HEIGHT", "(1.0 / BUFFER_HEIGHT)");
+
+	const auto create_backend = [&]() -> reshadefx::codegen * {
+		if (print_glsl)
+			return reshadefx::create_codegen_glsl(vulkan_semantics, debug_info, spec_constants, false, invert_y_axis);
+		else if (print_hlsl)
+			return reshadefx::create_codegen_hlsl(shader_model, debug_info, spec_constants);
+		else
+			return reshadefx::create_codegen_spirv(vulkan_semantics, debug_info, spec_constants, false, invert_y_axis, optimize);
+	};
+	const auto initialize_preprocessor = [&](reshadefx::preprocessor &pp) {
+		for (const auto &definition : macro_definitions)
+			pp.add_macro_definition(definition.first, definition.second);
+		for (const std::string &include_path : include_paths)
+			pp.add_include_path(include_path);
+	};
+
+	if (benchmark_count != 0)
+	{
+		using clock = std::chrono::high_resolution_clock;
+
+		// Share the include cache and base preprocessor state between iterations, like the runtime does between effects
+		const auto cache = std::make_shared<reshadefx::include_cache>();
+		reshadefx::preprocessor pp_base(cache);
+		initialize_preprocessor(pp_base);
+		pp_base.enable_output_tokens();
+
+		double preprocess_time[2] = {}, compile_time[2] = {};
+		size_t preprocess_allocations[2] = {}, compile_allocations[2] = {};
+		double write_result_time = 0;
+		std::string preprocessed;
+		std::vector<uint32_t> spirv;
+
+		s_count_allocations = true;
+
+		for (unsigned int iteration = 0; iteration < benchmark_count; ++iteration)
+		{
+			const size_t allocations_start = s_allocation_count;
+			const auto time_start = clock::now();
+
+			reshadefx::preprocessor pp(pp_base);
+			if (!pp.append_file(filename))
+			{
+				std::cout << pp.errors() << std::endl;
+				return 1;
+			}
+
+			const auto time_preprocessed = clock::now();
+			const size_t allocations_preprocessed = s_allocation_count;
+
+			std::unique_ptr<reshadefx::codegen> backend(create_backend());
+			reshadefx::parser parser;
+			if (!parser.parse(pp.output(), std::move(pp.output_tokens()), backend.get()))
+			{
+				std::cout << pp.errors() << parser.errors() << std::endl;
+				return 1;
+			}
+
+			const auto time_parsed = clock::now();
+
+			reshadefx::module module;
+			backend->write_result(module);
+
+			const auto time_compiled = clock::now();
+			const size_t allocations_compiled = s_allocation_count;
+
+			// Keep the first iteration separate, since it is the only one that has to read include files from disk
+			const size_t k = iteration == 0 ? 0 : 1;
+			preprocess_time[k] += std::chrono::duration<double, std::milli>(time_preprocessed - time_start).count();
+			compile_time[k] += std::chrono::duration<double, std::milli>(time_compiled - time_preprocessed).count();
+			preprocess_allocations[k] += allocations_preprocessed - allocations_start;
+			compile_allocations[k] += allocations_compiled - allocations_preprocessed;
+			write_result_time += std::chrono::duration<double, std::milli>(time_compiled - time_parsed).count();
+
+			preprocessed = std::move(pp.output());
+			spirv = std::move(module.spirv);
+		}
+
+		s_count_allocations = false;
+
+		printf("first iteration:   pre-process %8.3f ms, compile %8.3f ms\n", preprocess_time[0], compile_time[0]);
+		if (benchmark_count > 1)
+			printf("average of others: pre-process %8.3f ms, compile %8.3f ms\n", preprocess_time[1] / (benchmark_count - 1), compile_time[1] / (benchmark_count - 1));
+		printf("allocations:       pre-process %8zu,    compile %8zu (first iteration)\n", preprocess_allocations[0], compile_allocations[0]);
+		if (benchmark_count > 1)
+			printf("                   pre-process %8zu,    compile %8zu (average of others)\n", preprocess_allocations[1] / (benchmark_count - 1), compile_allocations[1] / (benchmark_count - 1));
+
+		// Tokenize the pre-processed result with the same settings the parser uses, to measure the lexer on its own
+		const auto input = std::make_shared<const std::string>(std::move(preprocessed));
+		size_t token_count = 0;
+
+		const auto time_start = clock::now();
+
+		for (unsigned int iteration = 0; iteration < benchmark_count; ++iteration)
+			for (reshadefx::lexer lexer(input); lexer.lex().id != reshadefx::tokenid::end_of_file;)
+				token_count++;
+
+		const double lex_time = std::chrono::duration<double>(clock::now() - time_start).count();
+		printf("lexer:             %8.3f MB/s, %zu tokens per iteration\n", (input->size() * benchmark_count) / (1024.0 * 1024.0) / lex_time, token_count / benchmark_count);
+
+		if (!spirv.empty())
+		{
+			// Skip the header and count instructions by their word count, which is stored in the high-order bits of the first word
+			size_t instruction_count = 0;
+			for (size_t i = 5; i < spirv.size(); i += spirv[i] >> 16)
+				instruction_count++;
+
+			printf("spir-v:            %8zu instructions, %zu words, write_result %8.3f ms on average%s\n", instruction_count, spirv.size(), write_result_time / benchmark_count, optimize ? " (including optimization passes)" : "");
+		}
+		return 0;
+	}
+
+	reshadefx::preprocessor pp;
+	initialize_preprocessor(pp);
+	if (preprocess == nullptr)
+		pp.enable_output_tokens();
 
 	if (!pp.append_file(filename))
 	{
@@ -162,15 +320,10 @@ int main(int argc, char *argv[])
 		return 0;
 	}
 
-	std::unique_ptr<reshadefx::codegen> backend;
-	if (print_glsl)
-		backend.reset(reshadefx::create_codegen_glsl(vulkan_semantics, debug_info, spec_constants, invert_y_axis));
-	else if (print_hlsl)
-		backend.reset(reshadefx::create_codegen_hlsl(shader_model, debug_info, spec_constants));
-	else
-		backend.reset(reshadefx::create_codegen_spirv(vulkan_semantics, debug_info, spec_constants, invert_y_axis));
+	std::unique_ptr<reshadefx::codegen> backend(create_backend());
 
-	if (!parser.parse(pp.output(), backend.get()))
+	reshadefx::parser parser;
+	if (!parser.parse(std::move(pp.output()), std::move(pp.output_tokens()), backend.get()))
 	{
 		if (errorfile == nullptr)
 			std::cout << pp.errors() << parser.errors() << std::endl;